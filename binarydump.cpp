@@ -0,0 +1,243 @@
+/// \file binarydump.cpp
+/// \brief Implementation of the serialization of binary dumps and of their
+///        conversion to CSV
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <tuple>
+#include <vector>
+
+// Local includes
+#include "binarydump.h"
+
+/// \brief Read a CSV file with a single column or two columns
+///
+/// \return false if the header doesn't match \p ExpectedHeader or a line
+///         doesn't have the expected number of columns.
+template<typename F>
+static bool readCSV(std::istream &Input,
+                    const char *ExpectedHeader,
+                    F Handler) {
+  std::string Line;
+  if (!std::getline(Input, Line) || Line != ExpectedHeader)
+    return false;
+
+  bool TwoColumns = std::string(ExpectedHeader).find(',') != std::string::npos;
+  while (std::getline(Input, Line)) {
+    if (Line.empty())
+      continue;
+
+    size_t Comma = Line.find(',');
+    if (TwoColumns != (Comma != std::string::npos))
+      return false;
+
+    if (TwoColumns)
+      Handler(Line.substr(0, Comma), Line.substr(Comma + 1));
+    else
+      Handler(Line, std::string());
+  }
+
+  return true;
+}
+
+bool BinaryDumpWriter::readCFG(std::istream &Input) {
+  return readCSV(Input, "source,destination",
+                 [this] (const std::string &Source,
+                         const std::string &Destination) {
+                   addEdge(Source, Destination);
+                 });
+}
+
+bool BinaryDumpWriter::readNoreturn(std::istream &Input) {
+  return readCSV(Input, "noreturn",
+                 [this] (const std::string &Name, const std::string &) {
+                   addNoreturn(Name);
+                 });
+}
+
+bool BinaryDumpWriter::readFunctionBoundaries(std::istream &Input) {
+  return readCSV(Input, "function,basicblock",
+                 [this] (const std::string &Function,
+                         const std::string &Name) {
+                   addMember(Function, Name);
+                 });
+}
+
+template<typename T>
+static void writeSection(std::ostream &Output,
+                         uint64_t &Offset,
+                         const std::vector<T> &Data) {
+  static const char Padding[8] = { 0 };
+  uint64_t Aligned = (Offset + 7) & ~uint64_t(7);
+  Output.write(Padding, Aligned - Offset);
+  Output.write(reinterpret_cast<const char *>(Data.data()),
+               Data.size() * sizeof(T));
+  Offset = Aligned + Data.size() * sizeof(T);
+}
+
+void BinaryDumpWriter::serialize(std::ostream &Output) {
+  // Sort the basic blocks: first the ones with a PC, by PC, then the others
+  using BlockEntry = std::pair<const std::string, BlockInfo>;
+  std::vector<BlockEntry *> Sorted;
+  Sorted.reserve(Blocks.size());
+  for (BlockEntry &Entry : Blocks)
+    Sorted.push_back(&Entry);
+
+  // Blocks is sorted by name, keep it as the last criterion
+  std::stable_sort(Sorted.begin(),
+                   Sorted.end(),
+                   [] (const BlockEntry *LHS, const BlockEntry *RHS) {
+                     return std::make_tuple(!LHS->second.HasPC, LHS->second.PC)
+                       < std::make_tuple(!RHS->second.HasPC, RHS->second.PC);
+                   });
+
+  for (uint32_t I = 0; I < Sorted.size(); I++)
+    Sorted[I]->second.Index = I;
+
+  // Build the string table, sharing the names of basic blocks and functions
+  std::vector<char> Strings;
+  std::map<std::string, uint32_t> StringOffsets;
+  auto GetString = [&Strings, &StringOffsets] (const std::string &String) {
+    auto It = StringOffsets.find(String);
+    if (It != StringOffsets.end())
+      return It->second;
+
+    uint32_t Offset = Strings.size();
+    Strings.insert(Strings.end(), String.begin(), String.end());
+    Strings.push_back('\0');
+    StringOffsets[String] = Offset;
+    return Offset;
+  };
+
+  // Basic blocks and CFG
+  std::vector<BinaryDumpBlock> BlockTable;
+  std::vector<uint32_t> EdgesBegin;
+  std::vector<uint32_t> Edges;
+  for (BlockEntry *Entry : Sorted) {
+    const BlockInfo &Info = Entry->second;
+
+    BinaryDumpBlock Block;
+    Block.PC = Info.PC;
+    Block.Name = GetString(Entry->first);
+    Block.Flags = 0;
+    if (Info.HasPC)
+      Block.Flags |= BinaryDumpBlock::HasPC;
+    if (Info.Noreturn)
+      Block.Flags |= BinaryDumpBlock::Noreturn;
+    BlockTable.push_back(Block);
+
+    EdgesBegin.push_back(Edges.size());
+    size_t First = Edges.size();
+    for (const std::string &Successor : Info.Successors)
+      Edges.push_back(Blocks[Successor].Index);
+    std::sort(Edges.begin() + First, Edges.end());
+  }
+  EdgesBegin.push_back(Edges.size());
+
+  // Functions, representing their basic blocks as ranges of indices
+  std::vector<uint32_t> FunctionNames;
+  std::vector<uint32_t> RangesBegin;
+  std::vector<BinaryDumpRange> Ranges;
+  for (auto &P : Functions) {
+    FunctionNames.push_back(GetString(P.first));
+    RangesBegin.push_back(Ranges.size());
+
+    std::vector<uint32_t> Members;
+    for (const std::string &Name : P.second)
+      Members.push_back(Blocks[Name].Index);
+    std::sort(Members.begin(), Members.end());
+
+    for (uint32_t Member : Members) {
+      if (Ranges.size() != RangesBegin.back() && Ranges.back().End == Member)
+        Ranges.back().End++;
+      else
+        Ranges.push_back(BinaryDumpRange { Member, Member + 1 });
+    }
+  }
+  RangesBegin.push_back(Ranges.size());
+
+  BinaryDumpHeader Header;
+  std::copy(std::begin(BinaryDumpMagic),
+            std::end(BinaryDumpMagic),
+            std::begin(Header.Magic));
+  Header.Version = BinaryDumpVersion;
+  Header.BlockCount = BlockTable.size();
+  Header.EdgeCount = Edges.size();
+  Header.FunctionCount = FunctionNames.size();
+  Header.RangeCount = Ranges.size();
+  Header.StringsSize = Strings.size();
+
+  uint64_t Offset = 0;
+  writeSection(Output, Offset, std::vector<BinaryDumpHeader> { Header });
+  writeSection(Output, Offset, BlockTable);
+  writeSection(Output, Offset, EdgesBegin);
+  writeSection(Output, Offset, Edges);
+  writeSection(Output, Offset, FunctionNames);
+  writeSection(Output, Offset, RangesBegin);
+  writeSection(Output, Offset, Ranges);
+  writeSection(Output, Offset, Strings);
+}
+
+/// \brief Compare basic blocks by name, as the CSV serializers do
+struct CompareBlockNames {
+  CompareBlockNames(const BinaryDump &Dump) : Dump(Dump) { }
+
+  bool operator()(uint32_t LHS, uint32_t RHS) const {
+    return strcmp(Dump.blockName(LHS), Dump.blockName(RHS)) < 0;
+  }
+
+  const BinaryDump &Dump;
+};
+
+static std::vector<uint32_t> blocksByName(const BinaryDump &Dump) {
+  std::vector<uint32_t> Result;
+  for (uint32_t I = 0; I < Dump.blockCount(); I++)
+    Result.push_back(I);
+  std::sort(Result.begin(), Result.end(), CompareBlockNames(Dump));
+  return Result;
+}
+
+void serializeCFG(const BinaryDump &Dump, std::ostream &Output) {
+  Output << "source,destination\n";
+  for (uint32_t Source : blocksByName(Dump)) {
+    auto Successors = Dump.successors(Source);
+    std::vector<uint32_t> Destinations(Successors.begin(), Successors.end());
+    std::sort(Destinations.begin(),
+              Destinations.end(),
+              CompareBlockNames(Dump));
+    for (uint32_t Destination : Destinations)
+      Output << Dump.blockName(Source) << ","
+             << Dump.blockName(Destination) << "\n";
+  }
+}
+
+void serializeNoreturn(const BinaryDump &Dump, std::ostream &Output) {
+  Output << "noreturn\n";
+  for (uint32_t Block : blocksByName(Dump))
+    if (Dump.isNoreturn(Block))
+      Output << Dump.blockName(Block) << "\n";
+}
+
+void serializeFunctionBoundaries(const BinaryDump &Dump,
+                                 std::ostream &Output) {
+  Output << "function,basicblock\n";
+
+  // Functions are already sorted by name
+  for (uint32_t Function = 0; Function < Dump.functionCount(); Function++) {
+    std::vector<uint32_t> Members;
+    for (const BinaryDumpRange &Range : Dump.functionBlocks(Function))
+      for (uint32_t Block = Range.Begin; Block < Range.End; Block++)
+        Members.push_back(Block);
+    std::sort(Members.begin(), Members.end(), CompareBlockNames(Dump));
+
+    for (uint32_t Block : Members)
+      Output << Dump.functionName(Function) << ","
+             << Dump.blockName(Block) << "\n";
+  }
+}
@@ -0,0 +1,323 @@
+#ifndef _BINARYDUMP_H
+#define _BINARYDUMP_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <string>
+
+/// \brief Header of a binary dump, a compact representation of the
+///        information produced by `revamb-dump`
+///
+/// A binary dump contains the CFG, the noreturn basic blocks and the function
+/// boundaries, i.e., the same information of the CSV files produced by
+/// `revamb-dump`, in a form that can be used directly after mapping it in
+/// memory. All the integers are in the byte order of the machine which
+/// produced the file. The file is composed by the following parts, each one
+/// starting at an offset multiple of 8:
+///
+/// 1. The header (BinaryDumpHeader).
+/// 2. The table of the basic blocks (BinaryDumpBlock[BlockCount]). Basic blocks
+///    whose PC is known come first, sorted by PC, then the others. Basic blocks
+///    are always referred by their index in this table.
+/// 3. The index of the first outgoing edge of each basic block
+///    (uint32_t[BlockCount + 1]).
+/// 4. The destination of each edge of the CFG (uint32_t[EdgeCount]), grouped
+///    by source and sorted. The same edge might appear more than once.
+/// 5. The name of each function (uint32_t[FunctionCount]), i.e., an offset in
+///    the string table. Functions are sorted by name.
+/// 6. The index of the first range of basic blocks of each function
+///    (uint32_t[FunctionCount + 1]).
+/// 7. The ranges of basic blocks belonging to the functions
+///    (BinaryDumpRange[RangeCount]), sorted and disjoint.
+/// 8. The string table (char[StringsSize]), a sequence of NUL-terminated
+///    strings.
+struct BinaryDumpHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t BlockCount;
+  uint32_t EdgeCount;
+  uint32_t FunctionCount;
+  uint32_t RangeCount;
+  uint32_t StringsSize;
+};
+
+static const char BinaryDumpMagic[8] = { 'R', 'V', 'B', 'D', 'U', 'M', 'P', 0 };
+static const uint32_t BinaryDumpVersion = 1;
+
+struct BinaryDumpBlock {
+  enum FlagsType : uint32_t {
+    HasPC = 1, ///< PC is meaningful
+    Noreturn = 2 ///< The basic block has been marked as noreturn
+  };
+
+  uint64_t PC;
+  /// Offset of the name of the basic block in the string table
+  uint32_t Name;
+  uint32_t Flags;
+};
+
+/// \brief A range of basic blocks, [Begin, End)
+struct BinaryDumpRange {
+  uint32_t Begin;
+  uint32_t End;
+};
+
+/// \brief Read-only accessor to a binary dump loaded or mapped in memory
+///
+/// The accessor doesn't own nor copy the data, which must outlive it.
+class BinaryDump {
+public:
+  /// \brief A pair of pointers, usable in range-based for loops
+  template<typename T>
+  class Range {
+  public:
+    Range(const T *Begin, const T *End) : Begin(Begin), End(End) { }
+
+    const T *begin() const { return Begin; }
+    const T *end() const { return End; }
+    size_t size() const { return End - Begin; }
+    bool empty() const { return Begin == End; }
+
+  private:
+    const T *Begin;
+    const T *End;
+  };
+
+public:
+  /// \brief Interpret the \p Size bytes at \p Data as a binary dump
+  ///
+  /// The content is validated, use valid() to check the outcome. \p Data must
+  /// be aligned to 8 bytes, which is always the case for mapped files.
+  BinaryDump(const void *Data, size_t Size) :
+    Base(static_cast<const char *>(Data)),
+    Size(Size),
+    Valid(false) {
+    Valid = parse();
+  }
+
+  bool valid() const { return Valid; }
+
+  uint32_t blockCount() const { return Header->BlockCount; }
+  const BinaryDumpBlock &block(uint32_t Index) const { return Blocks[Index]; }
+  const char *blockName(uint32_t Index) const {
+    return Strings + Blocks[Index].Name;
+  }
+
+  bool hasPC(uint32_t Index) const {
+    return (Blocks[Index].Flags & BinaryDumpBlock::HasPC) != 0;
+  }
+
+  bool isNoreturn(uint32_t Index) const {
+    return (Blocks[Index].Flags & BinaryDumpBlock::Noreturn) != 0;
+  }
+
+  /// \brief Return the index of the basic block starting at \p PC, or
+  ///        blockCount() if there's none
+  uint32_t findBlock(uint64_t PC) const {
+    const BinaryDumpBlock *End = Blocks + pcBlockCount();
+    auto *It = std::lower_bound(Blocks, End, PC,
+                                [] (const BinaryDumpBlock &Block,
+                                    uint64_t PC) {
+                                  return Block.PC < PC;
+                                });
+    if (It == End || It->PC != PC)
+      return blockCount();
+    return It - Blocks;
+  }
+
+  /// \brief Return the indices of the successors of the basic block at index
+  ///        \p Index
+  Range<uint32_t> successors(uint32_t Index) const {
+    return Range<uint32_t>(Edges + EdgesBegin[Index],
+                           Edges + EdgesBegin[Index + 1]);
+  }
+
+  uint32_t functionCount() const { return Header->FunctionCount; }
+  const char *functionName(uint32_t Index) const {
+    return Strings + FunctionNames[Index];
+  }
+
+  /// \brief Return the ranges of basic blocks belonging to the function at
+  ///        index \p Index
+  Range<BinaryDumpRange> functionBlocks(uint32_t Index) const {
+    return Range<BinaryDumpRange>(Ranges + RangesBegin[Index],
+                                  Ranges + RangesBegin[Index + 1]);
+  }
+
+  /// \brief Return true if the basic block at index \p Block belongs to the
+  ///        function at index \p Function
+  bool isMember(uint32_t Function, uint32_t Block) const {
+    Range<BinaryDumpRange> Members = functionBlocks(Function);
+    auto *It = std::upper_bound(Members.begin(), Members.end(), Block,
+                                [] (uint32_t Block,
+                                    const BinaryDumpRange &Range) {
+                                  return Block < Range.End;
+                                });
+    return It != Members.end() && It->Begin <= Block;
+  }
+
+private:
+  static size_t align(size_t Offset) { return (Offset + 7) & ~size_t(7); }
+
+  template<typename T>
+  bool section(size_t &Offset, size_t Count, const T *&Result) {
+    Offset = align(Offset);
+    if (Offset > Size || (Size - Offset) / sizeof(T) < Count)
+      return false;
+
+    Result = reinterpret_cast<const T *>(Base + Offset);
+    Offset += Count * sizeof(T);
+    return true;
+  }
+
+  /// \brief Number of basic blocks whose PC is known
+  uint32_t pcBlockCount() const {
+    auto *End = Blocks + blockCount();
+    auto *It = std::partition_point(Blocks, End,
+                                    [] (const BinaryDumpBlock &Block) {
+                                      return (Block.Flags
+                                              & BinaryDumpBlock::HasPC) != 0;
+                                    });
+    return It - Blocks;
+  }
+
+  bool parse() {
+    size_t Offset = 0;
+    if (!section(Offset, 1, Header)
+        || memcmp(Header->Magic, BinaryDumpMagic, sizeof(BinaryDumpMagic)) != 0
+        || Header->Version != BinaryDumpVersion)
+      return false;
+
+    if (!section(Offset, Header->BlockCount, Blocks)
+        || !section(Offset, size_t(Header->BlockCount) + 1, EdgesBegin)
+        || !section(Offset, Header->EdgeCount, Edges)
+        || !section(Offset, Header->FunctionCount, FunctionNames)
+        || !section(Offset, size_t(Header->FunctionCount) + 1, RangesBegin)
+        || !section(Offset, Header->RangeCount, Ranges)
+        || !section(Offset, Header->StringsSize, Strings))
+      return false;
+
+    // All the strings must be terminated
+    uint32_t StringsSize = Header->StringsSize;
+    if (StringsSize != 0 && Strings[StringsSize - 1] != '\0')
+      return false;
+
+    for (uint32_t I = 0; I < Header->BlockCount; I++) {
+      if (Blocks[I].Name >= StringsSize
+          || EdgesBegin[I] > EdgesBegin[I + 1])
+        return false;
+    }
+
+    if (EdgesBegin[0] != 0
+        || EdgesBegin[Header->BlockCount] != Header->EdgeCount)
+      return false;
+
+    for (uint32_t I = 0; I < Header->EdgeCount; I++)
+      if (Edges[I] >= Header->BlockCount)
+        return false;
+
+    for (uint32_t I = 0; I < Header->FunctionCount; I++) {
+      if (FunctionNames[I] >= StringsSize
+          || RangesBegin[I] > RangesBegin[I + 1])
+        return false;
+    }
+
+    if (RangesBegin[0] != 0
+        || RangesBegin[Header->FunctionCount] != Header->RangeCount)
+      return false;
+
+    for (uint32_t I = 0; I < Header->RangeCount; I++) {
+      if (Ranges[I].Begin >= Ranges[I].End
+          || Ranges[I].End > Header->BlockCount)
+        return false;
+    }
+
+    return true;
+  }
+
+private:
+  const char *Base;
+  size_t Size;
+  bool Valid;
+
+  const BinaryDumpHeader *Header;
+  const BinaryDumpBlock *Blocks;
+  const uint32_t *EdgesBegin;
+  const uint32_t *Edges;
+  const uint32_t *FunctionNames;
+  const uint32_t *RangesBegin;
+  const BinaryDumpRange *Ranges;
+  const char *Strings;
+};
+
+/// \brief Collect the information to store in a binary dump and serialize it
+///
+/// Basic blocks and functions are identified by name, as in the CSV files
+/// produced by `revamb-dump`.
+class BinaryDumpWriter {
+public:
+  /// \brief Register a basic block whose PC is unknown
+  void addBlock(const std::string &Name) { Blocks[Name]; }
+
+  /// \brief Register a basic block starting at \p PC
+  void addBlock(const std::string &Name, uint64_t PC) {
+    BlockInfo &Info = Blocks[Name];
+    Info.HasPC = true;
+    Info.PC = PC;
+  }
+
+  void addEdge(const std::string &Source, const std::string &Destination) {
+    addBlock(Destination);
+    Blocks[Source].Successors.insert(Destination);
+  }
+
+  void addNoreturn(const std::string &Name) { Blocks[Name].Noreturn = true; }
+
+  void addMember(const std::string &Function, const std::string &Name) {
+    addBlock(Name);
+    Functions[Function].insert(Name);
+  }
+
+  /// \brief Parse the CSV files produced by `revamb-dump`
+  ///
+  /// \return false if the input is malformed.
+  bool readCFG(std::istream &Input);
+  bool readNoreturn(std::istream &Input);
+  bool readFunctionBoundaries(std::istream &Input);
+
+  void serialize(std::ostream &Output);
+
+private:
+  struct BlockInfo {
+    BlockInfo() : HasPC(false), PC(0), Noreturn(false), Index(0) { }
+
+    bool HasPC;
+    uint64_t PC;
+    bool Noreturn;
+    /// Successors, possibly repeated, as in the CFG produced by CollectCFG
+    std::multiset<std::string> Successors;
+    uint32_t Index;
+  };
+
+private:
+  std::map<std::string, BlockInfo> Blocks;
+  std::map<std::string, std::set<std::string>> Functions;
+};
+
+/// \brief Write the content of \p Dump in the CSV formats used by
+///        `revamb-dump`
+void serializeCFG(const BinaryDump &Dump, std::ostream &Output);
+void serializeNoreturn(const BinaryDump &Dump, std::ostream &Output);
+void serializeFunctionBoundaries(const BinaryDump &Dump, std::ostream &Output);
+
+#endif // _BINARYDUMP_H
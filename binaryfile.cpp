@@ -6,9 +6,13 @@
 //
 
 // Standard includes
+#include <algorithm>
+#include <functional>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 // LLVM includes
 #include "llvm/ADT/ArrayRef.h"
@@ -156,7 +160,8 @@ void BinaryFile::parseELF(object::ObjectFile *TheBinary, bool UseSections) {
       Symbols.push_back({
         Symbol.getName(StrtabContent).get(),
         Symbol.st_value,
-        Symbol.st_size
+        Symbol.st_size,
+        Symbol.getType() == ELF::STT_FUNC
       });
     }
   }
@@ -166,6 +171,19 @@ void BinaryFile::parseELF(object::ObjectFile *TheBinary, bool UseSections) {
   ProgramHeaders.Count = ElfHeader->e_phnum;
   ProgramHeaders.Size = ElfHeader->e_phentsize;
 
+  // Collect the sections containing code once for all the segments
+  std::vector<std::pair<uint64_t, uint64_t>> ExecutableSections;
+  if (UseSections) {
+    using Elf_Shdr = const typename object::ELFFile<T>::Elf_Shdr;
+    for (Elf_Shdr &SectionHeader : TheELF.sections()) {
+      if (SectionHeader.sh_flags & ELF::SHF_EXECINSTR) {
+        auto SectionStart = SectionHeader.sh_addr;
+        auto SectionEnd = SectionStart + SectionHeader.sh_size;
+        ExecutableSections.push_back(make_pair(SectionStart, SectionEnd));
+      }
+    }
+  }
+
   // Loop over the program headers looking for PT_LOAD segments, read them out
   // and create a global variable for each one of them (writable or read-only),
   // assign them a section and output information about them in the linking info
@@ -188,17 +206,8 @@ void BinaryFile::parseELF(object::ObjectFile *TheBinary, bool UseSections) {
 
         // If it's an executable segment, and we've been asked so, register
         // which sections actually contain code
-        if (UseSections && Segment.IsExecutable) {
-          using Elf_Shdr = const typename object::ELFFile<T>::Elf_Shdr;
-          auto Inserter = std::back_inserter(Segment.ExecutableSections);
-          for (Elf_Shdr &SectionHeader : TheELF.sections()) {
-            if (SectionHeader.sh_flags & ELF::SHF_EXECINSTR) {
-              auto SectionStart = SectionHeader.sh_addr;
-              auto SectionEnd = SectionStart + SectionHeader.sh_size;
-              Inserter = make_pair(SectionStart, SectionEnd);
-            }
-          }
-        }
+        if (UseSections && Segment.IsExecutable)
+          Segment.ExecutableSections = ExecutableSections;
 
         Segments.push_back(Segment);
 
@@ -427,6 +436,10 @@ void BinaryFile::parseEHFrame(uint64_t EHFrameAddress,
   DenseMap<uint64_t, DecodedCIE> CachedCIEs;
   unsigned FDEIndex = 0;
 
+  // The FDEs are parsed later, in parallel. For each FDE, record the offset
+  // where its PCBegin field starts and the offset of its CIE.
+  std::vector<std::pair<uint64_t, uint64_t>> FDEs;
+
   while (!EHFrameReader.eof()
          && ((FDEsCount && FDEIndex < *FDEsCount)
              || (EHFrameSize && EHFrameReader.offset() < *EHFrameSize))) {
@@ -511,7 +524,7 @@ void BinaryFile::parseEHFrame(uint64_t EHFrameAddress,
                   dbg << "Personality function: " << PersonalityPtr << "\n";
                 });
               // TODO: technically this is not a landing pad
-              LandingPads.insert(PersonalityPtr);
+              LandingPads.push_back(PersonalityPtr);
               break;
             }
             case 'R':
@@ -545,36 +558,93 @@ void BinaryFile::parseEHFrame(uint64_t EHFrameAddress,
              && "Couldn't find CIE at offset in to __eh_frame section");
 
       // Ensure we have at least the pointer encoding
-      const DecodedCIE &CIE = CIEIt->getSecond();
-      assert(CIE.FDEPointerEncoding &&
+      assert(CIEIt->getSecond().FDEPointerEncoding &&
              "FDE references CIE which did not set pointer encoding");
 
+      FDEs.push_back({ EHFrameReader.offset(), CIEOffset });
+    }
+
+    // Skip all the remaining parts
+    EHFrameReader.moveTo(EndOffset);
+  }
+
+  // Parse the FDEs in [Begin, End) and their LSDAs, collecting the landing
+  // pads in Result, sorted. CachedCIEs is only read from now on, therefore it
+  // can be shared among threads.
+  auto ParseFDEs = [this, &EHFrame, EHFrameAddress, &FDEs, &CachedCIEs]
+    (size_t Begin, size_t End, std::vector<uint64_t> &Result) {
+    for (size_t I = Begin; I < End; I++) {
+      uint64_t Offset, CIEOffset;
+      std::tie(Offset, CIEOffset) = FDEs[I];
+      const DecodedCIE &CIE = CachedCIEs.find(CIEOffset)->getSecond();
+
+      DwarfReader<T> FDEReader(EHFrame, EHFrameAddress);
+      FDEReader.moveTo(Offset);
+
       // PCBegin
-      auto PCBeginPointer = EHFrameReader.readPointer(*CIE.FDEPointerEncoding);
+      auto PCBeginPointer = FDEReader.readPointer(*CIE.FDEPointerEncoding);
       uint64_t PCBegin = getPointer<T>(PCBeginPointer);
       DBG("ehframe", dbg << "PCBegin: " << std::hex << PCBegin << "\n");
 
       // PCRange
-      EHFrameReader.readPointer(*CIE.FDEPointerEncoding);
+      FDEReader.readPointer(*CIE.FDEPointerEncoding);
 
       if (CIE.hasAugmentationLength)
-        EHFrameReader.readULEB128();
+        FDEReader.readULEB128();
 
       // Decode the LSDA if the CIE augmentation string said we should.
       if (CIE.LSDAPointerEncoding) {
-        auto LSDAPointer = EHFrameReader.readPointer(*CIE.LSDAPointerEncoding);
-        parseLSDA<T>(PCBegin, getPointer<T>(LSDAPointer));
+        auto LSDAPointer = FDEReader.readPointer(*CIE.LSDAPointerEncoding);
+        parseLSDA<T>(PCBegin, getPointer<T>(LSDAPointer), Result);
       }
     }
 
-    // Skip all the remaining parts
-    EHFrameReader.moveTo(EndOffset);
+    std::sort(Result.begin(), Result.end());
+  };
+
+  // Split the FDEs in chunks, one per thread, unless they are too few to be
+  // worth it. The debug output of multiple threads would be garbled, in that
+  // case stick to a single one.
+  const size_t MinChunkSize = 1024;
+  size_t ChunksCount = std::max(std::thread::hardware_concurrency(), 1U);
+  ChunksCount = std::min(ChunksCount,
+                         (FDEs.size() + MinChunkSize - 1) / MinChunkSize);
+  if (ChunksCount == 0
+      || (DebuggingEnabled && isDebugFeatureEnabled("ehframe")))
+    ChunksCount = 1;
+  size_t ChunkSize = (FDEs.size() + ChunksCount - 1) / ChunksCount;
+
+  // The first chunk is parsed on the current thread
+  std::vector<std::vector<uint64_t>> Chunks(ChunksCount);
+  std::vector<std::thread> Threads;
+  for (size_t I = 1; I < ChunksCount; I++) {
+    size_t Begin = std::min(I * ChunkSize, FDEs.size());
+    size_t End = std::min(Begin + ChunkSize, FDEs.size());
+    Threads.emplace_back(ParseFDEs, Begin, End, std::ref(Chunks[I]));
+  }
+  ParseFDEs(0, std::min(ChunkSize, FDEs.size()), Chunks[0]);
+
+  for (std::thread &Thread : Threads)
+    Thread.join();
+
+  // Merge the sorted results of each chunk with the personality functions
+  std::sort(LandingPads.begin(), LandingPads.end());
+  for (std::vector<uint64_t> &Chunk : Chunks) {
+    size_t Middle = LandingPads.size();
+    LandingPads.insert(LandingPads.end(), Chunk.begin(), Chunk.end());
+    std::inplace_merge(LandingPads.begin(),
+                       LandingPads.begin() + Middle,
+                       LandingPads.end());
   }
 
+  LandingPads.erase(std::unique(LandingPads.begin(), LandingPads.end()),
+                    LandingPads.end());
 }
 
 template<typename T>
-void BinaryFile::parseLSDA(uint64_t FDEStart, uint64_t LSDAAddress) {
+void BinaryFile::parseLSDA(uint64_t FDEStart,
+                           uint64_t LSDAAddress,
+                           std::vector<uint64_t> &Result) const {
   DBG("ehframe", dbg << "LSDAAddress: " << std::hex << LSDAAddress << "\n");
 
   auto R = getAddressData(LSDAAddress);
@@ -619,11 +689,9 @@ void BinaryFile::parseLSDA(uint64_t FDEStart, uint64_t LSDAAddress) {
     LSDAReader.readULEB128();
 
     if (LandingPad != 0) {
-      DBG("ehframe", {
-          if (LandingPads.count(LandingPad) == 0)
-            dbg << "New landing pad found: " << std::hex << LandingPad << "\n";
-        });
-      LandingPads.insert(LandingPad);
+      DBG("ehframe",
+          dbg << "Landing pad found: " << std::hex << LandingPad << "\n");
+      Result.push_back(LandingPad);
     }
   }
 }
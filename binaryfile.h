@@ -73,6 +73,7 @@ struct SymbolInfo {
   llvm::StringRef Name;
   uint64_t Address;
   uint64_t Size;
+  bool IsFunction; ///< The symbol is the entry point of a function
 
   bool operator<(const SymbolInfo &Other) const {
     return Address < Other.Address;
@@ -203,7 +204,8 @@ public:
   std::vector<SegmentInfo> &segments() { return Segments; }
   const std::vector<SegmentInfo> &segments() const { return Segments; }
   const std::vector<SymbolInfo> &symbols() const { return Symbols; }
-  const std::set<uint64_t> &landingPads() const { return LandingPads; }
+  /// \brief Return the sorted list of the landing pads
+  const std::vector<uint64_t> &landingPads() const { return LandingPads; }
   uint64_t entryPoint() const { return EntryPoint; }
 
   //
@@ -249,6 +251,9 @@ private:
 
   /// \brief Parse the .eh_frame section to collect all the landing pads
   ///
+  /// The CIEs are parsed sequentially, while the FDEs, and their LSDAs, are
+  /// split in chunks parsed on multiple threads.
+  ///
   /// \param EHFrameAddress the address of the .eh_frame section
   /// \param FDEsCount the count of FDEs in the .eh_frame section
   /// \param EHFrameSize the size of the .eh_frame section
@@ -264,16 +269,19 @@ private:
   /// \param FDEStart the start address of the FDE to which this LSDA is
   ///        associated
   /// \param LSDAAddress the address of the target LSDA
+  /// \param Result where to append the landing pads.
   template<typename T>
-  void parseLSDA(uint64_t FDEStart, uint64_t LSDAAddress);
+  void parseLSDA(uint64_t FDEStart,
+                 uint64_t LSDAAddress,
+                 std::vector<uint64_t> &Result) const;
 
 private:
   llvm::object::OwningBinary<llvm::object::Binary> BinaryHandle;
   Architecture TheArchitecture;
   std::vector<SymbolInfo> Symbols;
   std::vector<SegmentInfo> Segments;
-  std::set<uint64_t> LandingPads; ///< the set of the landing pad addresses
-                                  ///  collected from .eh_frame
+  /// The sorted landing pad addresses collected from .eh_frame
+  std::vector<uint64_t> LandingPads;
 
   uint64_t EntryPoint; ///< the program's entry point
 
@@ -0,0 +1,477 @@
+#ifndef _CFGVIEW_H
+#define _CFGVIEW_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cassert>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <set>
+
+// LLVM includes
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/GraphTraits.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+/// \brief Read-only view of the CFG of the translated function
+///
+/// The CFG of the translated function is kept in a form preserving the
+/// semantics of the program: the dispatcher can jump to any jump target and
+/// indirect jumps go through the dispatcher. Some analyses give better results
+/// considering only the edges we were able to recover, or replacing function
+/// calls with a jump to the return address. A CFGView exposes such a CFG
+/// without modifying the IR.
+///
+/// The view is built lazily: the edges of a basic block are computed, and
+/// cached, the first time they are requested. For this reason, if the CFG
+/// changes while a CFGView is in use, invalidate() has to be called.
+///
+/// The view can be visited directly, through successors() and predecessors(),
+/// or using GraphTraits, e.g., to build a dominator tree.
+class CFGView {
+public:
+  /// \brief The basic blocks and the options determining the form of the CFG
+  ///
+  /// A default constructed Form describes a view identical to the IR.
+  struct Form {
+    Form() :
+      Dispatcher(nullptr),
+      AnyPC(nullptr),
+      UnexpectedPC(nullptr),
+      NoFunctionCalls(false) { }
+
+    /// The dispatcher only jumps to the jump targets without other translated
+    /// predecessors
+    llvm::BasicBlock *Dispatcher;
+
+    /// Jumps to any PC do not go to the dispatcher, but to an unreachable
+    /// instruction
+    llvm::BasicBlock *AnyPC;
+
+    /// Jumps to an unexpected PC do not go to the dispatcher, but to an
+    /// unreachable instruction
+    llvm::BasicBlock *UnexpectedPC;
+
+    /// Basic blocks ending with a function call jump to the return address
+    /// instead of the callee
+    bool NoFunctionCalls;
+  };
+
+  /// \brief A basic block of the view, decorated with its successors and
+  ///        predecessors
+  class Node {
+  public:
+    using iterator = llvm::SmallVectorImpl<Node *>::iterator;
+
+    Node(CFGView *View, llvm::BasicBlock *BB) :
+      View(View), BB(BB), Expanded(false) { }
+
+    /// \brief Return the underlying basic block
+    llvm::BasicBlock *block() const { return BB; }
+
+    iterator succ_begin() { expand(); return Successors.begin(); }
+    iterator succ_end() { expand(); return Successors.end(); }
+    iterator pred_begin() { expand(); return Predecessors.begin(); }
+    iterator pred_end() { expand(); return Predecessors.end(); }
+
+  private:
+    friend class CFGView;
+
+    void expand() {
+      if (!Expanded) {
+        Expanded = true;
+        View->expand(*this);
+      }
+    }
+
+  private:
+    CFGView *View;
+    llvm::BasicBlock *BB;
+    bool Expanded;
+    llvm::SmallVector<Node *, 2> Successors;
+    llvm::SmallVector<Node *, 2> Predecessors;
+  };
+
+  /// \brief Iterator over the basic blocks associated to a list of nodes
+  class block_iterator :
+    public std::iterator<std::forward_iterator_tag, llvm::BasicBlock *> {
+  public:
+    block_iterator(Node::iterator It) : It(It) { }
+
+    llvm::BasicBlock *operator*() const { return (*It)->block(); }
+
+    block_iterator &operator++() {
+      ++It;
+      return *this;
+    }
+
+    block_iterator operator++(int) { return block_iterator(It++); }
+
+    bool operator==(const block_iterator &Other) const {
+      return It == Other.It;
+    }
+
+    bool operator!=(const block_iterator &Other) const {
+      return It != Other.It;
+    }
+
+  private:
+    Node::iterator It;
+  };
+
+  using block_range = llvm::iterator_range<block_iterator>;
+
+  /// \brief Iterator over all the nodes of the view
+  ///
+  /// It can be implicitly converted to a pointer to the node, as
+  /// DominatorTreeBase expects.
+  class node_iterator :
+    public std::iterator<std::forward_iterator_tag, Node> {
+  public:
+    node_iterator(std::deque<Node>::iterator It) : It(It) { }
+
+    Node &operator*() const { return *It; }
+    Node *operator->() const { return &*It; }
+    operator Node *() const { return &*It; }
+
+    node_iterator &operator++() {
+      ++It;
+      return *this;
+    }
+
+    node_iterator operator++(int) { return node_iterator(It++); }
+
+    bool operator==(const node_iterator &Other) const {
+      return It == Other.It;
+    }
+
+    bool operator!=(const node_iterator &Other) const {
+      return It != Other.It;
+    }
+
+  private:
+    std::deque<Node>::iterator It;
+  };
+
+public:
+  CFGView(llvm::Function &F, Form TheForm = Form()) :
+    F(F),
+    TheForm(TheForm),
+    DispatcherDefault(nullptr),
+    Complete(false) {
+
+    using namespace llvm;
+
+    if (TheForm.Dispatcher != nullptr) {
+      TerminatorInst *Terminator = TheForm.Dispatcher->getTerminator();
+      if (auto *Switch = dyn_cast_or_null<SwitchInst>(Terminator))
+        DispatcherDefault = Switch->getDefaultDest();
+    }
+
+    // Collect the branches forming a function call and their return address
+    Function *FunctionCall = F.getParent()->getFunction("function_call");
+    if (TheForm.NoFunctionCalls && FunctionCall != nullptr) {
+      for (User *U : FunctionCall->users()) {
+        auto *Call = cast<CallInst>(U);
+        if (Call->getParent() == nullptr || Call->getParent()->getParent() != &F)
+          continue;
+
+        // The first argument is the callee, the second the return basic block
+        Value *ReturnAddress = Call->getArgOperand(1);
+        BasicBlock *Return = cast<BlockAddress>(ReturnAddress)->getBasicBlock();
+        BasicBlock *Caller = Call->getParent();
+        CallReturns[Caller] = Return;
+        ReturnCallers[Return].push_back(Caller);
+      }
+    }
+  }
+
+  CFGView(const CFGView &) = delete;
+  CFGView &operator=(const CFGView &) = delete;
+
+  llvm::Function &function() const { return F; }
+
+  const Form &form() const { return TheForm; }
+
+  /// \brief Add to the view an edge from \p From to \p To
+  ///
+  /// \p To doesn't have to belong to the function, it can be a basic block
+  /// created on purpose (e.g., an artificial exit node). Additional edges are
+  /// not taken into account to decide to which jump targets the dispatcher
+  /// jumps.
+  ///
+  /// \note Edges can be added only before starting to visit the view.
+  void addEdge(llvm::BasicBlock *From, llvm::BasicBlock *To) {
+    assert(Nodes.empty());
+    AddedSuccessors[From].push_back(To);
+    AddedPredecessors[To].push_back(From);
+  }
+
+  /// \brief Replace all the successors of \p From with \p To
+  ///
+  /// \see addEdge
+  void replaceSuccessors(llvm::BasicBlock *From, llvm::BasicBlock *To) {
+    assert(Nodes.empty());
+    Replaced.insert(From);
+    addEdge(From, To);
+  }
+
+  /// \brief Return the node associated to \p BB, creating it if necessary
+  Node *node(llvm::BasicBlock *BB) {
+    auto It = NodesMap.find(BB);
+    if (It != NodesMap.end())
+      return It->second;
+
+    Nodes.emplace_back(this, BB);
+    Node *Result = &Nodes.back();
+    NodesMap[BB] = Result;
+    return Result;
+  }
+
+  /// \brief Return the node associated to the entry basic block
+  Node *entry() { return node(&F.getEntryBlock()); }
+
+  block_range successors(llvm::BasicBlock *BB) {
+    Node *N = node(BB);
+    return llvm::make_range(block_iterator(N->succ_begin()),
+                            block_iterator(N->succ_end()));
+  }
+
+  block_range predecessors(llvm::BasicBlock *BB) {
+    Node *N = node(BB);
+    return llvm::make_range(block_iterator(N->pred_begin()),
+                            block_iterator(N->pred_end()));
+  }
+
+  /// \brief Iterate over all the nodes of the view
+  ///
+  /// The first invocation builds the whole view.
+  node_iterator nodes_begin() {
+    complete();
+    return node_iterator(Nodes.begin());
+  }
+
+  node_iterator nodes_end() {
+    complete();
+    return node_iterator(Nodes.end());
+  }
+
+  unsigned size() {
+    complete();
+    return Nodes.size();
+  }
+
+  /// \brief Drop the cached edges, since the CFG has changed
+  ///
+  /// Nodes are preserved, but will be expanded again on the next visit.
+  void invalidate() {
+    for (Node &N : Nodes) {
+      N.Expanded = false;
+      N.Successors.clear();
+      N.Predecessors.clear();
+    }
+
+    Complete = false;
+  }
+
+  /// \brief Return the view currently in use by the analyses, if any
+  static CFGView *current() { return currentSlot(); }
+
+  /// \brief Return the form of the current view, or the form of the IR
+  static Form currentForm() {
+    CFGView *Current = current();
+    return Current != nullptr ? Current->form() : Form();
+  }
+
+  /// \brief Makes a view the current one for the lifetime of the object
+  class Scope {
+  public:
+    Scope(CFGView &View) {
+      assert(currentSlot() == nullptr && "CFGView scopes can't be nested");
+      currentSlot() = &View;
+    }
+
+    ~Scope() { currentSlot() = nullptr; }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+private:
+  static CFGView *&currentSlot() {
+    static CFGView *Current = nullptr;
+    return Current;
+  }
+
+  /// \brief Create and expand the nodes of all the basic blocks
+  void complete() {
+    if (Complete)
+      return;
+
+    for (llvm::BasicBlock &BB : F)
+      node(&BB)->succ_begin();
+
+    // Basic blocks outside the function reachable through additional edges
+    for (auto &P : AddedPredecessors)
+      node(P.first)->succ_begin();
+
+    Complete = true;
+  }
+
+  bool isTranslated(llvm::BasicBlock *BB) const {
+    return BB != TheForm.Dispatcher
+      && BB != TheForm.AnyPC
+      && BB != TheForm.UnexpectedPC
+      && BB != DispatcherDefault;
+  }
+
+  bool isUnreachable(llvm::BasicBlock *BB) const {
+    return BB == TheForm.AnyPC || BB == TheForm.UnexpectedPC;
+  }
+
+  bool isCaller(llvm::BasicBlock *BB) const {
+    return CallReturns.count(BB) != 0;
+  }
+
+  /// \brief Check if \p BB has a translated predecessor, not considering the
+  ///        additional edges
+  bool hasTranslatedPredecessors(llvm::BasicBlock *BB) const {
+    for (llvm::BasicBlock *Predecessor : llvm::predecessors(BB))
+      if (isTranslated(Predecessor) && !isCaller(Predecessor))
+        return true;
+
+    // Callers jump to their return address
+    return ReturnCallers.count(BB) != 0;
+  }
+
+  /// \brief Check if the edge \p From -> \p To of the IR is part of the view
+  bool hasEdge(llvm::BasicBlock *From, llvm::BasicBlock *To) const {
+    if (Replaced.count(From) != 0 || isUnreachable(From) || isCaller(From))
+      return false;
+
+    if (From == TheForm.Dispatcher)
+      return To == DispatcherDefault || !hasTranslatedPredecessors(To);
+
+    return true;
+  }
+
+  void expand(Node &N) {
+    llvm::BasicBlock *BB = N.block();
+
+    // Successors
+    for (llvm::BasicBlock *Successor : llvm::successors(BB))
+      if (hasEdge(BB, Successor))
+        N.Successors.push_back(node(Successor));
+
+    auto CallIt = CallReturns.find(BB);
+    if (CallIt != CallReturns.end() && Replaced.count(BB) == 0)
+      N.Successors.push_back(node(CallIt->second));
+
+    auto AddedIt = AddedSuccessors.find(BB);
+    if (AddedIt != AddedSuccessors.end())
+      for (llvm::BasicBlock *Successor : AddedIt->second)
+        N.Successors.push_back(node(Successor));
+
+    // Predecessors
+    for (llvm::BasicBlock *Predecessor : llvm::predecessors(BB))
+      if (hasEdge(Predecessor, BB))
+        N.Predecessors.push_back(node(Predecessor));
+
+    auto CallersIt = ReturnCallers.find(BB);
+    if (CallersIt != ReturnCallers.end())
+      for (llvm::BasicBlock *Caller : CallersIt->second)
+        if (Replaced.count(Caller) == 0)
+          N.Predecessors.push_back(node(Caller));
+
+    auto AddedPredIt = AddedPredecessors.find(BB);
+    if (AddedPredIt != AddedPredecessors.end())
+      for (llvm::BasicBlock *Predecessor : AddedPredIt->second)
+        N.Predecessors.push_back(node(Predecessor));
+  }
+
+private:
+  using BlockVector = llvm::SmallVector<llvm::BasicBlock *, 2>;
+
+  llvm::Function &F;
+  Form TheForm;
+  llvm::BasicBlock *DispatcherDefault;
+
+  std::map<llvm::BasicBlock *, llvm::BasicBlock *> CallReturns;
+  std::map<llvm::BasicBlock *, BlockVector> ReturnCallers;
+
+  std::set<llvm::BasicBlock *> Replaced;
+  std::map<llvm::BasicBlock *, BlockVector> AddedSuccessors;
+  std::map<llvm::BasicBlock *, BlockVector> AddedPredecessors;
+
+  // Note: std::deque never moves its elements when appending
+  std::deque<Node> Nodes;
+  llvm::DenseMap<llvm::BasicBlock *, Node *> NodesMap;
+  bool Complete;
+};
+
+namespace llvm {
+
+/// \brief Specialization of GraphTraits for the nodes of a CFGView
+template<>
+struct GraphTraits<CFGView::Node *> {
+  using NodeType = CFGView::Node;
+  using NodeRef = CFGView::Node *;
+  using ChildIteratorType = CFGView::Node::iterator;
+
+  static NodeType *getEntryNode(NodeType *N) { return N; }
+
+  static ChildIteratorType child_begin(NodeType *N) {
+    return N->succ_begin();
+  }
+
+  static ChildIteratorType child_end(NodeType *N) {
+    return N->succ_end();
+  }
+};
+
+/// \brief Specialization of GraphTraits for the inverse CFGView
+template<>
+struct GraphTraits<Inverse<CFGView::Node *>> {
+  using NodeType = CFGView::Node;
+  using NodeRef = CFGView::Node *;
+  using ChildIteratorType = CFGView::Node::iterator;
+
+  static NodeType *getEntryNode(Inverse<NodeType *> G) { return G.Graph; }
+
+  static ChildIteratorType child_begin(NodeType *N) {
+    return N->pred_begin();
+  }
+
+  static ChildIteratorType child_end(NodeType *N) {
+    return N->pred_end();
+  }
+};
+
+/// \brief Specialization of GraphTraits for CFGView
+template<>
+struct GraphTraits<CFGView *> : public GraphTraits<CFGView::Node *> {
+  using nodes_iterator = CFGView::node_iterator;
+
+  static NodeType *getEntryNode(CFGView *G) { return G->entry(); }
+
+  static nodes_iterator nodes_begin(CFGView *G) { return G->nodes_begin(); }
+
+  static nodes_iterator nodes_end(CFGView *G) { return G->nodes_end(); }
+
+  static unsigned size(CFGView *G) { return G->size(); }
+};
+
+}
+
+#endif // _CFGVIEW_H
@@ -7,9 +7,12 @@
 //
 
 // Standard includes
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <memory>
 #include <sstream>
+#include <streambuf>
 #include <vector>
 #include <fstream>
 #include <queue>
@@ -42,9 +45,13 @@
 #include "codegenerator.h"
 #include "debug.h"
 #include "debughelper.h"
+#include "foldreadonlyloads.h"
 #include "functionboundariesdetection.h"
+#include "helpercsvaccess.h"
+#include "helperinlining.h"
 #include "instructiontranslator.h"
 #include "jumptargetmanager.h"
+#include "objectemitter.h"
 #include "ptcinterface.h"
 #include "revamb.h"
 #include "variablemanager.h"
@@ -59,9 +66,51 @@ make_array(Args&&... args) {
   return { { std::forward<Args>(args)... } };
 }
 
+/// \brief Stream buffer appending to a string it doesn't own
+///
+/// Unlike std::stringbuf, the content can be accessed without copying it and,
+/// once cleared, the string reuses its storage.
+class StringAppendBuffer : public std::streambuf {
+public:
+  StringAppendBuffer(std::string &Target) : Target(Target) { }
+
+protected:
+  int_type overflow(int_type C) override {
+    if (!traits_type::eq_int_type(C, traits_type::eof()))
+      Target.push_back(traits_type::to_char_type(C));
+    return traits_type::not_eof(C);
+  }
+
+  std::streamsize xsputn(const char *Data, std::streamsize Size) override {
+    Target.append(Data, Size);
+    return Size;
+  }
+
+private:
+  std::string &Target;
+};
+
 // Outline the destructor for the sake of privacy in the header
 CodeGenerator::~CodeGenerator() = default;
 
+/// \brief Load the QEMU helpers module
+///
+/// If the helpers are in bitcode form, the function bodies are materialized
+/// lazily, i.e., only those actually required by the linker are parsed.
+static std::unique_ptr<Module> parseHelpers(std::string Helpers) {
+  SMDiagnostic Errors;
+  std::unique_ptr<Module> Result = getLazyIRFileModule(Helpers,
+                                                       Errors,
+                                                       getGlobalContext());
+
+  if (Result.get() == nullptr) {
+    Errors.print("revamb", dbgs());
+    abort();
+  }
+
+  return Result;
+}
+
 CodeGenerator::CodeGenerator(BinaryFile &Binary,
                              Architecture& Target,
                              std::string Output,
@@ -74,29 +123,68 @@ CodeGenerator::CodeGenerator(BinaryFile &Binary,
                              bool EnableOSRA,
                              bool DetectFunctionBoundaries,
                              bool EnableLinking,
-                             bool ExternalCSVs) :
+                             bool ExternalCSVs,
+                             unsigned InlineThreshold,
+                             bool SplitInPlace,
+                             bool DebugNames,
+                             bool ProfileDispatcher) :
+  CodeGenerator(Binary,
+                Target,
+                Output,
+                parseHelpers(Helpers),
+                DebugInfo,
+                Debug,
+                LinkingInfo,
+                Coverage,
+                BBSummary,
+                EnableOSRA,
+                DetectFunctionBoundaries,
+                EnableLinking,
+                ExternalCSVs,
+                InlineThreshold,
+                SplitInPlace,
+                DebugNames,
+                ProfileDispatcher) { }
+
+CodeGenerator::CodeGenerator(BinaryFile &Binary,
+                             Architecture& Target,
+                             std::string Output,
+                             std::unique_ptr<Module> Helpers,
+                             DebugInfoType DebugInfo,
+                             std::string Debug,
+                             std::string LinkingInfo,
+                             std::string Coverage,
+                             std::string BBSummary,
+                             bool EnableOSRA,
+                             bool DetectFunctionBoundaries,
+                             bool EnableLinking,
+                             bool ExternalCSVs,
+                             unsigned InlineThreshold,
+                             bool SplitInPlace,
+                             bool DebugNames,
+                             bool ProfileDispatcher) :
   TargetArchitecture(Target),
   Context(getGlobalContext()),
   TheModule((new Module("top", Context))),
+  HelpersModule(std::move(Helpers)),
   OutputPath(Output),
   Debug(new DebugHelper(Output, Debug, TheModule.get(), DebugInfo)),
   Binary(Binary),
   EnableOSRA(EnableOSRA),
   DetectFunctionBoundaries(DetectFunctionBoundaries),
   EnableLinking(EnableLinking),
-  ExternalCSVs(ExternalCSVs)
+  ExternalCSVs(ExternalCSVs),
+  InlineThreshold(InlineThreshold),
+  SplitInPlace(SplitInPlace),
+  DebugNames(DebugNames),
+  ProfileDispatcher(ProfileDispatcher),
+  AbandonedJumpTargets(0)
 {
   OriginalInstrMDKind = Context.getMDKindID("oi");
   PTCInstrMDKind = Context.getMDKindID("pi");
   DbgMDKind = Context.getMDKindID("dbg");
 
-  SMDiagnostic Errors;
-  HelpersModule = parseIRFile(Helpers, Errors, Context);
-
-  if (HelpersModule.get() == nullptr) {
-    Errors.print("revamb", dbgs());
-    abort();
-  }
+  assert(&HelpersModule->getContext() == &Context);
 
   if (Coverage.size() == 0)
     Coverage = Output + ".coverage.csv";
@@ -548,7 +636,10 @@ static void purgeDeadBlocks(Function *F) {
 
 }
 
-void CodeGenerator::translate(uint64_t VirtualAddress) {
+void CodeGenerator::translate(uint64_t VirtualAddress,
+                              ArrayRef<std::pair<uint64_t, uint64_t>> Region,
+                              const ExplorationBudget &Budget,
+                              ArrayRef<uint64_t> Seeds) {
   using FT = FunctionType;
 
   // Declare useful functions
@@ -563,6 +654,8 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
   TheModule->getOrInsertFunction("syscall_init",
                                  FT::get(Type::getVoidTy(Context), { }, false));
 
+  PhaseReporter Phases;
+
   // Instantiate helpers
   VariableManager Variables(*TheModule, *HelpersModule, TargetArchitecture);
   GlobalVariable *PCReg = Variables.getByEnvOffset(ptc.pc, "pc").first;
@@ -602,14 +695,39 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
   InputArchMD->addOperand(Tuple);
 
   // Create an instance of JumpTargetManager
-  JumpTargetManager JumpTargets(MainFunction, PCReg, Binary, EnableOSRA);
+  JumpTargetManager JumpTargets(MainFunction,
+                                PCReg,
+                                Binary,
+                                EnableOSRA,
+                                SplitInPlace,
+                                DebugNames);
+  JumpTargets.setBudget(Budget);
+
+  // In partial translation mode only the jump targets inside the region are
+  // registered, including the code pointers found in global data
+  if (!Region.empty())
+    JumpTargets.restrictTranslation(Region.vec());
 
   if (VirtualAddress == 0) {
     JumpTargets.harvestGlobalData();
     VirtualAddress = Binary.entryPoint();
   }
+
+  // In partial translation mode, start from the beginning of each range and
+  // from the entry point of the program only if it's part of the region. An
+  // explicit entry point outside the region has already been rejected.
+  for (const std::pair<uint64_t, uint64_t> &Range : Region)
+    JumpTargets.registerJT(Range.first, JumpTargetManager::GlobalData);
+
+  if (!JumpTargets.isInTranslationRegion(VirtualAddress))
+    VirtualAddress = Region.front().first;
   JumpTargets.registerJT(VirtualAddress, JumpTargetManager::GlobalData);
 
+  // Explore the seeds right away, instead of waiting for the analyses to find
+  // them. Seeds which are not valid PCs are ignored.
+  for (uint64_t Seed : Seeds)
+    JumpTargets.registerJT(Seed, JumpTargetManager::Seed);
+
   // Initialize the program counter
   auto *StartPC = ConstantInt::get(PCReg->getType()->getPointerElementType(),
                                    VirtualAddress);
@@ -626,6 +744,8 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
 
   std::tie(VirtualAddress, Entry) = JumpTargets.peek();
 
+  Phases.done("initialization", JumpTargets.jumpTargetsCount());
+
   std::vector<BasicBlock *> Blocks;
 
   InstructionTranslator Translator(Builder,
@@ -635,6 +755,18 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
                                    Binary.architecture(),
                                    TargetArchitecture);
 
+  // Reused across instructions to dump the PTC for the metadata
+  std::string PTCString;
+  StringAppendBuffer PTCBuffer(PTCString);
+  std::ostream PTCStream(&PTCBuffer);
+
+  // Time spent lifting PTC instructions, measured only if requested
+  using Clock = std::chrono::steady_clock;
+  bool MeasureLifting = DebuggingEnabled
+    && isDebugFeatureEnabled("liftingtime");
+  Clock::duration LiftingTime = Clock::duration::zero();
+  uint64_t LiftedCount = 0;
+
   while (Entry != nullptr) {
     Builder.SetInsertPoint(Entry);
 
@@ -686,12 +818,18 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
       j++;
     }
 
+    Clock::time_point LiftingStart;
+    if (MeasureLifting)
+      LiftingStart = Clock::now();
+
     // TODO: shall we move this whole loop in InstructionTranslator?
     for (; j < InstructionCount && !StopTranslation; j++) {
       if (ToIgnore.count(j) != 0)
         continue;
 
-      PTCInstruction Instruction = InstructionList->instructions[j];
+      LiftedCount++;
+
+      PTCInstruction &Instruction = InstructionList->instructions[j];
       PTCOpcode Opcode = Instruction.opc;
 
       Blocks.clear();
@@ -735,8 +873,8 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
           auto &IL = InstructionList;
           if (j == IL->instruction_count - 1) {
             using JTM = JumpTargetManager;
-            Builder.CreateBr(notNull(JumpTargets.registerJT(EndPC,
-                                                            JTM::PostHelper)));
+            auto *Next = JumpTargets.registerJTOrExit(EndPC, JTM::PostHelper);
+            Builder.CreateBr(notNull(Next));
           }
 
           break;
@@ -764,9 +902,9 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
 
       // Create a new metadata referencing the PTC instruction we have just
       // translated
-      std::stringstream PTCStringStream;
-      dumpInstruction(PTCStringStream, InstructionList.get(), j);
-      std::string PTCString = PTCStringStream.str() + "\n";
+      PTCString.clear();
+      dumpInstruction(PTCStream, InstructionList.get(), j);
+      PTCStream << "\n";
       MDString *MDPTCString = MDString::get(Context, PTCString);
       MDNode* MDPTCInstr = MDNode::getDistinct(Context, MDPTCString);
 
@@ -781,6 +919,9 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
 
     } // End loop over instructions
 
+    if (MeasureLifting)
+      LiftingTime += Clock::now() - LiftingStart;
+
     if (ForceNewBlock)
       JumpTargets.registerJT(EndPC, JumpTargetManager::PostHelper);
 
@@ -798,6 +939,27 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
     std::tie(VirtualAddress, Entry) = JumpTargets.peek();
   } // End translations loop
 
+  DBG("liftingtime", {
+      using namespace std::chrono;
+      auto Nanoseconds = duration_cast<nanoseconds>(LiftingTime).count();
+      dbg << std::dec << LiftedCount << " PTC instructions lifted in "
+          << Nanoseconds / 1000000 << " ms ("
+          << (LiftedCount != 0 ? Nanoseconds / LiftedCount : 0)
+          << " ns per instruction)\n";
+    });
+
+  Phases.done("translation", JumpTargets.jumpTargetsCount());
+
+  // If the exploration has been cut short, take note of it in the module too
+  if (const char *Limit = JumpTargets.exceededLimit()) {
+    ExceededLimit = Limit;
+    AbandonedJumpTargets = JumpTargets.abandonedJumpTargets();
+
+    const char *LimitMDName = "revamb.exploration.limit";
+    NamedMDNode *LimitMD = TheModule->getOrInsertNamedMetadata(LimitMDName);
+    LimitMD->addOperand(QMD.tuple(Limit));
+  }
+
   legacy::FunctionPassManager CpuLoopPM(TheModule.get());
   CpuLoopPM.add(new LoopInfoWrapperPass());
   CpuLoopPM.add(new CpuLoopFunctionPass());
@@ -888,6 +1050,12 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
         GV.setLinkage(GlobalValue::InternalLinkage);
   }
 
+  // The cached CPU state election is of no use in the output
+  const char *CPUStateMDName = VariableManager::CPUStateMDName;
+  NamedMDNode *CPUStateCache = HelpersModule->getNamedMetadata(CPUStateMDName);
+  if (CPUStateCache != nullptr)
+    HelpersModule->eraseNamedMetadata(CPUStateCache);
+
   if (EnableLinking) {
     Linker TheLinker(*TheModule);
     bool Result = TheLinker.linkInModule(std::move(HelpersModule),
@@ -897,18 +1065,31 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
 
   Variables.setDataLayout(&TheModule->getDataLayout());
 
+  Phases.done("linking", JumpTargets.jumpTargetsCount());
+
   legacy::PassManager PM;
   PM.add(createSROAPass());
   PM.add(new CpuLoopExitPass(&Variables));
   PM.add(Variables.createCorrectCPUStateUsagePass());
   PM.add(createDeadCodeEliminationPass());
+  if (EnableLinking)
+    PM.add(new HelperCSVAccessPass(&Variables));
   PM.run(*TheModule);
 
+  // Loads from read-only memory might have become constant after linking and
+  // CPU state accesses have been corrected
+  legacy::FunctionPassManager FoldingFPM(&*TheModule);
+  FoldingFPM.add(new FoldReadOnlyLoadsPass(&JumpTargets));
+  FoldingFPM.run(*MainFunction);
+
   JumpTargets.translateIndirectJumps();
 
   JumpTargets.finalizeJumpTargets();
 
   purgeDeadBlocks(MainFunction);
+  JumpTargets.invalidatePCIndex();
+
+  Phases.done("indirect-jumps", JumpTargets.jumpTargetsCount());
 
   if (DetectFunctionBoundaries) {
     legacy::FunctionPassManager FPM(&*TheModule);
@@ -918,19 +1099,81 @@ void CodeGenerator::translate(uint64_t VirtualAddress) {
 
   JumpTargets.noReturn().cleanup();
 
+  Phases.done("function-boundaries", JumpTargets.jumpTargetsCount());
+
+  // Now that the CFG of root is final, inline and specialize the helpers
+  if (EnableLinking && InlineThreshold != 0) {
+    legacy::PassManager InliningPM;
+    InliningPM.add(new HelperInliningPass(InlineThreshold));
+    InliningPM.run(*TheModule);
+  }
+
   Translator.finalizeNewPCMarkers(CoveragePath);
 
+  // Count the times the dispatcher is reached through a function provided by
+  // the support module. Done at the very end, so that no analysis sees it.
+  if (ProfileDispatcher) {
+    auto *HitTy = FT::get(Type::getVoidTy(Context), false);
+    Constant *Hit = TheModule->getOrInsertFunction("dispatcher_hit", HitTy);
+    CallInst::Create(Hit, { }, "", &*JumpTargets.dispatcher()->begin());
+  }
+
   Variables.finalize(ExternalCSVs);
 
   Debug->generateDebugInfo();
 
+  Phases.done("finalization", JumpTargets.jumpTargetsCount());
+}
+
+void CodeGenerator::writeLinkerOptions(std::ostream &Output) {
+  const uint64_t PageSize = 4096;
+
+  uint64_t Min = 0;
+  uint64_t Max = 0;
+  for (SegmentInfo &Segment : Binary.segments()) {
+    if (Min == 0 || Segment.StartVirtualAddress < Min)
+      Min = Segment.StartVirtualAddress;
+    Max = std::max(Max, Segment.EndVirtualAddress);
+  }
+
+  // The ELF header helper goes right before the first segment, while the rest
+  // of the program goes after the last one
+  Output << "-fuse-ld=bfd"
+         << std::hex
+         << " -Wl,--section-start=.elfheaderhelper=0x" << Min - 1
+         << " -Wl,-Ttext-segment=0x"
+         << PageSize * ((Max + PageSize - 1) / PageSize)
+         << " -Wl,-z,max-page-size=" << std::dec << PageSize;
+
+  for (SegmentInfo &Segment : Binary.segments())
+    Output << " -Wl,--section-start=" << Segment.generateName()
+           << "=0x" << std::hex << Segment.StartVirtualAddress << std::dec;
+}
+
+bool CodeGenerator::emitObject(ObjectEmitter &Emitter,
+                               std::string ObjectPath) {
+  std::vector<std::string> Objects = Emitter.emit(TheModule, ObjectPath);
+  if (Objects.empty())
+    return false;
+
+  std::ofstream Output(ObjectPath + ".ld-options");
+  writeLinkerOptions(Output);
+  for (std::string &Object : Objects)
+    Output << " " << Object;
+  Output << std::endl;
+
+  return true;
 }
 
 void CodeGenerator::serialize() {
+  PhaseReporter Phases;
+
   // Ask the debug handler if it already has a good copy of the IR, if not dump
   // it
   if (!Debug->copySource()) {
     std::ofstream Output(OutputPath);
     Debug->print(Output, false);
   }
+
+  Phases.done("serialization", 0);
 }
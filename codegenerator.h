@@ -7,8 +7,10 @@
 
 // Standard includes
 #include <cstdint>
+#include <ostream>
 #include <string>
 #include <memory>
+#include <utility>
 
 // LLVM includes
 #include "llvm/ADT/ArrayRef.h"
@@ -35,6 +37,7 @@ class ObjectFile;
 };
 
 class DebugHelper;
+class ObjectEmitter;
 
 /// Translator from binary code to LLVM IR.
 class CodeGenerator {
@@ -62,6 +65,16 @@ public:
   ///        additional jump targets or not.
   /// \param EnableLinking specifying whether linking to QEMU helpers should be
   ///        performed or not.
+  /// \param InlineThreshold maximum cost of a QEMU helper to be inlined in the
+  ///        translated code. 0 disables helper inlining and specialization.
+  /// \param SplitInPlace specify whether the translation of a basic block
+  ///        split due to a new jump target should be kept, when possible,
+  ///        instead of being purged and performed again.
+  /// \param DebugNames specify whether basic blocks should be named after the
+  ///        closest symbol or simply after their address.
+  /// \param ProfileDispatcher specify whether a call to `dispatcher_hit`
+  ///        should be emitted in the dispatcher, to count how many times it's
+  ///        reached at run-time.
   CodeGenerator(BinaryFile &Binary,
                 Architecture &Target,
                 std::string Output,
@@ -74,7 +87,36 @@ public:
                 bool EnableOSRA,
                 bool DetectFunctionBoundaries,
                 bool EnableLinking,
-                bool ExternalCSVs);
+                bool ExternalCSVs,
+                unsigned InlineThreshold,
+                bool SplitInPlace,
+                bool DebugNames,
+                bool ProfileDispatcher);
+
+  /// \brief Create a new code generator using an already loaded module of
+  ///        QEMU helpers
+  ///
+  /// \param Helpers the module containing the QEMU helpers, it must belong to
+  ///        the global LLVMContext. The code generator takes ownership of it.
+  ///
+  /// See the other constructor for the description of the other parameters.
+  CodeGenerator(BinaryFile &Binary,
+                Architecture &Target,
+                std::string Output,
+                std::unique_ptr<llvm::Module> Helpers,
+                DebugInfoType DebugInfo,
+                std::string Debug,
+                std::string LinkingInfo,
+                std::string Coverage,
+                std::string BBSummary,
+                bool EnableOSRA,
+                bool DetectFunctionBoundaries,
+                bool EnableLinking,
+                bool ExternalCSVs,
+                unsigned InlineThreshold,
+                bool SplitInPlace,
+                bool DebugNames,
+                bool ProfileDispatcher);
 
   ~CodeGenerator();
 
@@ -83,11 +125,44 @@ public:
   /// create in this phase.
   ///
   /// \param VirtualAddress the address from where the translation should start.
-  void translate(uint64_t VirtualAddress);
+  /// \param Region if not empty, translate only the code in these [start, end)
+  ///        address ranges, starting from the beginning of each one of them.
+  /// \param Budget limits to the resources the exploration of the code can
+  ///        use. If a limit is exceeded, only the code explored so far is
+  ///        translated, see exceededLimit().
+  /// \param Seeds additional addresses from where the exploration should
+  ///        start, e.g., the entry points of known functions.
+  void translate(uint64_t VirtualAddress,
+                 llvm::ArrayRef<std::pair<uint64_t, uint64_t>> Region = { },
+                 const ExplorationBudget &Budget = ExplorationBudget(),
+                 llvm::ArrayRef<uint64_t> Seeds = { });
+
+  /// \brief Return the name of the limit of the exploration budget that has
+  ///        been exceeded (e.g., "max-time"), or an empty string
+  const std::string &exceededLimit() const { return ExceededLimit; }
+
+  /// \brief Return the number of jump targets which haven't been explored due
+  ///        to the exploration budget
+  size_t abandonedJumpTargets() const { return AbandonedJumpTargets; }
 
   /// Serialize the generated LLVM IR to the specified output path.
   void serialize();
 
+  /// \brief Produce the object files for the translated code
+  ///
+  /// Along with the object files, a file with \p ObjectPath plus a
+  /// ".ld-options" suffix is created, containing the arguments to pass to the
+  /// compiler driver to link them (i.e., the linker options produced by the
+  /// `li-csv-to-ld-options` script, followed by the object files).
+  ///
+  /// Must be called after serialize, since the module is altered.
+  ///
+  /// \param Emitter the ObjectEmitter to use.
+  /// \param ObjectPath path of the (first) object file to produce.
+  ///
+  /// \return true in case of success.
+  bool emitObject(ObjectEmitter &Emitter, std::string ObjectPath);
+
 private:
   /// \brief Parse the ELF headers.
   /// Collect useful information such as the segments' boundaries, their
@@ -103,6 +178,10 @@ private:
                 std::string LinkingInfo,
                 bool UseSections);
 
+  /// \brief Write the linker options to load the segments of the input binary
+  ///        at their original addresses
+  void writeLinkerOptions(std::ostream &Output);
+
 private:
   Architecture TargetArchitecture;
   llvm::LLVMContext& Context;
@@ -123,6 +202,12 @@ private:
   bool DetectFunctionBoundaries;
   bool EnableLinking;
   bool ExternalCSVs;
+  unsigned InlineThreshold;
+  bool SplitInPlace;
+  bool DebugNames;
+  bool ProfileDispatcher;
+  std::string ExceededLimit;
+  size_t AbandonedJumpTargets;
 };
 
 #endif // _CODEGENERATOR_H
@@ -10,6 +10,7 @@
 #include "llvm/IR/Instructions.h"
 
 // Local includes
+#include "binarydump.h"
 #include "datastructures.h"
 #include "collectcfg.h"
 #include "ir-helpers.h"
@@ -30,6 +31,21 @@ void CollectCFG::serialize(std::ostream &Output) {
   }
 }
 
+void CollectCFG::serialize(BinaryDumpWriter &Output) {
+  for (auto &P : Result)
+    for (BasicBlock *Destination : P.second)
+      Output.addEdge(P.first->getName().str(), Destination->getName().str());
+}
+
+ArrayRef<BasicBlock *> CollectCFG::successorsOf(BasicBlock *BB) {
+  auto It = Result.find(BB);
+  if (It == Result.end())
+    return { };
+
+  std::sort(It->second.begin(), It->second.end(), CompareByName<BasicBlock>());
+  return It->second;
+}
+
 bool CollectCFG::isNewInstruction(BasicBlock *BB) {
   if (BB->empty())
     return false;
@@ -43,38 +59,45 @@ bool CollectCFG::isNewInstruction(BasicBlock *BB) {
   return true;
 }
 
-bool CollectCFG::runOnFunction(Function &F) {
+void CollectCFG::clear() {
   Result.clear();
+  BlackList.clear();
+  FirstInstructionFound = false;
+}
 
-  for (BasicBlock &BB : F) {
-    if (!isNewInstruction(&BB))
-      BlackList.insert(&BB);
-    else
-      break;
+void CollectCFG::collect(BasicBlock *BB) {
+  if (!isNewInstruction(BB)) {
+    // Ignore the basic blocks preceding the first instruction
+    if (!FirstInstructionFound)
+      BlackList.insert(BB);
+    return;
   }
 
-  // For each basic block
-  for (BasicBlock &BB : F) {
-    if (!isNewInstruction(&BB))
-      continue;
-
-    OnceQueue<BasicBlock *> Queue;
-    Queue.insert(&BB);
-    while (!Queue.empty()) {
-      BasicBlock *ToExplore = Queue.pop();
-      for (BasicBlock *Successor : successors(ToExplore)) {
-
-        // If it's a new instruction register it, otherwise enqueue the basic
-        // block for further processing
-        if (isNewInstruction(Successor)) {
-          Result[&BB].push_back(Successor);
-        } else if (BlackList.count(Successor) == 0) {
-          Queue.insert(Successor);
-        }
+  FirstInstructionFound = true;
+
+  OnceQueue<BasicBlock *> Queue;
+  Queue.insert(BB);
+  while (!Queue.empty()) {
+    BasicBlock *ToExplore = Queue.pop();
+    for (BasicBlock *Successor : successors(ToExplore)) {
 
+      // If it's a new instruction register it, otherwise enqueue the basic
+      // block for further processing
+      if (isNewInstruction(Successor)) {
+        Result[BB].push_back(Successor);
+      } else if (BlackList.count(Successor) == 0) {
+        Queue.insert(Successor);
       }
+
     }
   }
+}
+
+bool CollectCFG::runOnFunction(Function &F) {
+  clear();
+
+  for (BasicBlock &BB : F)
+    collect(&BB);
 
   return false;
 }
@@ -12,9 +12,12 @@
 
 // LLVM includes
 #include "llvm/Pass.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 
+class BinaryDumpWriter;
+
 template<typename T>
 struct CompareByName {
   bool operator()(const T *LHS, const T *RHS) const {
@@ -27,15 +30,28 @@ public:
   static char ID;
 
 public:
-  CollectCFG() : llvm::FunctionPass(ID) { }
+  CollectCFG() : llvm::FunctionPass(ID), FirstInstructionFound(false) { }
 
   bool runOnFunction(llvm::Function &F) override;
 
+  /// \brief Forget all the collected information
+  void clear();
+
+  /// \brief Collect the information about \p BB
+  ///
+  /// This allows to collect information from multiple analyses in a single
+  /// traversal of the function. Basic blocks have to be visited in order.
+  void collect(llvm::BasicBlock *BB);
+
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.setPreservesAll();
   }
 
   void serialize(std::ostream &Output);
+  void serialize(BinaryDumpWriter &Output);
+
+  /// \brief Return the successors of \p BB in the CFG, sorted by name
+  llvm::ArrayRef<llvm::BasicBlock *> successorsOf(llvm::BasicBlock *BB);
 
 private:
   bool isNewInstruction(llvm::BasicBlock *BB);
@@ -45,6 +61,7 @@ private:
            llvm::SmallVector<llvm::BasicBlock *, 2>,
            CompareByName<llvm::BasicBlock>> Result;
   std::set<llvm::BasicBlock *> BlackList;
+  bool FirstInstructionFound;
 };
 
 #endif // _COLLECTCFG_H
@@ -12,6 +12,7 @@
 #include "llvm/IR/Metadata.h"
 
 // Local includes
+#include "binarydump.h"
 #include "collectfunctionboundaries.h"
 
 using namespace llvm;
@@ -42,22 +43,35 @@ void CollectFunctionBoundaries::serialize(std::ostream &Output) {
   }
 }
 
-bool CollectFunctionBoundaries::runOnFunction(Function &F) {
+void CollectFunctionBoundaries::serialize(BinaryDumpWriter &Output) {
+  for (auto &P : Functions)
+    for (BasicBlock *BB : P.second)
+      Output.addMember(P.first.str(), BB->getName().str());
+}
+
+void CollectFunctionBoundaries::clear() {
   Functions.clear();
+}
 
-  for (BasicBlock &BB : F) {
-    if (!BB.empty()) {
-      TerminatorInst *Terminator = BB.getTerminator();
-      if (MDNode *Node = Terminator->getMetadata("func.member.of")) {
-        auto *Tuple = cast<MDTuple>(Node);
-        for (const MDOperand &Op : Tuple->operands()) {
-          auto *FunctionMD = cast<MDTuple>(Op);
-          auto *FunctionNameMD = cast<MDString>(&*FunctionMD->getOperand(0));
-          Functions[FunctionNameMD->getString()].push_back(&BB);
-        }
+void CollectFunctionBoundaries::collect(BasicBlock *BB) {
+  if (!BB->empty()) {
+    TerminatorInst *Terminator = BB->getTerminator();
+    if (MDNode *Node = Terminator->getMetadata("func.member.of")) {
+      auto *Tuple = cast<MDTuple>(Node);
+      for (const MDOperand &Op : Tuple->operands()) {
+        auto *FunctionMD = cast<MDTuple>(Op);
+        auto *FunctionNameMD = cast<MDString>(&*FunctionMD->getOperand(0));
+        Functions[FunctionNameMD->getString()].push_back(BB);
       }
     }
   }
+}
+
+bool CollectFunctionBoundaries::runOnFunction(Function &F) {
+  clear();
+
+  for (BasicBlock &BB : F)
+    collect(&BB);
 
   return false;
 }
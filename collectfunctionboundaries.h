@@ -18,6 +18,8 @@ namespace llvm {
 class BasicBlock;
 }
 
+class BinaryDumpWriter;
+
 class CollectFunctionBoundaries : public llvm::FunctionPass {
 public:
   static char ID;
@@ -27,11 +29,28 @@ public:
 
   bool runOnFunction(llvm::Function &F) override;
 
+  /// \brief Forget all the collected information
+  void clear();
+
+  /// \brief Collect the information about \p BB
+  ///
+  /// This allows to collect information from multiple analyses in a single
+  /// traversal of the function. Basic blocks have to be visited in order.
+  void collect(llvm::BasicBlock *BB);
+
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.setPreservesAll();
   }
 
   void serialize(std::ostream &Output);
+  void serialize(BinaryDumpWriter &Output);
+
+  /// \brief Return the basic blocks of each function, indexed by the name of
+  ///        the function
+  const std::map<llvm::StringRef, std::vector<llvm::BasicBlock *>> &
+  functions() const {
+    return Functions;
+  }
 
 private:
   std::map<llvm::StringRef, std::vector<llvm::BasicBlock *>> Functions;
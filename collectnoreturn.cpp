@@ -6,12 +6,16 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
+// Standard includes
+#include <algorithm>
+
 // LLVM includes
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
 
 // Local includes
+#include "binarydump.h"
 #include "collectnoreturn.h"
 
 using namespace llvm;
@@ -35,20 +39,43 @@ void CollectNoreturn::serialize(std::ostream &Output) {
     Output << BB->getName().data() << "\n";
 }
 
-bool CollectNoreturn::runOnFunction(Function &F) {
+void CollectNoreturn::serialize(BinaryDumpWriter &Output) {
+  for (BasicBlock *BB : NoreturnBBs)
+    Output.addNoreturn(BB->getName().str());
+}
+
+bool CollectNoreturn::isNoreturn(BasicBlock *BB) const {
+  return std::binary_search(NoreturnBBs.begin(),
+                            NoreturnBBs.end(),
+                            BB,
+                            CompareByName<BasicBlock>());
+}
+
+void CollectNoreturn::clear() {
   NoreturnBBs.clear();
+}
 
-  for (BasicBlock &BB : F) {
-    if (!BB.empty()) {
-      TerminatorInst *Terminator = BB.getTerminator();
-      if (Terminator->getMetadata("noreturn") != nullptr)
-        NoreturnBBs.push_back(&BB);
-    }
+void CollectNoreturn::collect(BasicBlock *BB) {
+  if (!BB->empty()) {
+    TerminatorInst *Terminator = BB->getTerminator();
+    if (Terminator->getMetadata("noreturn") != nullptr)
+      NoreturnBBs.push_back(BB);
   }
+}
 
+void CollectNoreturn::finalize() {
   std::sort(NoreturnBBs.begin(),
             NoreturnBBs.end(),
             CompareByName<BasicBlock>());
+}
+
+bool CollectNoreturn::runOnFunction(Function &F) {
+  clear();
+
+  for (BasicBlock &BB : F)
+    collect(&BB);
+
+  finalize();
 
   return false;
 }
@@ -16,6 +16,8 @@ namespace llvm {
 class BasicBlock;
 }
 
+class BinaryDumpWriter;
+
 class CollectNoreturn : public llvm::FunctionPass {
 public:
   static char ID;
@@ -25,11 +27,29 @@ public:
 
   bool runOnFunction(llvm::Function &F) override;
 
+  /// \brief Forget all the collected information
+  void clear();
+
+  /// \brief Collect the information about \p BB
+  ///
+  /// This allows to collect information from multiple analyses in a single
+  /// traversal of the function. Basic blocks have to be visited in order.
+  void collect(llvm::BasicBlock *BB);
+
+  /// \brief Finalize the results after all the basic blocks have been
+  ///        collected
+  void finalize();
+
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.setPreservesAll();
   }
 
   void serialize(std::ostream &Output);
+  void serialize(BinaryDumpWriter &Output);
+
+  /// \brief Return true if the terminator of \p BB has been marked as
+  ///        noreturn
+  bool isNoreturn(llvm::BasicBlock *BB) const;
 
 private:
   std::vector<llvm::BasicBlock *> NoreturnBBs;
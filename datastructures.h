@@ -6,9 +6,17 @@
 //
 
 // Standard includes
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <new>
 #include <queue>
 #include <set>
 #include <stack>
+#include <type_traits>
+
+// LLVM includes
+#include "llvm/Support/Allocator.h"
 
 /// \brief Queue where an element cannot be re-inserted if it's already in the
 ///        queue
@@ -95,4 +103,115 @@ static inline void freeContainer(T &Container) {
   Empty.swap(Container);
 }
 
+/// \brief Bump-pointer arena for the state of the analyses of a harvest round
+///
+/// Containers using an ArenaAllocator constructed while an AnalysisArena is
+/// active (i.e., between its construction and destruction) take their memory
+/// from it. Deallocations are no-ops and the whole memory is released at once
+/// when the AnalysisArena is destroyed, therefore it must outlive all such
+/// containers. Arenas do not nest.
+class AnalysisArena {
+public:
+  /// \param UseHeap if true, allocate through the global `operator new`
+  ///        instead, but keep counting allocations. Useful for comparisons.
+  AnalysisArena(bool UseHeap = false) :
+    UseHeap(UseHeap),
+    Allocations(0),
+    AllocatedBytes(0) {
+    assert(currentSlot() == nullptr);
+    currentSlot() = this;
+  }
+
+  ~AnalysisArena() {
+    assert(currentSlot() == this);
+    currentSlot() = nullptr;
+  }
+
+  AnalysisArena(const AnalysisArena &) = delete;
+  AnalysisArena &operator=(const AnalysisArena &) = delete;
+
+  /// \brief Return the active arena, if any
+  static AnalysisArena *current() { return currentSlot(); }
+
+  void *allocate(size_t Size, size_t Alignment) {
+    Allocations++;
+    AllocatedBytes += Size;
+    if (UseHeap)
+      return ::operator new(Size);
+    return Allocator.Allocate(Size, Alignment);
+  }
+
+  void deallocate(void *Pointer) {
+    if (UseHeap)
+      ::operator delete(Pointer);
+  }
+
+  uint64_t allocations() const { return Allocations; }
+  uint64_t allocatedBytes() const { return AllocatedBytes; }
+
+private:
+  static AnalysisArena *&currentSlot() {
+    static AnalysisArena *Current = nullptr;
+    return Current;
+  }
+
+private:
+  bool UseHeap;
+  uint64_t Allocations;
+  uint64_t AllocatedBytes;
+  llvm::BumpPtrAllocator Allocator;
+};
+
+/// \brief STL allocator drawing memory from the AnalysisArena active at its
+///        construction, or from the heap if there's none
+template<typename T>
+class ArenaAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() : Arena(AnalysisArena::current()) { }
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U> &Other) : Arena(Other.arena()) { }
+
+  T *allocate(size_t Count) {
+    size_t Size = Count * sizeof(T);
+    if (Arena == nullptr)
+      return static_cast<T *>(::operator new(Size));
+    return static_cast<T *>(Arena->allocate(Size, alignof(T)));
+  }
+
+  void deallocate(T *Pointer, size_t) {
+    if (Arena == nullptr)
+      ::operator delete(Pointer);
+    else
+      Arena->deallocate(Pointer);
+  }
+
+  AnalysisArena *arena() const { return Arena; }
+
+  template<typename U>
+  bool operator==(const ArenaAllocator<U> &Other) const {
+    return Arena == Other.arena();
+  }
+
+  template<typename U>
+  bool operator!=(const ArenaAllocator<U> &Other) const {
+    return Arena != Other.arena();
+  }
+
+private:
+  AnalysisArena *Arena;
+};
+
+template<typename K, typename V>
+using ArenaMap = std::map<K, V, std::less<K>, ArenaAllocator<std::pair<const K,
+                                                                       V>>>;
+
+template<typename T>
+using ArenaSet = std::set<T, std::less<T>, ArenaAllocator<T>>;
+
 #endif // _DATASTRUCTURES_H
@@ -6,9 +6,11 @@
 //
 
 // Standard includes
+#include <chrono>
 #include <functional>
 #include <ostream>
 #include <string>
+#include <sys/resource.h>
 
 // LLVM includes
 #include "llvm/Support/Debug.h"
@@ -50,4 +52,48 @@ private:
   bool Enabled;
 };
 
+/// \brief Report the time, peak memory usage and jump targets of each phase of
+///        the translation
+///
+/// When the "phases" debug feature is enabled, each completed phase produces a
+/// line in the form `phase,NAME,SECONDS,MAX_RSS_KB,JUMP_TARGETS`, easy to
+/// collect from a script. The peak memory usage is the one of the whole
+/// process up to the end of the phase.
+class PhaseReporter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+public:
+  PhaseReporter() : Start(Clock::now()) { }
+
+  /// \brief Report the end of the phase \p Name and start a new one
+  void done(const char *Name, size_t JumpTargetsCount) {
+    Clock::time_point End = Clock::now();
+    report(Name, End - Start, JumpTargetsCount);
+    Start = End;
+  }
+
+  /// \brief Report the phase \p Name, which lasted \p Duration
+  ///
+  /// Useful for phases which have been timed elsewhere, e.g., on another
+  /// thread.
+  static void report(const char *Name,
+                     Clock::duration Duration,
+                     size_t JumpTargetsCount) {
+    DBG("phases", {
+        using namespace std::chrono;
+        struct rusage Usage;
+        getrusage(RUSAGE_SELF, &Usage);
+        double Seconds = duration_cast<duration<double>>(Duration).count();
+        dbg << "phase," << Name << ","
+            << Seconds << ","
+            << std::dec << Usage.ru_maxrss << ","
+            << JumpTargetsCount << "\n";
+      });
+  }
+
+private:
+  Clock::time_point Start;
+};
+
 #endif // _DEBUG_H
@@ -4,8 +4,13 @@
 
 // Standard includes
 #include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 // LLVM includes
 #include "llvm/IR/Constants.h" // REMOVE ME
@@ -18,9 +23,13 @@
 
 // Local includes
 #include "argparse.h"
+#include "binarydump.h"
 #include "collectcfg.h"
 #include "collectfunctionboundaries.h"
 #include "collectnoreturn.h"
+#include "helpercsvaccess.h"
+#include "ir-helpers.h"
+#include "queryserver.h"
 
 using namespace llvm;
 
@@ -29,6 +38,9 @@ struct ProgramParameters {
   const char *CFGPath;
   const char *NoreturnPath;
   const char *FunctionBoundariesPath;
+  const char *HelperSummariesPath;
+  const char *BinaryPath;
+  const char *ServePath;
 };
 
 static const char *const Usage[] = {
@@ -52,6 +64,18 @@ static bool parseArgs(int Argc, const char *Argv[], ProgramParameters &Result) {
                &Result.FunctionBoundariesPath,
                "path where the list of function boundaries blocks should be "
                "stored."),
+    OPT_STRING('s', "helper-summaries",
+               &Result.HelperSummariesPath,
+               "path where the list of CSVs read and written by each helper "
+               "should be stored."),
+    OPT_STRING('b', "binary",
+               &Result.BinaryPath,
+               "path where the CFG, the noreturn basic blocks and the "
+               "function boundaries should be stored in binary form."),
+    OPT_STRING('S', "serve",
+               &Result.ServePath,
+               "instead of dumping, keep the module loaded and answer the "
+               "queries received on the Unix domain socket at this path."),
     OPT_END(),
   };
 
@@ -72,88 +96,153 @@ static bool parseArgs(int Argc, const char *Argv[], ProgramParameters &Result) {
   return true;
 }
 
-class DumpPass : public FunctionPass {
-public:
-  static char ID;
+static bool isStdout(const char *Path) {
+  return Path[0] == '-' && Path[1] == '\0';
+}
 
+/// \brief Write a set of outputs concurrently
+///
+/// Each output going to a file is written by a separate thread, while those
+/// going to stdout are written, in order, by the calling thread in wait().
+class ParallelOutputs {
 public:
-  DumpPass(ProgramParameters &Parameters) : FunctionPass(ID),
-                                            Parameters(Parameters) { }
+  using Serializer = std::function<void(std::ostream &)>;
 
-  bool runOnFunction(Function &F) override {
-    std::ofstream Output;
-
-    if (Parameters.CFGPath != nullptr) {
-      auto &Analysis = getAnalysis<CollectCFG>();
-      Analysis.serialize(pathToStream(Parameters.CFGPath, Output));
-    }
+public:
+  ~ParallelOutputs() { wait(); }
 
-    if (Parameters.NoreturnPath != nullptr) {
-      auto &Analysis = getAnalysis<CollectNoreturn>();
-      Analysis.serialize(pathToStream(Parameters.NoreturnPath, Output));
-    }
+  void add(const char *Path, Serializer Serialize) {
+    if (Path == nullptr)
+      return;
 
-    if (Parameters.FunctionBoundariesPath != nullptr) {
-      auto &Analysis = getAnalysis<CollectFunctionBoundaries>();
-      Analysis.serialize(pathToStream(Parameters.FunctionBoundariesPath,
-                                      Output));
+    if (isStdout(Path)) {
+      ToStdout.push_back(Serialize);
+    } else {
+      std::string FilePath = Path;
+      Threads.emplace_back([FilePath, Serialize] () {
+          std::ofstream Output(FilePath, std::ios::binary);
+          Serialize(Output);
+        });
     }
-
-    return false;
   }
 
-  void getAnalysisUsage(AnalysisUsage &AU) const override {
-    AU.setPreservesAll();
-
-    if (Parameters.CFGPath != nullptr)
-      AU.addRequired<CollectCFG>();
-
-    if (Parameters.NoreturnPath != nullptr)
-      AU.addRequired<CollectNoreturn>();
-
-    if (Parameters.FunctionBoundariesPath != nullptr)
-      AU.addRequired<CollectFunctionBoundaries>();
+  /// \brief Wait for all the outputs to be completely written
+  void wait() {
+    for (std::thread &Thread : Threads)
+      Thread.join();
+    Threads.clear();
 
+    for (Serializer &Serialize : ToStdout)
+      Serialize(std::cout);
+    ToStdout.clear();
   }
 
 private:
-  std::ostream &pathToStream(const char *Path, std::ofstream &File) {
-    if (Path[0] == '-' && Path[1] == '\0') {
-      return std::cout;
-    } else {
-      if (File.is_open())
-        File.close();
-      File.open(Path);
-      return File;
-    }
-  }
-
-private:
-  ProgramParameters &Parameters;
+  std::vector<std::thread> Threads;
+  std::vector<Serializer> ToStdout;
 };
 
-char DumpPass::ID = 0;
-
 int main(int argc, const char *argv[]) {
   ProgramParameters Parameters = { nullptr, nullptr };
 
   if (!parseArgs(argc, argv, Parameters))
     return EXIT_FAILURE;
 
+  // If the input is in bitcode form, the function bodies are materialized
+  // lazily, and, unless helper summaries are requested, we only need root
   LLVMContext &Context = getGlobalContext();
   SMDiagnostic Err;
-  std::unique_ptr<Module> TheModule = parseIRFile(Parameters.InputPath,
-                                                  Err,
-                                                  Context);
+  std::unique_ptr<Module> TheModule = getLazyIRFileModule(Parameters.InputPath,
+                                                          Err,
+                                                          Context);
 
   if (!TheModule) {
     fprintf(stderr, "Couldn't load the LLVM IR.");
     return EXIT_FAILURE;
   }
 
-  legacy::FunctionPassManager FPM(TheModule.get());
-  FPM.add(new DumpPass(Parameters));
-  FPM.run(*TheModule->getFunction("root"));
+  Function *Root = TheModule->getFunction("root");
+  if (Root == nullptr || Root->materialize()) {
+    fprintf(stderr, "Couldn't load the root function.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (Parameters.ServePath != nullptr) {
+    QueryServer Server(*Root);
+    return Server.serve(Parameters.ServePath) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  bool Binary = Parameters.BinaryPath != nullptr;
+  bool NeedCFG = Binary || Parameters.CFGPath != nullptr;
+  bool NeedNoreturn = Binary || Parameters.NoreturnPath != nullptr;
+  bool NeedFunctionBoundaries = Binary
+    || Parameters.FunctionBoundariesPath != nullptr;
+
+  // Collect all the required information in a single traversal of root
+  CollectCFG CFG;
+  CollectNoreturn Noreturn;
+  CollectFunctionBoundaries FunctionBoundaries;
+  for (BasicBlock &BB : *Root) {
+    if (NeedCFG)
+      CFG.collect(&BB);
+
+    if (NeedNoreturn)
+      Noreturn.collect(&BB);
+
+    if (NeedFunctionBoundaries)
+      FunctionBoundaries.collect(&BB);
+  }
+  Noreturn.finalize();
+
+  // Populate the binary dump before the CSV serializers start sorting the
+  // results concurrently
+  BinaryDumpWriter Writer;
+  if (Binary) {
+    // Register all the basic blocks starting an instruction with their PC
+    for (BasicBlock &BB : *Root)
+      if (!BB.empty())
+        if (uint64_t PC = getBasicBlockPC(&BB))
+          Writer.addBlock(BB.getName().str(), PC);
+
+    CFG.serialize(Writer);
+    Noreturn.serialize(Writer);
+    FunctionBoundaries.serialize(Writer);
+  }
+
+  // The helper summaries need all the functions
+  legacy::PassManager PM;
+  HelperCSVAccessPass *Summaries = nullptr;
+  if (Parameters.HelperSummariesPath != nullptr) {
+    if (TheModule->materializeAll()) {
+      fprintf(stderr, "Couldn't load the LLVM IR.\n");
+      return EXIT_FAILURE;
+    }
+
+    Summaries = new HelperCSVAccessPass();
+    PM.add(Summaries);
+    PM.run(*TheModule);
+  }
+
+  // Write the outputs in parallel, the analyses are not touched anymore
+  ParallelOutputs Outputs;
+  Outputs.add(Parameters.CFGPath, [&CFG] (std::ostream &Output) {
+      CFG.serialize(Output);
+    });
+  Outputs.add(Parameters.NoreturnPath, [&Noreturn] (std::ostream &Output) {
+      Noreturn.serialize(Output);
+    });
+  Outputs.add(Parameters.FunctionBoundariesPath,
+              [&FunctionBoundaries] (std::ostream &Output) {
+                FunctionBoundaries.serialize(Output);
+              });
+  Outputs.add(Parameters.BinaryPath, [&Writer] (std::ostream &Output) {
+      Writer.serialize(Output);
+    });
+  Outputs.add(Parameters.HelperSummariesPath,
+              [Summaries] (std::ostream &Output) {
+                Summaries->serialize(Output);
+              });
+  Outputs.wait();
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,195 @@
+/// \file dumpconvert.cpp
+/// \brief Standalone program to convert the binary dumps produced by
+///        revamb-dump to CSV and vice versa
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Local includes
+#include "argparse.h"
+#include "binarydump.h"
+
+struct ProgramParameters {
+  const char *BinaryPath;
+  const char *CFGPath;
+  const char *NoreturnPath;
+  const char *FunctionBoundariesPath;
+  int ToBinary;
+};
+
+static const char *const Usage[] = {
+  "revamb-dump-convert [options] BINARY",
+  nullptr,
+};
+
+static bool parseArgs(int Argc, const char *Argv[], ProgramParameters &Result) {
+  // Initialize argument parser
+  struct argparse Arguments;
+  struct argparse_option Options[] = {
+    OPT_HELP(),
+    OPT_STRING('c', "cfg",
+               &Result.CFGPath,
+               "path of the CFG CSV."),
+    OPT_STRING('n', "noreturn",
+               &Result.NoreturnPath,
+               "path of the noreturn basic blocks CSV."),
+    OPT_STRING('f', "functions-boundaries",
+               &Result.FunctionBoundariesPath,
+               "path of the function boundaries CSV."),
+    OPT_BOOLEAN('t', "to-binary",
+                &Result.ToBinary,
+                "read the CSV files and produce BINARY, instead of the "
+                "opposite."),
+    OPT_END(),
+  };
+
+  argparse_init(&Arguments, Options, Usage, 0);
+  argparse_describe(&Arguments, "\nrevamb-dump-convert.",
+                    "\nExtract the CSV files produced by revamb-dump from a "
+                    "binary dump (see revamb-dump --binary) or, with "
+                    "--to-binary, produce a binary dump from the CSV "
+                    "files.\n");
+  Argc = argparse_parse(&Arguments, Argc, Argv);
+
+  // Handle positional arguments
+  if (Argc != 1) {
+    fprintf(stderr, "Please specify one and only one binary dump.\n");
+    return false;
+  }
+
+  Result.BinaryPath = Argv[0];
+
+  return true;
+}
+
+static bool isStdio(const char *Path) {
+  return Path[0] == '-' && Path[1] == '\0';
+}
+
+/// \brief Read the CSV at \p Path, if any, using \p Reader
+template<typename F>
+static bool readCSV(const char *Path, F Reader) {
+  if (Path == nullptr)
+    return true;
+
+  if (isStdio(Path))
+    return Reader(std::cin);
+
+  std::ifstream Input(Path);
+  if (!Input.is_open()) {
+    fprintf(stderr, "Couldn't open %s.\n", Path);
+    return false;
+  }
+
+  return Reader(Input);
+}
+
+/// \brief Write the CSV at \p Path, if any, using \p Writer
+template<typename F>
+static void writeCSV(const char *Path, F Writer) {
+  if (Path == nullptr)
+    return;
+
+  if (isStdio(Path)) {
+    Writer(std::cout);
+  } else {
+    std::ofstream Output(Path);
+    Writer(Output);
+  }
+}
+
+static bool toBinary(ProgramParameters &Parameters) {
+  BinaryDumpWriter Writer;
+
+  auto ReadCFG = [&Writer] (std::istream &Input) {
+    return Writer.readCFG(Input);
+  };
+  auto ReadNoreturn = [&Writer] (std::istream &Input) {
+    return Writer.readNoreturn(Input);
+  };
+  auto ReadFunctionBoundaries = [&Writer] (std::istream &Input) {
+    return Writer.readFunctionBoundaries(Input);
+  };
+
+  if (!readCSV(Parameters.CFGPath, ReadCFG)
+      || !readCSV(Parameters.NoreturnPath, ReadNoreturn)
+      || !readCSV(Parameters.FunctionBoundariesPath, ReadFunctionBoundaries)) {
+    fprintf(stderr, "Malformed CSV file.\n");
+    return false;
+  }
+
+  if (isStdio(Parameters.BinaryPath)) {
+    Writer.serialize(std::cout);
+  } else {
+    std::ofstream Output(Parameters.BinaryPath, std::ios::binary);
+    Writer.serialize(Output);
+  }
+
+  return true;
+}
+
+static bool toCSV(ProgramParameters &Parameters) {
+  int FD = open(Parameters.BinaryPath, O_RDONLY);
+  if (FD == -1) {
+    perror("Couldn't open the binary dump");
+    return false;
+  }
+
+  struct stat Stat;
+  if (fstat(FD, &Stat) != 0) {
+    perror("fstat");
+    close(FD);
+    return false;
+  }
+
+  size_t Size = Stat.st_size;
+  void *Data = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, FD, 0);
+  close(FD);
+  if (Data == MAP_FAILED) {
+    perror("mmap");
+    return false;
+  }
+
+  BinaryDump Dump(Data, Size);
+  bool Result = Dump.valid();
+  if (Result) {
+    writeCSV(Parameters.CFGPath, [&Dump] (std::ostream &Output) {
+        serializeCFG(Dump, Output);
+      });
+    writeCSV(Parameters.NoreturnPath, [&Dump] (std::ostream &Output) {
+        serializeNoreturn(Dump, Output);
+      });
+    writeCSV(Parameters.FunctionBoundariesPath,
+             [&Dump] (std::ostream &Output) {
+               serializeFunctionBoundaries(Dump, Output);
+             });
+  } else {
+    fprintf(stderr, "%s is not a valid binary dump.\n", Parameters.BinaryPath);
+  }
+
+  munmap(Data, Size);
+  return Result;
+}
+
+int main(int argc, const char *argv[]) {
+  ProgramParameters Parameters = { nullptr, nullptr, nullptr, nullptr, 0 };
+
+  if (!parseArgs(argc, argv, Parameters))
+    return EXIT_FAILURE;
+
+  bool Success = Parameters.ToBinary ? toBinary(Parameters)
+                                     : toCSV(Parameters);
+
+  return Success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,104 @@
+/// \file foldreadonlyloads.cpp
+/// \brief Implementation of the pass folding loads from read-only segments
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <vector>
+
+// LLVM includes
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+
+// Local includes
+#include "debug.h"
+#include "foldreadonlyloads.h"
+#include "jumptargetmanager.h"
+
+using namespace llvm;
+
+char FoldReadOnlyLoadsPass::ID = 0;
+static RegisterPass<FoldReadOnlyLoadsPass> X("fold-ro-loads",
+                                             "Fold Read-Only Loads Pass",
+                                             true,
+                                             false);
+
+bool FoldReadOnlyLoadsPass::fold(LoadInst *Load) {
+  if (Load->isVolatile() || !Load->getType()->isIntegerTy())
+    return false;
+
+  // We're looking for `load (inttoptr C)`, either as an instruction or as a
+  // constant expression
+  auto *Cast = dyn_cast<IntToPtrOperator>(Load->getPointerOperand());
+  if (Cast == nullptr)
+    return false;
+
+  auto *Address = dyn_cast<ConstantInt>(Cast->getOperand(0));
+  if (Address == nullptr)
+    return false;
+
+  unsigned Size = Load->getType()->getIntegerBitWidth() / 8;
+  if (Size != 1 && Size != 2 && Size != 4 && Size != 8)
+    return false;
+
+  if (!JTM->isReadOnlyAddress(Address->getLimitedValue(), Size))
+    return false;
+
+  // Read the value as the load would do at run time, i.e., using the
+  // destination endianess. If the original endianess was different, the
+  // translated code swaps the bytes right after the load.
+  auto Endianess = JumpTargetManager::DestinationEndianess;
+  ConstantInt *Value = JTM->readConstantInt(Address, Size, Endianess);
+  if (Value == nullptr)
+    return false;
+
+  // Collect the byte swaps of the loaded value, we'll fold them too
+  std::vector<IntrinsicInst *> Swaps;
+  for (User *U : Load->users())
+    if (auto *Call = dyn_cast<IntrinsicInst>(U))
+      if (Call->getIntrinsicID() == Intrinsic::bswap)
+        Swaps.push_back(Call);
+
+  Load->replaceAllUsesWith(Value);
+
+  const DataLayout &DL = Load->getModule()->getDataLayout();
+  for (IntrinsicInst *Swap : Swaps) {
+    if (Constant *Swapped = ConstantFoldInstruction(Swap, DL)) {
+      Swap->replaceAllUsesWith(Swapped);
+      Swap->eraseFromParent();
+    }
+  }
+
+  return true;
+}
+
+bool FoldReadOnlyLoadsPass::runOnFunction(Function &F) {
+  DBG("passes", { dbg << "Starting FoldReadOnlyLoadsPass\n"; });
+
+  std::vector<LoadInst *> Loads;
+  for (BasicBlock &BB : F)
+    for (Instruction &I : BB)
+      if (auto *Load = dyn_cast<LoadInst>(&I))
+        Loads.push_back(Load);
+
+  unsigned FoldedCount = 0;
+  for (LoadInst *Load : Loads) {
+    if (fold(Load)) {
+      Load->eraseFromParent();
+      FoldedCount++;
+    }
+  }
+
+  DBG("loadfolding", dbg << std::dec
+                         << FoldedCount << " loads from read-only segments "
+                         << "folded\n");
+
+  return FoldedCount != 0;
+}
@@ -0,0 +1,56 @@
+#ifndef _FOLDREADONLYLOADS_H
+#define _FOLDREADONLYLOADS_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// LLVM includes
+#include "llvm/Pass.h"
+
+// Forward declarations
+namespace llvm {
+class LoadInst;
+}
+
+class JumpTargetManager;
+
+/// \brief Replace loads from constant addresses in read-only segments with the
+///        loaded value
+///
+/// Literal pools, `.rodata` constants and similar data can never change at run
+/// time, therefore a load from a constant address in a non-writeable segment
+/// can be replaced by the value read from the input binary. The value is read
+/// exactly as the load would do at run time (i.e., in the endianess of the
+/// destination architecture), and a byte swap of the loaded value, if any, is
+/// folded too.
+///
+/// This both spares SET the need of reading the value on its own and removes
+/// a memory access from the generated code.
+class FoldReadOnlyLoadsPass : public llvm::FunctionPass {
+public:
+  static char ID;
+
+  FoldReadOnlyLoadsPass() : llvm::FunctionPass(ID), JTM(nullptr) { }
+
+  FoldReadOnlyLoadsPass(JumpTargetManager *JTM) :
+    llvm::FunctionPass(ID),
+    JTM(JTM) { }
+
+  void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+  }
+
+  bool runOnFunction(llvm::Function &F) override;
+
+private:
+  /// \brief Try to fold \p Load
+  ///
+  /// \return true if \p Load has been replaced (but not erased).
+  bool fold(llvm::LoadInst *Load);
+
+private:
+  JumpTargetManager *JTM;
+};
+
+#endif // _FOLDREADONLYLOADS_H
@@ -195,15 +195,9 @@ private:
 void FBD::initPostDispatcherIt() {
   // Skip dispatcher and friends
   auto It = F.begin();
-  for (; It != F.end(); It++) {
-    if (!It->empty()) {
-      if (auto *Call = dyn_cast<CallInst>(&*It->begin())) {
-        Function *Callee = Call->getCalledFunction();
-        if (Callee != nullptr && Callee->getName() == "newpc")
-          break;
-      }
-    }
-  }
+  for (; It != F.end(); It++)
+    if (!It->empty() && JTM->isNewPC(&*It->begin()))
+      break;
   PostDispatcherIt = It;
 }
 
@@ -581,9 +575,8 @@ map<BasicBlock *, vector<BasicBlock *>> FBD::run() {
   collectReturnInstructions();
 
   // TODO: move this code in JTM
-  JTM->setCFGForm(JumpTargetManager::NoFunctionCallsCFG);
-  JTM->noReturn().computeKillerSet(CallPredecessors, Returns);
-  JTM->setCFGForm(JumpTargetManager::SemanticPreservingCFG);
+  auto Form = JTM->viewForm(JumpTargetManager::NoFunctionCallsCFG);
+  JTM->noReturn().computeKillerSet(Form, CallPredecessors, Returns);
 
   registerBasicBlockAddressRanges();
 
@@ -637,8 +630,7 @@ void FBDP::serialize() const {
     for (BasicBlock *BB : P.second) {
       for (Instruction &I : *BB) {
         if (auto *Call = dyn_cast<CallInst>(&I)) {
-          Function *Callee = Call->getCalledFunction();
-          if (Callee != nullptr && Callee->getName() == "newpc") {
+          if (JTM->isNewPC(Call)) {
             uint64_t StartPC = getLimitedValue(Call->getArgOperandUse(0));
             uint64_t Size = getLimitedValue(Call->getArgOperandUse(1));
             uint64_t EndPC = StartPC + Size;
@@ -93,8 +93,7 @@ bool FunctionCallIdentification::runOnFunction(llvm::Function &F) {
             }
           }
         } else if (auto *Call = dyn_cast<CallInst>(&I)) {
-          auto *Callee = Call->getCalledFunction();
-          if (Callee != nullptr && Callee->getName() == "newpc") {
+          if (GCBI.isNewPC(Call)) {
             assert(NewPCLeft > 0);
 
             uint64_t ProgramCounter = getLimitedValue(Call->getOperand(0));
@@ -6,10 +6,6 @@
 // This file is distributed under the MIT License. See LICENSE.md for details.
 //
 
-// Standard includes
-#include <set>
-#include <queue>
-
 // LLVM includes
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
@@ -38,8 +34,14 @@ bool GeneratedCodeBasicInfo::runOnFunction(llvm::Function &F) {
   DelaySlotSize = QMD.extract<uint32_t>(Tuple, 0);
   PC = M->getGlobalVariable(QMD.extract<StringRef>(Tuple, 1));
 
+  // Identify calls to newpc by the called function, not by name
+  PCs.setNewPCMarker(M->getFunction("newpc"));
+
   for (BasicBlock &BB : F) {
     if (!BB.empty()) {
+      // Record the calls to newpc in the basic block
+      PCs.index(&BB);
+
       switch (getType(&BB)) {
       case DispatcherBlock:
         assert(Dispatcher == nullptr);
@@ -55,8 +57,8 @@ bool GeneratedCodeBasicInfo::runOnFunction(llvm::Function &F) {
         break;
       case JumpTargetBlock:
         {
-          auto *Call = cast<CallInst>(&*BB.begin());
-          assert(Call->getCalledFunction()->getName() == "newpc");
+          CallInst *Call = PCs.getNewPC(&*BB.begin());
+          assert(Call != nullptr);
           JumpTargets[getLimitedValue(Call->getArgOperand(0))] = &BB;
           break;
         }
@@ -71,72 +73,9 @@ bool GeneratedCodeBasicInfo::runOnFunction(llvm::Function &F) {
          && AnyPC != nullptr
          && UnexpectedPC != nullptr);
 
+  PCs.setDispatcher(Dispatcher);
+
   DBG("passes", { dbg << "Ending GeneratedCodeBasicInfo\n"; });
 
   return false;
 }
-
-std::pair<uint64_t, uint64_t>
-GeneratedCodeBasicInfo::getPC(Instruction *TheInstruction) const {
-  CallInst *NewPCCall = nullptr;
-  std::set<BasicBlock *> Visited;
-  std::queue<BasicBlock::reverse_iterator> WorkList;
-  if (TheInstruction->getIterator() == TheInstruction->getParent()->begin())
-    WorkList.push(--TheInstruction->getParent()->rend());
-  else
-    WorkList.push(make_reverse_iterator(TheInstruction));
-
-  while (!WorkList.empty()) {
-    auto I = WorkList.front();
-    WorkList.pop();
-    auto *BB = I->getParent();
-    auto End = BB->rend();
-
-    // Go through the instructions looking for calls to newpc
-    for (; I != End; I++) {
-      if (auto Marker = dyn_cast<CallInst>(&*I)) {
-        // TODO: comparing strings is not very elegant
-        auto *Callee = Marker->getCalledFunction();
-        if (Callee != nullptr && Callee->getName() == "newpc") {
-
-          // We found two distinct newpc leading to the requested instruction
-          if (NewPCCall != nullptr)
-            return { 0, 0 };
-
-          NewPCCall = Marker;
-          break;
-        }
-      }
-    }
-
-    // If we haven't find a newpc call yet, continue exploration backward
-    if (NewPCCall == nullptr) {
-      // If one of the predecessors is the dispatcher, don't explore any further
-      for (BasicBlock *Predecessor : predecessors(BB)) {
-        // Assert we didn't reach the almighty dispatcher
-        assert(!(NewPCCall == nullptr && Predecessor == Dispatcher));
-        if (Predecessor == Dispatcher)
-          continue;
-      }
-
-      for (BasicBlock *Predecessor : predecessors(BB)) {
-        // Ignore already visited or empty BBs
-        if (!Predecessor->empty()
-            && Visited.find(Predecessor) == Visited.end()) {
-          WorkList.push(Predecessor->rbegin());
-          Visited.insert(Predecessor);
-        }
-      }
-    }
-
-  }
-
-  // Couldn't find the current PC
-  if (NewPCCall == nullptr)
-    return { 0, 0 };
-
-  uint64_t PC = getLimitedValue(NewPCCall->getArgOperand(0));
-  uint64_t Size = getLimitedValue(NewPCCall->getArgOperand(1));
-  assert(Size != 0);
-  return { PC, Size };
-}
@@ -16,6 +16,7 @@
 
 // Local includes
 #include "ir-helpers.h"
+#include "pcindex.h"
 #include "revamb.h"
 
 // Forward declarations
@@ -65,14 +66,9 @@ public:
 
     if (MD == nullptr) {
       llvm::Instruction *First = &*T->getParent()->begin();
-      if (auto *Call = llvm::dyn_cast<llvm::CallInst>(First)) {
-        llvm::Function *Callee = Call->getCalledFunction();
-        if (Callee != nullptr
-            && Callee->getName() == "newpc"
-            && getLimitedValue(Call->getArgOperand(2)) == 1) {
+      if (llvm::CallInst *Call = PCs.getNewPC(First))
+        if (getLimitedValue(Call->getArgOperand(2)) == 1)
           return JumpTargetBlock;
-        }
-      }
 
       return UntypedBlock;
     }
@@ -140,11 +136,16 @@ public:
     return BB != Dispatcher && BB != AnyPC && BB != UnexpectedPC;
   }
 
+  /// \brief Check if \p I is a call to `newpc`
+  bool isNewPC(llvm::Instruction *I) const { return PCs.isNewPC(I); }
+
   /// \brief Find the PC which lead to generated \p TheInstruction
   ///
   /// \return a pair of integers: the first element represents the PC and the
   ///         second the size of the instruction.
-  std::pair<uint64_t, uint64_t> getPC(llvm::Instruction *TheInstruction) const;
+  std::pair<uint64_t, uint64_t> getPC(llvm::Instruction *TheInstruction) const {
+    return PCs.getPC(TheInstruction);
+  }
 
   /// \brief Return the program counter of the next (i.e., fallthrough)
   ///        instruction of \p TheInstruction
@@ -165,6 +166,7 @@ private:
   llvm::BasicBlock *AnyPC;
   llvm::BasicBlock *UnexpectedPC;
   std::map<uint64_t, llvm::BasicBlock *> JumpTargets;
+  PCIndex PCs;
 };
 
 template<>
@@ -0,0 +1,248 @@
+/// \file helpercsvaccess.cpp
+/// \brief Implementation of the pass computing the parts of the CPU state read
+///        and written by each helper.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+// LLVM includes
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+// Local includes
+#include "debug.h"
+#include "helpercsvaccess.h"
+#include "ir-helpers.h"
+#include "variablemanager.h"
+
+using namespace llvm;
+
+char HelperCSVAccessPass::ID = 0;
+static RegisterPass<HelperCSVAccessPass> X("helper-csv-access",
+                                           "Helper CSV Access Pass",
+                                           true,
+                                           true);
+
+static const char *ReadsMDName = "revamb.csv.reads";
+static const char *WritesMDName = "revamb.csv.writes";
+
+bool HelperCSVAccessPass::AccessSummary::merge(const AccessSummary &Other) {
+  if (Unknown)
+    return false;
+
+  if (Other.Unknown)
+    return setUnknown();
+
+  size_t OldSize = Reads.size() + Writes.size();
+  Reads.insert(Other.Reads.begin(), Other.Reads.end());
+  Writes.insert(Other.Writes.begin(), Other.Writes.end());
+  return OldSize != Reads.size() + Writes.size();
+}
+
+bool HelperCSVAccessPass::AccessSummary::setUnknown() {
+  if (Unknown)
+    return false;
+
+  Unknown = true;
+  Reads.clear();
+  Writes.clear();
+  return true;
+}
+
+bool HelperCSVAccessPass::runOnModule(Module &M) {
+  DBG("passes", { dbg << "Starting HelperCSVAccessPass\n"; });
+
+  Summaries.clear();
+
+  if (Variables == nullptr) {
+    load(M);
+    return false;
+  }
+
+  compute(M);
+  attach(M);
+
+  return true;
+}
+
+void HelperCSVAccessPass::compute(Module &M) {
+  for (Function &F : M)
+    if (!F.isDeclaration() && F.getName() != "root")
+      Summaries[&F];
+
+  auto SummaryFor = [this] (Instruction *I) -> AccessSummary * {
+    auto It = Summaries.find(I->getParent()->getParent());
+    if (It == Summaries.end())
+      return nullptr;
+    return &It->second;
+  };
+
+  // Collect the direct accesses to each CSV, looking through constant
+  // expressions
+  for (auto &P : Variables->cpuStateGlobals()) {
+    uint64_t Offset = P.first;
+    GlobalVariable *CSV = P.second;
+
+    std::queue<std::pair<User *, Value *>> WorkList;
+    for (User *U : CSV->users())
+      WorkList.push({ U, CSV });
+
+    while (!WorkList.empty()) {
+      User *U;
+      Value *Pointer;
+      std::tie(U, Pointer) = WorkList.front();
+      WorkList.pop();
+
+      if (auto *Expression = dyn_cast<ConstantExpr>(U)) {
+        for (User *ExpressionUser : Expression->users())
+          WorkList.push({ ExpressionUser, Expression });
+        continue;
+      }
+
+      auto *I = dyn_cast<Instruction>(U);
+      if (I == nullptr)
+        continue;
+
+      AccessSummary *Summary = SummaryFor(I);
+      if (Summary == nullptr || Summary->Unknown)
+        continue;
+
+      auto *Store = dyn_cast<StoreInst>(I);
+      if (isa<LoadInst>(I))
+        Summary->Reads.insert(Offset);
+      else if (Store != nullptr && Store->getPointerOperand() == Pointer)
+        Summary->Writes.insert(Offset);
+      else
+        Summary->setUnknown(); // The address of the CSV escapes
+    }
+  }
+
+  // Accesses to env have not been resolved by CorrectCPUStateUsagePass
+  if (GlobalVariable *Env = M.getGlobalVariable("env"))
+    for (User *U : Env->users())
+      if (auto *I = dyn_cast<Instruction>(U))
+        if (AccessSummary *Summary = SummaryFor(I))
+          Summary->setUnknown();
+
+  // Build the call graph, indirect calls make the summary unknown
+  std::map<const Function *, std::set<const Function *>> Callees;
+  for (auto &P : Summaries) {
+    const Function *F = P.first;
+    for (const BasicBlock &BB : *F) {
+      for (const Instruction &I : BB) {
+        auto *Call = dyn_cast<CallInst>(&I);
+        if (Call == nullptr || isa<IntrinsicInst>(Call))
+          continue;
+
+        auto *Called = Call->getCalledValue()->stripPointerCasts();
+        auto *Callee = dyn_cast<Function>(Called);
+        if (Callee == nullptr)
+          P.second.setUnknown();
+        else if (Callee != F && Summaries.count(Callee) != 0)
+          Callees[F].insert(Callee);
+      }
+    }
+  }
+
+  // Propagate the summaries from the callees to the callers until a fixed
+  // point is reached
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (auto &P : Callees)
+      for (const Function *Callee : P.second)
+        Changed |= Summaries[P.first].merge(Summaries[Callee]);
+  }
+
+  DBG("csv-access", {
+      unsigned UnknownCount = 0;
+      for (auto &P : Summaries)
+        if (P.second.Unknown)
+          UnknownCount++;
+      dbg << std::dec << Summaries.size() << " functions summarized, "
+          << UnknownCount << " of which might access any CSV\n";
+    });
+}
+
+void HelperCSVAccessPass::attach(Module &M) {
+  QuickMetadata QMD(M.getContext());
+
+  auto ToTuple = [&QMD] (const std::set<uint64_t> &Offsets) {
+    std::vector<Metadata *> Result;
+    for (uint64_t Offset : Offsets)
+      Result.push_back(QMD.get(static_cast<uint32_t>(Offset)));
+    return QMD.tuple(Result);
+  };
+
+  for (auto &P : Summaries) {
+    auto *F = const_cast<Function *>(P.first);
+    if (P.second.Unknown) {
+      F->setMetadata(ReadsMDName, nullptr);
+      F->setMetadata(WritesMDName, nullptr);
+    } else {
+      F->setMetadata(ReadsMDName, ToTuple(P.second.Reads));
+      F->setMetadata(WritesMDName, ToTuple(P.second.Writes));
+    }
+  }
+}
+
+void HelperCSVAccessPass::load(Module &M) {
+  QuickMetadata QMD(M.getContext());
+
+  for (Function &F : M) {
+    if (F.isDeclaration() || F.getName() == "root")
+      continue;
+
+    AccessSummary &Summary = Summaries[&F];
+    auto *Reads = cast_or_null<MDTuple>(F.getMetadata(ReadsMDName));
+    auto *Writes = cast_or_null<MDTuple>(F.getMetadata(WritesMDName));
+    if (Reads == nullptr || Writes == nullptr) {
+      Summary.setUnknown();
+      continue;
+    }
+
+    for (const MDOperand &Operand : Reads->operands())
+      Summary.Reads.insert(QMD.extract<uint32_t>(Operand.get()));
+    for (const MDOperand &Operand : Writes->operands())
+      Summary.Writes.insert(QMD.extract<uint32_t>(Operand.get()));
+  }
+}
+
+void HelperCSVAccessPass::serialize(std::ostream &Output) {
+  std::vector<const Function *> Functions;
+  for (auto &P : Summaries)
+    Functions.push_back(P.first);
+
+  std::sort(Functions.begin(),
+            Functions.end(),
+            [] (const Function *A, const Function *B) {
+              return A->getName() < B->getName();
+            });
+
+  Output << "function,access,offset\n";
+  for (const Function *F : Functions) {
+    const AccessSummary &Summary = Summaries[F];
+    const char *Name = F->getName().data();
+
+    if (Summary.Unknown) {
+      Output << Name << ",unknown,\n";
+      continue;
+    }
+
+    Output << std::hex;
+    for (uint64_t Offset : Summary.Reads)
+      Output << Name << ",read,0x" << Offset << "\n";
+    for (uint64_t Offset : Summary.Writes)
+      Output << Name << ",write,0x" << Offset << "\n";
+    Output << std::dec;
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef _HELPERCSVACCESS_H
+#define _HELPERCSVACCESS_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <set>
+
+// LLVM includes
+#include "llvm/Pass.h"
+
+// Forward declarations
+namespace llvm {
+class Function;
+class Module;
+}
+
+class VariableManager;
+
+/// \brief Compute which parts of the CPU state each helper might read or write
+///
+/// This pass has to run after CorrectCPUStateUsagePass, i.e., once all the
+/// accesses to `env` in the helpers have been turned into accesses to CSVs.
+/// For each function (except `root`), it collects the offsets in the CPU state
+/// of the CSVs it reads and writes, also considering the functions it calls.
+///
+/// If a function performs indirect calls, still uses `env` (i.e., it contains
+/// accesses CorrectCPUStateUsagePass was not able to resolve) or lets the
+/// address of a CSV escape, the summary is marked as unknown, meaning that the
+/// function might access any part of the CPU state.
+///
+/// The summaries are attached to each function in the form of two metadata
+/// tuples of offsets, `revamb.csv.reads` and `revamb.csv.writes`. Functions
+/// with an unknown summary have no such metadata. If no VariableManager is
+/// provided, the pass simply loads the summaries from the metadata.
+class HelperCSVAccessPass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  /// \brief Offsets in the CPU state accessed by a function
+  struct AccessSummary {
+    AccessSummary() : Unknown(false) { }
+
+    /// \brief Merge the accesses of \p Other in this summary
+    ///
+    /// \return true if this summary changed.
+    bool merge(const AccessSummary &Other);
+
+    /// \brief Mark this summary as unknown
+    ///
+    /// \return true if this summary changed.
+    bool setUnknown();
+
+    bool Unknown; ///< Might the function access any part of the CPU state?
+    std::set<uint64_t> Reads; ///< Offsets of the CSVs read
+    std::set<uint64_t> Writes; ///< Offsets of the CSVs written
+  };
+
+public:
+  HelperCSVAccessPass() : llvm::ModulePass(ID), Variables(nullptr) { }
+
+  HelperCSVAccessPass(VariableManager *Variables) :
+    llvm::ModulePass(ID),
+    Variables(Variables) { }
+
+  bool runOnModule(llvm::Module &M) override;
+
+  void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
+    AU.setPreservesAll();
+  }
+
+  /// \brief Return the summary associated to \p F
+  ///
+  /// \return a pointer to the summary of \p F, or nullptr if it's unknown.
+  const AccessSummary *summary(const llvm::Function *F) const {
+    auto It = Summaries.find(F);
+    if (It == Summaries.end() || It->second.Unknown)
+      return nullptr;
+    return &It->second;
+  }
+
+  /// \brief Write the summaries as a CSV with the `function`, `access` and
+  ///        `offset` columns
+  void serialize(std::ostream &Output);
+
+private:
+  void compute(llvm::Module &M);
+  void attach(llvm::Module &M);
+  void load(llvm::Module &M);
+
+private:
+  VariableManager *Variables;
+  std::map<const llvm::Function *, AccessSummary> Summaries;
+};
+
+#endif // _HELPERCSVACCESS_H
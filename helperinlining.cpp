@@ -0,0 +1,261 @@
+/// \file helperinlining.cpp
+/// \brief Implementation of the pass inlining and specializing QEMU helpers
+///        into the translated code.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <limits>
+#include <set>
+#include <sstream>
+
+// LLVM includes
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+// Local includes
+#include "debug.h"
+#include "helperinlining.h"
+
+using namespace llvm;
+
+char HelperInliningPass::ID = 0;
+static RegisterPass<HelperInliningPass> X("inline-helpers",
+                                          "Helper Inlining Pass",
+                                          false,
+                                          false);
+
+/// Additional cost for each call performed by a helper, since inlining it will
+/// not remove the call overhead of its callees.
+static const unsigned CallPenalty = 5;
+
+Function *HelperInliningPass::getEligibleCallee(CallInst *Call) {
+  // Calls to specialized helpers might go through a bitcast
+  Value *Called = Call->getCalledValue()->stripPointerCasts();
+  auto *Callee = dyn_cast<Function>(Called);
+
+  if (Callee == nullptr
+      || Callee->isDeclaration()
+      || Callee->isIntrinsic()
+      || Callee->isVarArg()
+      || Callee->hasFnAttribute(Attribute::NoInline)
+      || !Callee->getName().startswith("helper_"))
+    return nullptr;
+
+  // We only handle no-op casts
+  if (Callee->getFunctionType() != Call->getFunctionType())
+    return nullptr;
+
+  return Callee;
+}
+
+unsigned HelperInliningPass::cost(Function *F) {
+  auto It = Costs.find(F);
+  if (It != Costs.end())
+    return It->second;
+
+  unsigned Result = 0;
+  for (BasicBlock &BB : *F) {
+    for (Instruction &I : BB) {
+      if (isa<DbgInfoIntrinsic>(&I))
+        continue;
+
+      Result++;
+
+      if (auto *Call = dyn_cast<CallInst>(&I)) {
+        // Never inline recursive functions
+        if (Call->getCalledValue()->stripPointerCasts() == F) {
+          Costs[F] = std::numeric_limits<unsigned>::max();
+          return Costs[F];
+        }
+
+        if (!isa<IntrinsicInst>(Call))
+          Result += CallPenalty;
+      }
+    }
+  }
+
+  Costs[F] = Result;
+  return Result;
+}
+
+/// \brief Fold constants in \p F and remove the code that became unreachable
+static void foldConstants(Function *F) {
+  const DataLayout &DL = F->getParent()->getDataLayout();
+
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+
+    for (BasicBlock &BB : *F) {
+      for (auto It = BB.begin(); It != BB.end();) {
+        Instruction *I = &*It++;
+
+        if (isInstructionTriviallyDead(I)) {
+          I->eraseFromParent();
+          Changed = true;
+        } else if (Constant *C = ConstantFoldInstruction(I, DL)) {
+          I->replaceAllUsesWith(C);
+          I->eraseFromParent();
+          Changed = true;
+        }
+      }
+
+      Changed |= ConstantFoldTerminator(&BB, true);
+    }
+
+    Changed |= removeUnreachableBlocks(*F);
+  }
+}
+
+Function *HelperInliningPass::specialize(CallInst *Call, Function *Callee) {
+  ConstantArguments Arguments;
+  for (unsigned I = 0; I < Call->getNumArgOperands(); I++)
+    if (auto *Constant = dyn_cast<ConstantInt>(Call->getArgOperand(I)))
+      if (Constant->getBitWidth() <= 64)
+        Arguments.push_back({ I, Constant->getZExtValue() });
+
+  if (Arguments.empty())
+    return nullptr;
+
+  // Do we already have this specialization?
+  SpecializationKey Key = { Callee, Arguments };
+  auto It = Specializations.find(Key);
+  if (It != Specializations.end())
+    return It->second;
+
+  std::stringstream NewName;
+  NewName << Callee->getName().str() << "_c" << Specializations.size();
+  Function *NewFunc = Function::Create(Callee->getFunctionType(),
+                                       GlobalValue::InternalLinkage,
+                                       NewName.str(),
+                                       Callee->getParent());
+
+  // Map the specialized arguments to their constant value and all the others
+  // to the corresponding argument of the new function
+  ValueToValueMapTy VTV;
+  SmallVector<ReturnInst *, 5> Returns;
+  auto NewArg = NewFunc->arg_begin();
+  auto Specialized = Arguments.begin();
+  unsigned Index = 0;
+  for (Argument &CalleeArg : Callee->args()) {
+    NewArg->setName(CalleeArg.getName());
+
+    if (Specialized != Arguments.end() && Specialized->first == Index) {
+      VTV[&CalleeArg] = Call->getArgOperand(Index);
+      Specialized++;
+    } else {
+      VTV[&CalleeArg] = &*NewArg;
+    }
+
+    NewArg++;
+    Index++;
+  }
+
+  CloneFunctionInto(NewFunc, Callee, VTV, true, Returns);
+  foldConstants(NewFunc);
+
+  // Keep the specialization only if it's actually smaller than the original
+  if (cost(NewFunc) >= cost(Callee)) {
+    Costs.erase(NewFunc);
+    NewFunc->eraseFromParent();
+    NewFunc = nullptr;
+  } else {
+    SpecializedCount++;
+  }
+
+  Specializations[Key] = NewFunc;
+  return NewFunc;
+}
+
+bool HelperInliningPass::runOnModule(Module &M) {
+  DBG("passes", { dbg << "Starting HelperInliningPass\n"; });
+
+  Function *Root = M.getFunction("root");
+  if (Root == nullptr)
+    return false;
+
+  // Collect the candidate call sites first, inlining will change the CFG. Also
+  // record the original instructions, to tell them apart from the inlined ones.
+  std::vector<CallInst *> Calls;
+  std::set<Instruction *> Original;
+  for (BasicBlock &BB : *Root) {
+    for (Instruction &I : BB) {
+      Original.insert(&I);
+      if (auto *Call = dyn_cast<CallInst>(&I))
+        if (getEligibleCallee(Call) != nullptr)
+          Calls.push_back(Call);
+    }
+  }
+
+  std::set<Function *> Touched;
+  bool Changed = false;
+  for (CallInst *Call : Calls) {
+    Function *Callee = getEligibleCallee(Call);
+    Touched.insert(Callee);
+
+    if (cost(Callee) > Threshold) {
+      // Too large, try to specialize it on its constant arguments
+      Function *Specialized = specialize(Call, Callee);
+      if (Specialized == nullptr)
+        continue;
+
+      Call->setCalledFunction(Specialized);
+      Touched.insert(Specialized);
+      Changed = true;
+
+      if (cost(Specialized) > Threshold)
+        continue;
+    }
+
+    InlineFunctionInfo IFI;
+    if (InlineFunction(Call, IFI)) {
+      // The call is gone, its memory might be reused by the next inlined code
+      Original.erase(Call);
+      InlinedCount++;
+      Changed = true;
+    }
+  }
+
+  if (!Changed)
+    return false;
+
+  // The debug information of the inlined code refers to the helpers, drop it,
+  // the DebugHelper will take care of root
+  std::vector<Instruction *> ToErase;
+  for (BasicBlock &BB : *Root) {
+    for (Instruction &I : BB) {
+      if (Original.count(&I) != 0)
+        continue;
+
+      if (isa<DbgInfoIntrinsic>(&I))
+        ToErase.push_back(&I);
+      else
+        I.setDebugLoc(DebugLoc());
+    }
+  }
+
+  for (Instruction *I : ToErase)
+    I->eraseFromParent();
+
+  // Purge helpers that are no longer used
+  for (Function *F : Touched)
+    if (F->use_empty() && F->hasLocalLinkage())
+      F->eraseFromParent();
+
+  DBG("inlining", dbg << std::dec
+                      << InlinedCount << " helper calls inlined, "
+                      << SpecializedCount << " helper specializations "
+                      << "created\n");
+
+  return true;
+}
@@ -0,0 +1,91 @@
+#ifndef _HELPERINLINING_H
+#define _HELPERINLINING_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+// LLVM includes
+#include "llvm/Pass.h"
+
+// Forward declarations
+namespace llvm {
+class CallInst;
+class Function;
+}
+
+/// \brief Inline and specialize QEMU helpers called by the translated code
+///
+/// Once the helpers have been linked in and CorrectCPUStateUsagePass has
+/// turned their `env` accesses into accesses to CSVs, the calls from `root`
+/// are opaque only due to the call boundary. This pass inlines the helpers
+/// whose cost is below a threshold at their call sites in `root`.
+///
+/// Calls to helpers that are too large to be inlined but that receive one or
+/// more constant integer arguments are redirected to a clone of the helper
+/// specialized on such constants. If, after constant folding, the specialized
+/// version is cheap enough it gets inlined too. Specializations are cached on
+/// the (helper, constant arguments) pair, so they are shared among all the call
+/// sites with the same constant arguments.
+///
+/// The specialization performed by CorrectCPUStateUsagePass is not reused
+/// since it only handles arguments which are offsets in the CPU state and it's
+/// driven by its own worklist of `env` uses, while here any constant integer
+/// argument is a candidate and the helpers are already free of `env` accesses.
+class HelperInliningPass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  static const unsigned DefaultThreshold = 50;
+
+  HelperInliningPass() :
+    llvm::ModulePass(ID),
+    Threshold(DefaultThreshold),
+    InlinedCount(0),
+    SpecializedCount(0) { }
+
+  HelperInliningPass(unsigned Threshold) :
+    llvm::ModulePass(ID),
+    Threshold(Threshold),
+    InlinedCount(0),
+    SpecializedCount(0) { }
+
+  bool runOnModule(llvm::Module &M) override;
+
+private:
+  /// \brief Check if \p Call targets a helper we are allowed to manipulate
+  ///
+  /// \return the called helper, or nullptr if \p Call is not eligible.
+  llvm::Function *getEligibleCallee(llvm::CallInst *Call);
+
+  /// \brief Estimate the cost of inlining \p F
+  ///
+  /// The cost is the number of instructions in \p F, with an additional penalty
+  /// for each call it performs.
+  unsigned cost(llvm::Function *F);
+
+  /// \brief Obtain a version of the callee of \p Call specialized on its
+  ///        constant integer arguments
+  ///
+  /// \return the specialized function, or nullptr if \p Call has no constant
+  ///         arguments or the specialization is not profitable.
+  llvm::Function *specialize(llvm::CallInst *Call, llvm::Function *Callee);
+
+private:
+  using ConstantArguments = std::vector<std::pair<unsigned, uint64_t>>;
+  using SpecializationKey = std::pair<llvm::Function *, ConstantArguments>;
+
+  unsigned Threshold;
+  std::map<llvm::Function *, unsigned> Costs;
+  std::map<SpecializationKey, llvm::Function *> Specializations;
+  unsigned InlinedCount;
+  unsigned SpecializedCount;
+};
+
+#endif // _HELPERINLINING_H
@@ -23,12 +23,12 @@
 
 // Local includes
 #include "datastructures.h"
+#include "debug.h"
 #include "instructiontranslator.h"
 #include "ir-helpers.h"
 #include "ptcinterface.h"
 #include "rai.h"
 #include "range.h"
-#include "transformadapter.h"
 #include "variablemanager.h"
 
 using namespace llvm;
@@ -145,11 +145,11 @@ namespace PTC {
       return TheInstruction->opc;
     }
 
-    std::string helperName() const {
+    StringRef helperName() const {
       assert(IsCall);
       PTCHelperDef *Helper = ptc_find_helper(&ptc, ConstArguments[0]);
       assert(Helper != nullptr && Helper->name != nullptr);
-      return std::string(Helper->name);
+      return StringRef(Helper->name);
     }
 
     uint64_t pc() const {
@@ -466,6 +466,127 @@ static Value *CreateICmp(T& Builder,
                             SecondOperand);
 }
 
+/// Classification of PTC opcodes for the purpose of the peephole optimizations
+enum PeepholeOpcodeKind {
+  Barrier, ///< Control flow, helper calls and unknown opcodes
+  Neutral, ///< Instructions not reading nor writing any temporary
+  Pure, ///< Only effect is writing the output arguments
+  EnvLoad, ///< Pure, but might read any CSV through `env`
+  MemoryAccess ///< Access to the guest memory, cannot be removed
+};
+
+/// Classifies \p Opcode for the purpose of the peephole optimizations.
+static PeepholeOpcodeKind getPeepholeKind(unsigned Opcode) {
+  switch (Opcode) {
+  case PTC_INSTRUCTION_op_debug_insn_start:
+  case PTC_INSTRUCTION_op_discard:
+    return Neutral;
+  case PTC_INSTRUCTION_op_movi_i32:
+  case PTC_INSTRUCTION_op_movi_i64:
+  case PTC_INSTRUCTION_op_mov_i32:
+  case PTC_INSTRUCTION_op_mov_i64:
+  case PTC_INSTRUCTION_op_add_i32:
+  case PTC_INSTRUCTION_op_add_i64:
+  case PTC_INSTRUCTION_op_sub_i32:
+  case PTC_INSTRUCTION_op_sub_i64:
+  case PTC_INSTRUCTION_op_mul_i32:
+  case PTC_INSTRUCTION_op_mul_i64:
+  case PTC_INSTRUCTION_op_and_i32:
+  case PTC_INSTRUCTION_op_and_i64:
+  case PTC_INSTRUCTION_op_or_i32:
+  case PTC_INSTRUCTION_op_or_i64:
+  case PTC_INSTRUCTION_op_xor_i32:
+  case PTC_INSTRUCTION_op_xor_i64:
+  case PTC_INSTRUCTION_op_shl_i32:
+  case PTC_INSTRUCTION_op_shl_i64:
+  case PTC_INSTRUCTION_op_shr_i32:
+  case PTC_INSTRUCTION_op_shr_i64:
+  case PTC_INSTRUCTION_op_sar_i32:
+  case PTC_INSTRUCTION_op_sar_i64:
+  case PTC_INSTRUCTION_op_setcond_i32:
+  case PTC_INSTRUCTION_op_setcond_i64:
+  case PTC_INSTRUCTION_op_ext8s_i32:
+  case PTC_INSTRUCTION_op_ext8s_i64:
+  case PTC_INSTRUCTION_op_ext8u_i32:
+  case PTC_INSTRUCTION_op_ext8u_i64:
+  case PTC_INSTRUCTION_op_ext16s_i32:
+  case PTC_INSTRUCTION_op_ext16s_i64:
+  case PTC_INSTRUCTION_op_ext16u_i32:
+  case PTC_INSTRUCTION_op_ext16u_i64:
+  case PTC_INSTRUCTION_op_ext32s_i64:
+  case PTC_INSTRUCTION_op_ext32u_i64:
+  case PTC_INSTRUCTION_op_not_i32:
+  case PTC_INSTRUCTION_op_not_i64:
+  case PTC_INSTRUCTION_op_neg_i32:
+  case PTC_INSTRUCTION_op_neg_i64:
+    return Pure;
+  case PTC_INSTRUCTION_op_ld8u_i32:
+  case PTC_INSTRUCTION_op_ld8s_i32:
+  case PTC_INSTRUCTION_op_ld16u_i32:
+  case PTC_INSTRUCTION_op_ld16s_i32:
+  case PTC_INSTRUCTION_op_ld_i32:
+  case PTC_INSTRUCTION_op_ld8u_i64:
+  case PTC_INSTRUCTION_op_ld8s_i64:
+  case PTC_INSTRUCTION_op_ld16u_i64:
+  case PTC_INSTRUCTION_op_ld16s_i64:
+  case PTC_INSTRUCTION_op_ld32u_i64:
+  case PTC_INSTRUCTION_op_ld32s_i64:
+  case PTC_INSTRUCTION_op_ld_i64:
+    return EnvLoad;
+  case PTC_INSTRUCTION_op_qemu_ld_i32:
+  case PTC_INSTRUCTION_op_qemu_ld_i64:
+  case PTC_INSTRUCTION_op_qemu_st_i32:
+  case PTC_INSTRUCTION_op_qemu_st_i64:
+    return MemoryAccess;
+  default:
+    // Stores to env write CSVs we cannot identify here, treat them as barriers
+    return Barrier;
+  }
+}
+
+/// Tries to fold a PTC binary operation with constant operands, without
+/// creating any Constant
+///
+/// \return the result, or nothing if it's not a well-defined constant (e.g.,
+///         a division by zero or an over-wide shift).
+static Optional<uint64_t> foldBinaryOp(unsigned Width,
+                                       unsigned Opcode,
+                                       uint64_t FirstOperand,
+                                       uint64_t SecondOperand) {
+  switch (Opcode) {
+  case PTC_INSTRUCTION_op_add_i32:
+  case PTC_INSTRUCTION_op_add_i64:
+  case PTC_INSTRUCTION_op_sub_i32:
+  case PTC_INSTRUCTION_op_sub_i64:
+  case PTC_INSTRUCTION_op_mul_i32:
+  case PTC_INSTRUCTION_op_mul_i64:
+  case PTC_INSTRUCTION_op_and_i32:
+  case PTC_INSTRUCTION_op_and_i64:
+  case PTC_INSTRUCTION_op_or_i32:
+  case PTC_INSTRUCTION_op_or_i64:
+  case PTC_INSTRUCTION_op_xor_i32:
+  case PTC_INSTRUCTION_op_xor_i64:
+  case PTC_INSTRUCTION_op_shl_i32:
+  case PTC_INSTRUCTION_op_shl_i64:
+  case PTC_INSTRUCTION_op_shr_i32:
+  case PTC_INSTRUCTION_op_shr_i64:
+  case PTC_INSTRUCTION_op_sar_i32:
+  case PTC_INSTRUCTION_op_sar_i64:
+    break;
+  default:
+    return Optional<uint64_t>();
+  }
+
+  auto BinaryOp = opcodeToBinaryOp(static_cast<PTCOpcode>(Opcode));
+  Optional<APInt> Result = foldBinaryOperator(BinaryOp,
+                                              APInt(Width, FirstOperand),
+                                              APInt(Width, SecondOperand));
+  if (!Result)
+    return Optional<uint64_t>();
+
+  return Result->getZExtValue();
+}
+
 using LBM = IT::LabeledBlocksMap;
 IT::InstructionTranslator(IRBuilder<>& Builder,
                           VariableManager& Variables,
@@ -503,6 +624,7 @@ IT::InstructionTranslator(IRBuilder<>& Builder,
                                  GlobalValue::ExternalLinkage,
                                  "newpc",
                                  &TheModule);
+  JumpTargets.setNewPCMarker(NewPCMarker);
 }
 
 void IT::finalizeNewPCMarkers(std::string &CoveragePath) {
@@ -567,9 +689,190 @@ SmallSet<unsigned, 1> IT::preprocess(PTCInstructionList *InstructionList) {
     break;
   }
 
+  peephole(InstructionList, Result);
+
   return Result;
 }
 
+void IT::peephole(PTCInstructionList *InstructionList,
+                  SmallSet<unsigned, 1> &Dead) {
+  KnownArguments.clear();
+
+  unsigned InstructionCount = InstructionList->instruction_count;
+  StringRef PCName = JumpTargets.pcReg()->getName();
+
+  auto SizeOf = [InstructionList] (unsigned TemporaryId) {
+    PTCTemp *Temporary = ptc_temp_get(InstructionList, TemporaryId);
+    return Temporary->type == PTC_TYPE_I32 ? 32U : 64U;
+  };
+
+  // Forward pass: copy propagation, constant propagation and folding
+  auto &Known = KnownTemporaries;
+  Known.clear();
+  SmallVector<uint64_t, 4> InArguments;
+  for (unsigned I = 0; I < InstructionCount; I++) {
+    PTCInstruction *Instruction = &InstructionList->instructions[I];
+    unsigned Opcode = Instruction->opc;
+    PeepholeOpcodeKind Kind = getPeepholeKind(Opcode);
+
+    // Each input instruction can be a jump target, and helpers can access any
+    // CSV: do not propagate anything across them
+    if (Opcode == PTC_INSTRUCTION_op_debug_insn_start
+        || Opcode == PTC_INSTRUCTION_op_call) {
+      Known.clear();
+      continue;
+    }
+
+    if (Kind == Neutral)
+      continue;
+
+    const PTC::Instruction TheInstruction(Instruction);
+    InArguments.assign(TheInstruction.InArguments.begin(),
+                       TheInstruction.InArguments.end());
+
+    // Replace the input arguments with a known value, but never feed a
+    // constant as an address
+    bool AcceptsConstants = (Kind == Pure
+                             || Opcode == PTC_INSTRUCTION_op_brcond_i32
+                             || Opcode == PTC_INSTRUCTION_op_brcond_i64);
+    bool AllConstant = !InArguments.empty();
+    for (unsigned J = 0; J < InArguments.size(); J++) {
+      auto It = Known.find(InArguments[J]);
+      if (It == Known.end()
+          || (It->second.Kind == KnownValue::Constant && !AcceptsConstants)) {
+        AllConstant = false;
+        continue;
+      }
+
+      KnownValue Replacement = It->second;
+      Replacement.Size = SizeOf(InArguments[J]);
+      KnownArguments[{ Instruction, J }] = Replacement;
+
+      if (Replacement.Kind == KnownValue::Constant)
+        InArguments[J] = Replacement.Value;
+      else
+        AllConstant = false;
+    }
+
+    if (Kind == Barrier) {
+      Known.clear();
+      continue;
+    }
+
+    // Compute the value of the result, if possible
+    bool HasResult = false;
+    KnownValue Result = { KnownValue::Constant, 0, 0 };
+    if (Opcode == PTC_INSTRUCTION_op_movi_i32
+        || Opcode == PTC_INSTRUCTION_op_movi_i64) {
+      Result = { KnownValue::Constant, TheInstruction.ConstArguments[0], 0 };
+      HasResult = true;
+    } else if (Opcode == PTC_INSTRUCTION_op_mov_i32
+               || Opcode == PTC_INSTRUCTION_op_mov_i64) {
+      auto It = KnownArguments.find({ Instruction, 0 });
+      if (It != KnownArguments.end())
+        Result = It->second;
+      else
+        Result = { KnownValue::Temporary, InArguments[0], 0 };
+      HasResult = true;
+    } else if (AllConstant && InArguments.size() == 2) {
+      Optional<uint64_t> Folded = foldBinaryOp(getRegisterSize(Opcode),
+                                               Opcode,
+                                               InArguments[0],
+                                               InArguments[1]);
+      if (Folded) {
+        Result = { KnownValue::Constant, *Folded, 0 };
+        HasResult = true;
+      }
+    }
+
+    // Forget everything about the overwritten temporaries
+    for (uint64_t OutArgument : TheInstruction.OutArguments) {
+      Known.erase(OutArgument);
+      for (auto It = Known.begin(); It != Known.end();) {
+        auto Current = It++;
+        if (Current->second.Kind == KnownValue::Temporary
+            && Current->second.Value == OutArgument)
+          Known.erase(Current);
+      }
+    }
+
+    if (HasResult) {
+      uint64_t OutArgument = TheInstruction.OutArguments[0];
+      bool SelfCopy = (Result.Kind == KnownValue::Temporary
+                       && Result.Value == OutArgument);
+      if (!SelfCopy)
+        Known[OutArgument] = Result;
+    }
+  }
+
+  // Backward pass: remove the instructions whose outputs are overwritten
+  // before being read. Overwritten contains the temporaries which are
+  // certainly written before being read, everything else is considered alive.
+  unsigned RemovedCount = 0;
+  auto &Overwritten = OverwrittenTemporaries;
+  Overwritten.clear();
+  for (unsigned I = InstructionCount; I > 0; I--) {
+    PTCInstruction *Instruction = &InstructionList->instructions[I - 1];
+    PeepholeOpcodeKind Kind = getPeepholeKind(Instruction->opc);
+
+    if (Kind == Neutral)
+      continue;
+
+    if (Kind == Barrier) {
+      Overwritten.clear();
+      continue;
+    }
+
+    const PTC::Instruction TheInstruction(Instruction);
+
+    if (Kind == Pure || Kind == EnvLoad) {
+      bool Removable = true;
+      for (uint64_t OutArgument : TheInstruction.OutArguments) {
+        PTCTemp *Temporary = ptc_temp_get(InstructionList, OutArgument);
+        bool IsPC = ptc_temp_is_global(InstructionList, OutArgument)
+          && PCName == Temporary->name;
+        if (IsPC || Overwritten.count(OutArgument) == 0) {
+          Removable = false;
+          break;
+        }
+      }
+
+      if (Removable) {
+        Dead.insert(I - 1);
+        RemovedCount++;
+        continue;
+      }
+    }
+
+    for (uint64_t OutArgument : TheInstruction.OutArguments)
+      Overwritten.insert(OutArgument);
+
+    // Loads from env might read any CSV
+    if (Kind == EnvLoad) {
+      for (auto It = Overwritten.begin(); It != Overwritten.end();) {
+        auto Current = It++;
+        if (ptc_temp_is_global(InstructionList, *Current))
+          Overwritten.erase(Current);
+      }
+    }
+
+    unsigned J = 0;
+    for (uint64_t InArgument : TheInstruction.InArguments) {
+      auto It = KnownArguments.find({ Instruction, J++ });
+      if (It == KnownArguments.end())
+        Overwritten.erase(InArgument);
+      else if (It->second.Kind == KnownValue::Temporary)
+        Overwritten.erase(It->second.Value);
+    }
+  }
+
+  DBG("peephole", {
+      dbg << std::dec << KnownArguments.size() << " arguments propagated, "
+          << RemovedCount << " of " << InstructionCount
+          << " PTC instructions removed\n";
+    });
+}
+
 std::tuple<IT::TranslationResult, MDNode *, uint64_t, uint64_t>
 IT::newInstruction(PTCInstruction *Instr,
                    PTCInstruction *Next,
@@ -593,6 +896,14 @@ IT::newInstruction(PTCInstruction *Instr,
   MDNode *MDOriginalInstr = MDNode::getDistinct(Context,
                                                 { MDOriginalString, MDPC });
 
+  // Stop as soon as we leave the region to translate
+  if (!IsFirst && !JumpTargets.isInTranslationRegion(PC)) {
+    auto *PCType = JumpTargets.pcReg()->getType()->getPointerElementType();
+    Builder.CreateStore(ConstantInt::get(PCType, PC), JumpTargets.pcReg());
+    Builder.CreateBr(JumpTargets.regionExit());
+    return R { Stop, MDOriginalInstr, PC, NextPC };
+  }
+
   if (ForceNew)
     JumpTargets.registerJT(PC, JumpTargetManager::PostHelper);
 
@@ -687,7 +998,8 @@ static StoreInst *getLastUniqueWrite(BasicBlock *BB, Value *Register) {
 IT::TranslationResult IT::translateCall(PTCInstruction *Instr) {
   const PTC::CallInstruction TheCall(Instr);
 
-  std::vector<Value *> InArgs;
+  SmallVector<Value *, 4> InArgs;
+  SmallVector<Type *, 4> InArgsType;
 
   for (uint64_t TemporaryId : TheCall.InArguments) {
     auto *Temporary = Variables.getOrCreate(TemporaryId, true);
@@ -696,11 +1008,9 @@ IT::TranslationResult IT::translateCall(PTCInstruction *Instr) {
     auto *Load = Builder.CreateLoad(Temporary);
     Variables.setAliasScope(Load);
     InArgs.push_back(Load);
+    InArgsType.push_back(Load->getType());
   }
 
-  auto GetValueType = [] (Value *Argument) { return Argument->getType(); };
-  std::vector<Type *> InArgsType = (InArgs | GetValueType).toVector();
-
   // TODO: handle multiple return arguments
   assert(TheCall.OutArguments.size() <= 1);
 
@@ -720,7 +1030,8 @@ IT::TranslationResult IT::translateCall(PTCInstruction *Instr) {
                                        ArrayRef<Type *>(InArgsType),
                                        false);
 
-  std::string HelperName = "helper_" + TheCall.helperName();
+  SmallString<64> HelperName("helper_");
+  HelperName += TheCall.helperName();
   Constant *FunctionDeclaration = TheModule.getOrInsertFunction(HelperName,
                                                                 CalleeType);
 
@@ -744,22 +1055,40 @@ IT::TranslationResult IT::translate(PTCInstruction *Instr,
                                     uint64_t NextPC) {
   const PTC::Instruction TheInstruction(Instr);
 
-  std::vector<Value *> InArgs;
+  SmallVector<Value *, 4> InArgs;
+  unsigned ArgumentIndex = 0;
   for (uint64_t TemporaryId : TheInstruction.InArguments) {
+    // Use the value identified by the peephole optimizations, if any
+    auto It = KnownArguments.find({ Instr, ArgumentIndex++ });
+    Type *ReplacementType = nullptr;
+    if (It != KnownArguments.end()) {
+      const KnownValue &Replacement = It->second;
+      ReplacementType = Builder.getIntNTy(Replacement.Size);
+      if (Replacement.Kind == KnownValue::Constant) {
+        InArgs.push_back(ConstantInt::get(ReplacementType, Replacement.Value));
+        continue;
+      }
+
+      TemporaryId = Replacement.Value;
+    }
+
     auto *Temporary = Variables.getOrCreate(TemporaryId, true);
     if (Temporary == nullptr)
       return Abort;
 
     auto *Load = Builder.CreateLoad(Temporary);
     Variables.setAliasScope(Load);
-    InArgs.push_back(Load);
+
+    if (ReplacementType != nullptr)
+      InArgs.push_back(Builder.CreateZExtOrTrunc(Load, ReplacementType));
+    else
+      InArgs.push_back(Load);
   }
 
-  auto ConstArgs = TheInstruction.ConstArguments;
+  SmallVector<uint64_t, 4> ConstArgs(TheInstruction.ConstArguments.begin(),
+                                     TheInstruction.ConstArguments.end());
   LastPC = PC;
-  auto Result = translateOpcode(TheInstruction.opcode(),
-                                ConstArgs.toVector(),
-                                InArgs);
+  auto Result = translateOpcode(TheInstruction.opcode(), ConstArgs, InArgs);
 
   // Check if there was an error while translating the instruction
   if (!Result)
@@ -792,21 +1121,37 @@ IT::TranslationResult IT::translate(PTCInstruction *Instr,
   return Success;
 }
 
-ErrorOr<std::vector<Value *>>
+ErrorOr<IT::OutputValues>
 IT::translateOpcode(PTCOpcode Opcode,
-                    std::vector<uint64_t> ConstArguments,
-                    std::vector<Value *> InArguments) {
-  LLVMContext& Context = TheModule.getContext();
+                    ArrayRef<uint64_t> ConstArguments,
+                    ArrayRef<Value *> InArguments) {
+  using Translator = ErrorOr<OutputValues> (IT::*)(PTCOpcode,
+                                                   ArrayRef<uint64_t>,
+                                                   ArrayRef<Value *>);
+  static const Translator Translators[] = {
+    &IT::translateSizedOpcode<0>,
+    &IT::translateSizedOpcode<32>,
+    &IT::translateSizedOpcode<64>
+  };
+
   unsigned RegisterSize = getRegisterSize(Opcode);
+  assert(RegisterSize % 32 == 0 && RegisterSize <= 64);
+  return (this->*Translators[RegisterSize / 32])(Opcode,
+                                                  ConstArguments,
+                                                  InArguments);
+}
+
+template<unsigned RegisterSize>
+ErrorOr<IT::OutputValues>
+IT::translateSizedOpcode(PTCOpcode Opcode,
+                         ArrayRef<uint64_t> ConstArguments,
+                         ArrayRef<Value *> InArguments) {
+  LLVMContext& Context = TheModule.getContext();
   Type *RegisterType = nullptr;
-  if (RegisterSize == 32)
-    RegisterType = Builder.getInt32Ty();
-  else if (RegisterSize == 64)
-    RegisterType = Builder.getInt64Ty();
-  else if (RegisterSize != 0)
-    llvm_unreachable("Unexpected register size");
-
-  using v = std::vector<Value *>;
+  if (RegisterSize != 0)
+    RegisterType = Builder.getIntNTy(RegisterSize);
+
+  using v = OutputValues;
   switch (Opcode) {
   case PTC_INSTRUCTION_op_movi_i32:
   case PTC_INSTRUCTION_op_movi_i64:
@@ -1305,7 +1650,7 @@ IT::translateOpcode(PTCOpcode Opcode,
       unsigned LabelId = ptc.get_arg_label_id(ConstArguments[0]);
 
       std::stringstream LabelSS;
-      LabelSS << "bb." << JumpTargets.nameForAddress(LastPC);
+      LabelSS << JumpTargets.blockName(LastPC);
       LabelSS << "_L" << std::dec << LabelId;
       std::string Label = LabelSS.str();
 
@@ -1346,7 +1691,7 @@ IT::translateOpcode(PTCOpcode Opcode,
       unsigned LabelId = ptc.get_arg_label_id(ConstArguments.back());
 
       std::stringstream LabelSS;
-      LabelSS << "bb." << JumpTargets.nameForAddress(LastPC);
+      LabelSS << JumpTargets.blockName(LastPC);
       LabelSS << "_L" << std::dec << LabelId;
       std::string Label = LabelSS.str();
 
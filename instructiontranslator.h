@@ -11,6 +11,10 @@
 #include <vector>
 
 // LLVM includes
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/ErrorOr.h"
@@ -122,13 +126,56 @@ public:
   /// Check if the translated code contains a delay slot and return a blacklist
   /// of the PTC_INSTRUCTION_op_debug_insn_start instructions that have to be
   /// ignored to merge the delay slot into the branch instruction.
+  ///
+  /// The blacklist also contains the instructions found to be useless by the
+  /// peephole optimizations performed on the PTC (see peephole).
   llvm::SmallSet<unsigned, 1> preprocess(PTCInstructionList *Instructions);
 
 private:
-  llvm::ErrorOr<std::vector<llvm::Value *>>
+  /// \brief Value of a temporary known before its translation
+  struct KnownValue {
+    enum KindType {
+      Temporary, ///< The value is a copy of another temporary
+      Constant ///< The value is a constant
+    };
+
+    KindType Kind;
+    uint64_t Value; ///< The temporary identifier or the constant
+    unsigned Size; ///< Size, in bits, of the temporary being replaced
+  };
+
+  /// \brief Perform copy and constant propagation and dead code elimination
+  ///        on the PTC
+  ///
+  /// Copy and constant propagation are performed within the boundaries of a
+  /// single input instruction, since each input instruction is a potential
+  /// jump target. The input arguments that can be replaced are recorded in
+  /// KnownArguments. Dead code elimination removes side effect-free
+  /// instructions whose results, temporaries or CSVs, are overwritten before
+  /// being read in a straight line sequence of PTC instructions.
+  ///
+  /// \param Instructions the instruction list to optimize.
+  /// \param Dead set where the index of the useless instructions is recorded.
+  void peephole(PTCInstructionList *Instructions,
+                llvm::SmallSet<unsigned, 1> &Dead);
+
+  /// \brief Values produced by the translation of a PTC instruction
+  using OutputValues = llvm::SmallVector<llvm::Value *, 2>;
+
+  /// \brief Dispatch \p Opcode to the translateSizedOpcode specialization
+  ///        for its register size
+  llvm::ErrorOr<OutputValues>
   translateOpcode(PTCOpcode Opcode,
-                  std::vector<uint64_t> ConstArguments,
-                  std::vector<llvm::Value *> InArguments);
+                  llvm::ArrayRef<uint64_t> ConstArguments,
+                  llvm::ArrayRef<llvm::Value *> InArguments);
+
+  /// \brief Translate an opcode operating on registers of \p RegisterSize
+  ///        bits (0 if the opcode does not operate on registers)
+  template<unsigned RegisterSize>
+  llvm::ErrorOr<OutputValues>
+  translateSizedOpcode(PTCOpcode Opcode,
+                       llvm::ArrayRef<uint64_t> ConstArguments,
+                       llvm::ArrayRef<llvm::Value *> InArguments);
 private:
   llvm::IRBuilder<>& Builder;
   VariableManager& Variables;
@@ -145,6 +192,16 @@ private:
   llvm::Function *NewPCMarker;
 
   uint64_t LastPC;
+
+  /// Input arguments of the current PTC translation to replace, identified by
+  /// instruction and argument index
+  llvm::DenseMap<std::pair<PTCInstruction *, unsigned>,
+                 KnownValue> KnownArguments;
+
+  /// Working sets of peephole, kept here to reuse their storage: the known
+  /// values of the temporaries and the temporaries certainly overwritten
+  llvm::DenseMap<uint64_t, KnownValue> KnownTemporaries;
+  llvm::DenseSet<uint64_t> OverwrittenTemporaries;
 };
 
 #endif // _INSTRUCTIONTRANSLATOR_H
@@ -11,6 +11,8 @@
 #include <sstream>
 
 // LLVM includes
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Analysis/ConstantFolding.h"
 #include "llvm/Analysis/Interval.h"
@@ -98,6 +100,133 @@ static inline uint64_t getLimitedValue(const llvm::Value *V) {
   return llvm::cast<llvm::ConstantInt>(V)->getLimitedValue();
 }
 
+/// \brief Fold the integer binary operation \p Opcode on \p LHS and \p RHS
+///
+/// Unlike `ConstantFoldInstOperands`, this function doesn't create any
+/// `Constant`, which would be uniqued (and kept alive) by the `LLVMContext`.
+/// Use it for speculative computations whose results do not end up in the IR.
+///
+/// \return the result of the operation, or nothing if \p Opcode is not
+///         supported or the result is undefined (e.g., a division by zero).
+static inline llvm::Optional<llvm::APInt>
+foldBinaryOperator(unsigned Opcode,
+                   const llvm::APInt &LHS,
+                   const llvm::APInt &RHS) {
+  using I = llvm::Instruction;
+  using Result = llvm::Optional<llvm::APInt>;
+  assert(LHS.getBitWidth() == RHS.getBitWidth());
+  unsigned Width = LHS.getBitWidth();
+
+  switch (Opcode) {
+  case I::Add:
+    return LHS + RHS;
+  case I::Sub:
+    return LHS - RHS;
+  case I::Mul:
+    return LHS * RHS;
+  case I::And:
+    return LHS & RHS;
+  case I::Or:
+    return LHS | RHS;
+  case I::Xor:
+    return LHS ^ RHS;
+  case I::UDiv:
+  case I::URem:
+  case I::SDiv:
+  case I::SRem:
+    if (RHS == 0)
+      return Result();
+
+    if (Opcode == I::UDiv)
+      return LHS.udiv(RHS);
+    else if (Opcode == I::URem)
+      return LHS.urem(RHS);
+
+    // MIN_INT / -1 overflows
+    if (LHS.isMinSignedValue() && RHS.isAllOnesValue())
+      return Result();
+
+    if (Opcode == I::SDiv)
+      return LHS.sdiv(RHS);
+    else
+      return LHS.srem(RHS);
+  case I::Shl:
+  case I::LShr:
+  case I::AShr:
+    {
+      // Shifting by more than the width of the operand is undefined
+      uint64_t Amount = RHS.getLimitedValue();
+      if (Amount >= Width)
+        return Result();
+
+      if (Opcode == I::Shl)
+        return LHS.shl(Amount);
+      else if (Opcode == I::LShr)
+        return LHS.lshr(Amount);
+      else
+        return LHS.ashr(Amount);
+    }
+  default:
+    return Result();
+  }
+}
+
+/// \brief Fold the integer cast \p Opcode of \p Value to \p Width bits
+///
+/// Pointers are treated as integers of the appropriate size.
+///
+/// \return the result of the cast, or nothing if \p Opcode is not supported.
+static inline llvm::Optional<llvm::APInt> foldCast(unsigned Opcode,
+                                                   const llvm::APInt &Value,
+                                                   unsigned Width) {
+  using I = llvm::Instruction;
+
+  switch (Opcode) {
+  case I::Trunc:
+  case I::ZExt:
+  case I::BitCast:
+  case I::IntToPtr:
+  case I::PtrToInt:
+    return Value.zextOrTrunc(Width);
+  case I::SExt:
+    return Value.sextOrTrunc(Width);
+  default:
+    return llvm::Optional<llvm::APInt>();
+  }
+}
+
+/// \brief Evaluate the integer comparison \p Predicate on \p LHS and \p RHS
+static inline bool compareIntegers(unsigned Predicate,
+                                   const llvm::APInt &LHS,
+                                   const llvm::APInt &RHS) {
+  using CI = llvm::CmpInst;
+
+  switch (Predicate) {
+  case CI::ICMP_EQ:
+    return LHS.eq(RHS);
+  case CI::ICMP_NE:
+    return LHS.ne(RHS);
+  case CI::ICMP_UGT:
+    return LHS.ugt(RHS);
+  case CI::ICMP_UGE:
+    return LHS.uge(RHS);
+  case CI::ICMP_ULT:
+    return LHS.ult(RHS);
+  case CI::ICMP_ULE:
+    return LHS.ule(RHS);
+  case CI::ICMP_SGT:
+    return LHS.sgt(RHS);
+  case CI::ICMP_SGE:
+    return LHS.sge(RHS);
+  case CI::ICMP_SLT:
+    return LHS.slt(RHS);
+  case CI::ICMP_SLE:
+    return LHS.sle(RHS);
+  default:
+    llvm_unreachable("Unexpected comparison predicate");
+  }
+}
+
 static inline llvm::iterator_range<llvm::Interval::pred_iterator>
 predecessors(llvm::Interval *BB) {
   return make_range(pred_begin(BB), pred_end(BB));
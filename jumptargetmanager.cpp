@@ -8,11 +8,16 @@
 //
 
 // Standard includes
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <fstream>
 #include <queue>
 #include <sstream>
+#include <tuple>
+#include <vector>
+#include <sys/resource.h>
 
 // Boost includes
 #include <boost/icl/interval_set.hpp>
@@ -22,7 +27,7 @@
 // LLVM includes
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/PostOrderIterator.h"
-#include "llvm/IR/Dominators.h"
+#include "llvm/ADT/Twine.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LegacyPassManager.h"
@@ -34,6 +39,7 @@
 // Local includes
 #include "datastructures.h"
 #include "debug.h"
+#include "foldreadonlyloads.h"
 #include "generatedcodebasicinfo.h"
 #include "ir-helpers.h"
 #include "jumptargetmanager.h"
@@ -55,7 +61,6 @@ static RegisterPass<TranslateDirectBranchesPass> X("translate-db",
                                                    false);
 
 void TranslateDirectBranchesPass::getAnalysisUsage(AnalysisUsage &AU) const {
-  AU.addRequired<DominatorTreeWrapperPass>();
   AU.addUsedIfAvailable<SETPass>();
   AU.setPreservesAll();
 }
@@ -85,6 +90,14 @@ bool TranslateDirectBranchesPass::pinJTs(Function &F) {
   Value *PCReg = JTM->pcReg();
   auto *RegType = cast<IntegerType>(PCReg->getType()->getPointerElementType());
   auto C = [RegType] (uint64_t A) { return ConstantInt::get(RegType, A); };
+
+  // Destinations leaving the region to translate go to the region exit
+  auto Target = [this] (uint64_t PC) {
+    if (!JTM->isInTranslationRegion(PC))
+      return JTM->regionExit();
+    return JTM->getBlockAt(PC);
+  };
+
   BasicBlock *AnyPC = JTM->anyPC();
   BasicBlock *UnexpectedPC = JTM->unexpectedPC();
   // TODO: enforce CFG
@@ -124,13 +137,11 @@ bool TranslateDirectBranchesPass::pinJTs(Function &F) {
     auto PCLoad = Builder.CreateLoad(PCReg);
     if (Destinations.size() == 1) {
       auto *Comparison = Builder.CreateICmpEQ(C(Destinations[0]), PCLoad);
-      Builder.CreateCondBr(Comparison,
-                           JTM->getBlockAt(Destinations[0]),
-                           FailBB);
+      Builder.CreateCondBr(Comparison, Target(Destinations[0]), FailBB);
     } else {
       auto *Switch = Builder.CreateSwitch(PCLoad, FailBB, Destinations.size());
       for (uint64_t Destination : Destinations)
-        Switch->addCase(C(Destination), JTM->getBlockAt(Destination));
+        Switch->addCase(C(Destination), Target(Destination));
     }
 
     // Notify new branches only if the amount of possible targets actually
@@ -168,8 +179,9 @@ bool TranslateDirectBranchesPass::pinConstantStore(Function &F) {
           if (Address != nullptr) {
             // Compute the actual PC and get the associated BasicBlock
             uint64_t TargetPC = Address->getSExtValue();
-            auto *TargetBlock = JTM->registerJT(TargetPC,
-                                                JumpTargetManager::DirectJump);
+            // Jumps leaving the region to translate go to the region exit
+            auto Reason = JumpTargetManager::DirectJump;
+            auto *TargetBlock = JTM->registerJTOrExit(TargetPC, Reason);
 
             // Remove unreachable right after the exit_tb
             BasicBlock::iterator CallIt(Call);
@@ -264,7 +276,8 @@ bool TranslateDirectBranchesPass::forceFallthroughAfterHelper(CallInst *Call) {
   Value *NextPCConst = Builder.getIntN(PCRegTy->getIntegerBitWidth(), NextPC);
   Builder.CreateCondBr(Builder.CreateICmpEQ(Builder.CreateLoad(PCReg),
                                             NextPCConst),
-                       JTM->registerJT(NextPC, JumpTargetManager::PostHelper),
+                       JTM->registerJTOrExit(NextPC,
+                                             JumpTargetManager::PostHelper),
                        JTM->anyPC());
 
   return true;
@@ -276,41 +289,6 @@ bool TranslateDirectBranchesPass::runOnFunction(Function &F) {
   return true;
 }
 
-uint64_t TranslateDirectBranchesPass::getNextPC(Instruction *TheInstruction) {
-  DominatorTree& DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
-
-  BasicBlock *Block = TheInstruction->getParent();
-  BasicBlock::reverse_iterator It(make_reverse_iterator(TheInstruction));
-
-  while (true) {
-    BasicBlock::reverse_iterator Begin(Block->rend());
-
-    // Go back towards the beginning of the basic block looking for a call to
-    // newpc
-    CallInst *Marker = nullptr;
-    for (; It != Begin; It++) {
-      if ((Marker = dyn_cast<CallInst>(&*It))) {
-        // TODO: comparing strings is not very elegant
-        if (Marker->getCalledFunction()->getName() == "newpc") {
-          uint64_t PC = getLimitedValue(Marker->getArgOperand(0));
-          uint64_t Size = getLimitedValue(Marker->getArgOperand(1));
-          assert(Size != 0);
-          return PC + Size;
-        }
-      }
-    }
-
-    auto *Node = DT.getNode(Block);
-    assert(Node != nullptr &&
-           "BasicBlock not in the dominator tree, is it reachable?" );
-
-    Block = Node->getIDom()->getBlock();
-    It = Block->rbegin();
-  }
-
-  llvm_unreachable("Can't find the PC marker");
-}
-
 Optional<uint64_t>
 JumpTargetManager::readRawValue(uint64_t Address,
                                 unsigned Size,
@@ -363,19 +341,6 @@ JumpTargetManager::readRawValue(uint64_t Address,
   return Optional<uint64_t>();
 }
 
-Constant *JumpTargetManager::readConstantPointer(Constant *Address,
-                                                 Type *PointerTy,
-                                                 Endianess ReadEndianess) {
-  auto *Value = readConstantInt(Address,
-                                Binary.architecture().pointerSize() / 8,
-                                ReadEndianess);
-  if (Value != nullptr) {
-    return ConstantExpr::getIntToPtr(Value, PointerTy);
-  } else {
-    return nullptr;
-  }
-}
-
 ConstantInt *JumpTargetManager::readConstantInt(Constant *ConstantAddress,
                                                 unsigned Size,
                                                 Endianess ReadEndianess) {
@@ -389,10 +354,7 @@ ConstantInt *JumpTargetManager::readConstantInt(Constant *ConstantAddress,
   }
 
   uint64_t Address = getZExtValue(ConstantAddress, DL);
-  UnusedCodePointers.erase(Address);
-  registerReadRange(Address, Size);
-
-  auto Result = readRawValue(Address, Size, ReadEndianess);
+  auto Result = readInteger(Address, Size, ReadEndianess);
 
   if (Result.hasValue())
     return ConstantInt::get(IntegerType::get(Context, Size * 8),
@@ -401,6 +363,15 @@ ConstantInt *JumpTargetManager::readConstantInt(Constant *ConstantAddress,
     return nullptr;
 }
 
+Optional<uint64_t> JumpTargetManager::readInteger(uint64_t Address,
+                                                  unsigned Size,
+                                                  Endianess ReadEndianess) {
+  UnusedCodePointers.erase(Address);
+  registerReadRange(Address, Size);
+
+  return readRawValue(Address, Size, ReadEndianess);
+}
+
 template<typename T>
 static cl::opt<T> *getOption(StringMap<cl::Option *>& Options,
                              const char *Name) {
@@ -410,7 +381,9 @@ static cl::opt<T> *getOption(StringMap<cl::Option *>& Options,
 JumpTargetManager::JumpTargetManager(Function *TheFunction,
                                      Value *PCReg,
                                      const BinaryFile &Binary,
-                                     bool EnableOSRA) :
+                                     bool EnableOSRA,
+                                     bool SplitInPlace,
+                                     bool DebugNames) :
   TheModule(*TheFunction->getParent()),
   Context(TheModule.getContext()),
   TheFunction(TheFunction),
@@ -420,20 +393,25 @@ JumpTargetManager::JumpTargetManager(Function *TheFunction,
   ExitTB(nullptr),
   Dispatcher(nullptr),
   DispatcherSwitch(nullptr),
+  RegionExit(nullptr),
   Binary(Binary),
   EnableOSRA(EnableOSRA),
+  SplitInPlace(SplitInPlace),
   NoReturn(Binary.architecture()),
-  CurrentCFGForm(UnknownFormCFG) {
+  DebugNames(DebugNames) {
   FunctionType *ExitTBTy = FunctionType::get(Type::getVoidTy(Context),
                                              { Type::getInt32Ty(Context) },
                                              false);
   ExitTB = cast<Function>(TheModule.getOrInsertFunction("exitTB", ExitTBTy));
   createDispatcher(TheFunction, PCReg, true);
+  ExplorationStart = std::chrono::steady_clock::now();
 
   for (auto &Segment : Binary.segments())
     Segment.insertExecutableRanges(std::back_inserter(ExecutableRanges));
 
-  initializeSymbolMap();
+  // Symbols are only needed to name the basic blocks
+  if (DebugNames)
+    initializeSymbolMap();
 
   // Configure GlobalValueNumbering
   StringMap<cl::Option *>& Options(cl::getRegisteredOptions());
@@ -444,54 +422,103 @@ JumpTargetManager::JumpTargetManager(Function *TheFunction,
 }
 
 void JumpTargetManager::initializeSymbolMap() {
-  // Collect how many times each name is used
-  std::map<std::string, unsigned> SeenCount;
-  for (const SymbolInfo &Symbol : Binary.symbols())
-    SeenCount[std::string(Symbol.Name)]++;
+  const std::vector<SymbolInfo> &Symbols = Binary.symbols();
+
+  // Identify the names used more than once by sorting the symbols by name
+  std::vector<const SymbolInfo *> ByName;
+  ByName.reserve(Symbols.size());
+  for (const SymbolInfo &Symbol : Symbols)
+    ByName.push_back(&Symbol);
+
+  std::sort(ByName.begin(),
+            ByName.end(),
+            [] (const SymbolInfo *A, const SymbolInfo *B) {
+              return A->Name < B->Name;
+            });
+
+  std::set<const SymbolInfo *> Duplicated;
+  for (unsigned I = 1; I < ByName.size(); I++) {
+    if (ByName[I - 1]->Name == ByName[I]->Name) {
+      Duplicated.insert(ByName[I - 1]);
+      Duplicated.insert(ByName[I]);
+    }
+  }
+  freeContainer(ByName);
+
+  // Each symbol starts and ends an interval, collect these events sorted by
+  // address. Symbols are identified by their index in Symbols.
+  using Event = std::tuple<uint64_t, bool, unsigned>;
+  std::vector<Event> Events;
+  for (unsigned I = 0; I < Symbols.size(); I++) {
+    const SymbolInfo &Symbol = Symbols[I];
 
-  for (const SymbolInfo &Symbol : Binary.symbols()) {
     // Discard symbols pointing to 0, with zero-sized names or present multiple
     // times. Note that we keep zero-size symbols.
     if (Symbol.Address == 0
         || Symbol.Name.size() == 0
-        || SeenCount[std::string(Symbol.Name)] > 1)
+        || Duplicated.count(&Symbol) != 0)
       continue;
 
-    // Associate to this interval the symbol
-    unsigned Size = std::max(1UL, Symbol.Size);
-    auto NewInterval = interval::right_open(Symbol.Address,
-                                            Symbol.Address + Size);
-    SymbolMap += make_pair(NewInterval, SymbolInfoSet { &Symbol });
+    uint64_t Size = std::max(1UL, Symbol.Size);
+    Events.push_back(Event { Symbol.Address, true, I });
+    Events.push_back(Event { Symbol.Address + Size, false, I });
+  }
+  std::sort(Events.begin(), Events.end());
+
+  // Sweep the events keeping track of the symbols covering the current
+  // address, the closest one is the one starting last. Where no symbol is
+  // active, the last one is retained.
+  std::set<std::pair<uint64_t, unsigned>> Active;
+  auto It = Events.begin();
+  while (It != Events.end()) {
+    uint64_t Address = std::get<0>(*It);
+    for (; It != Events.end() && std::get<0>(*It) == Address; It++) {
+      const SymbolInfo &Symbol = Symbols[std::get<2>(*It)];
+      if (std::get<1>(*It))
+        Active.insert({ Symbol.Address, std::get<2>(*It) });
+      else
+        Active.erase({ Symbol.Address, std::get<2>(*It) });
+    }
+
+    if (Active.empty())
+      continue;
+
+    const SymbolInfo *Closest = &Symbols[Active.rbegin()->second];
+    if (SymbolMap.empty() || SymbolMap.back().second != Closest)
+      SymbolMap.push_back({ Address, Closest });
   }
 }
 
 // TODO: move this in BinaryFile?
 std::string JumpTargetManager::nameForAddress(uint64_t Address) const {
-  std::stringstream Result;
-
-  // Take the interval greater than [Address, Address + 1[
-  auto It = SymbolMap.upper_bound(interval::right_open(Address, Address + 1));
-  if (It != SymbolMap.begin()) {
-    // Go back one position
-    It--;
-
-    // In case we have multiple matching symbols, take the closest one
-    const SymbolInfoSet &Matching = It->second;
-    auto MaxIt = std::max_element(Matching.begin(), Matching.end());
-    const SymbolInfo *const BestMatch = *MaxIt;
-
-    // Use the symbol name
-    Result << BestMatch->Name.str();
-
-    // And, if necessary, an offset
-    if (Address != BestMatch->Address)
-      Result << ".0x" << std::hex << (Address - BestMatch->Address);
-  } else {
-    // We don't have a symbol to use, just return the address
-    Result << "0x" << std::hex << Address;
-  }
+  // Find the last entry starting at or before Address
+  auto Compare = [] (uint64_t Address,
+                     const std::pair<uint64_t, const SymbolInfo *> &Entry) {
+    return Address < Entry.first;
+  };
+  auto It = std::upper_bound(SymbolMap.begin(),
+                             SymbolMap.end(),
+                             Address,
+                             Compare);
+
+  // We don't have a symbol to use, just return the address
+  if (It == SymbolMap.begin())
+    return ("0x" + Twine::utohexstr(Address)).str();
+
+  // Use the symbol name and, if necessary, an offset
+  const SymbolInfo *BestMatch = (--It)->second;
+  if (Address == BestMatch->Address)
+    return BestMatch->Name.str();
+
+  uint64_t Offset = Address - BestMatch->Address;
+  return (BestMatch->Name + ".0x" + Twine::utohexstr(Offset)).str();
+}
 
-  return Result.str();
+std::string JumpTargetManager::blockName(uint64_t PC) const {
+  if (DebugNames)
+    return "bb." + nameForAddress(PC);
+  else
+    return ("bb.0x" + Twine::utohexstr(PC)).str();
 }
 
 void JumpTargetManager::harvestGlobalData() {
@@ -617,7 +644,7 @@ CallInst *JumpTargetManager::findNextExitTB(Instruction *Start) {
                   [this,&Result] (BasicBlockRange Range) {
       for (Instruction &I : Range) {
         if (auto *Call = dyn_cast<CallInst>(&I)) {
-          assert(!(Call->getCalledFunction()->getName() == "newpc"));
+          assert(!isNewPC(Call));
           if (Call->getCalledFunction() == ExitTB) {
             assert(Result == nullptr);
             Result = Call;
@@ -742,77 +769,17 @@ static bool isSumJump(StoreInst *PCWrite) {
   return false;
 }
 
-std::pair<uint64_t, uint64_t>
-JumpTargetManager::getPC(Instruction *TheInstruction) const {
-  CallInst *NewPCCall = nullptr;
-  std::set<BasicBlock *> Visited;
-  std::queue<BasicBlock::reverse_iterator> WorkList;
-  if (TheInstruction->getIterator() == TheInstruction->getParent()->begin())
-    WorkList.push(--TheInstruction->getParent()->rend());
-  else
-    WorkList.push(make_reverse_iterator(TheInstruction));
-
-  while (!WorkList.empty()) {
-    auto I = WorkList.front();
-    WorkList.pop();
-    auto *BB = I->getParent();
-    auto End = BB->rend();
-
-    // Go through the instructions looking for calls to newpc
-    for (; I != End; I++) {
-      if (auto Marker = dyn_cast<CallInst>(&*I)) {
-        // TODO: comparing strings is not very elegant
-        auto *Callee = Marker->getCalledFunction();
-        if (Callee != nullptr && Callee->getName() == "newpc") {
-
-          // We found two distinct newpc leading to the requested instruction
-          if (NewPCCall != nullptr)
-            return { 0, 0 };
-
-          NewPCCall = Marker;
-          break;
-        }
-      }
-    }
-
-    // If we haven't find a newpc call yet, continue exploration backward
-    if (NewPCCall == nullptr) {
-      // If one of the predecessors is the dispatcher, don't explore any further
-      for (BasicBlock *Predecessor : predecessors(BB)) {
-        // Assert we didn't reach the almighty dispatcher
-        assert(!(NewPCCall == nullptr && Predecessor == Dispatcher));
-        if (Predecessor == Dispatcher)
-          continue;
-      }
-
-      for (BasicBlock *Predecessor : predecessors(BB)) {
-        // Ignore already visited or empty BBs
-        if (!Predecessor->empty()
-            && Visited.find(Predecessor) == Visited.end()) {
-          WorkList.push(Predecessor->rbegin());
-          Visited.insert(Predecessor);
-        }
-      }
-    }
-
-  }
-
-  // Couldn't find the current PC
-  if (NewPCCall == nullptr)
-    return { 0, 0 };
-
-  uint64_t PC = getLimitedValue(NewPCCall->getArgOperand(0));
-  uint64_t Size = getLimitedValue(NewPCCall->getArgOperand(1));
-  assert(Size != 0);
-  return { PC, Size };
-}
-
 void JumpTargetManager::handleSumJump(Instruction *SumJump) {
   // Take the next PC
   uint64_t NextPC = getNextPC(SumJump);
   assert(NextPC != 0);
   BasicBlock *BB = registerJT(NextPC, JumpTargetManager::SumJump);
-  assert(BB && !BB->empty());
+
+  // The next PC might be outside the region to translate
+  if (BB == nullptr)
+    return;
+
+  assert(!BB->empty());
 
   std::set<BasicBlock *> Visited;
   Visited.insert(Dispatcher);
@@ -828,9 +795,7 @@ void JumpTargetManager::handleSumJump(Instruction *SumJump) {
     while (I != End) {
       // Is it a new PC marker?
       if (auto *Call = dyn_cast<CallInst>(&*I)) {
-        Function *Callee = Call->getCalledFunction();
-        // TODO: comparing strings is not very elegant
-        if (Callee != nullptr && Callee->getName() == "newpc") {
+        if (isNewPC(Call)) {
           uint64_t PC = getLimitedValue(Call->getArgOperand(0));
 
           // If we've found a (direct or indirect) jump, stop
@@ -968,11 +933,42 @@ void JumpTargetManager::translateIndirectJumps() {
 JumpTargetManager::BlockWithAddress JumpTargetManager::peek() {
   harvest();
 
+  // Out of budget, harvest didn't run any analysis round on the code translated
+  // since the last one. Translate at least its direct branches, no constant
+  // write to the PC must reach translateIndirectJumps. This has to happen
+  // before purging, since it can register jump targets in the middle of
+  // already translated blocks. Its new jump targets are abandoned below.
+  bool OutOfBudget = budgetExceeded();
+  if (OutOfBudget) {
+    legacy::PassManager PM;
+    PM.add(new TranslateDirectBranchesPass(this));
+    PM.run(TheModule);
+  }
+
   // Purge all the partial translations we know might be wrong
-  for (BasicBlock *BB : ToPurge)
-    purgeTranslation(BB);
+  for (BasicBlock *BB : ToPurge) {
+    if (SplitInPlace && canSplitInPlace(BB)) {
+      // The existing translation is fine, no need to explore BB again
+      auto IsBB = [BB] (const BlockWithAddress &Entry) {
+        return Entry.second == BB;
+      };
+      Unexplored.erase(std::remove_if(Unexplored.begin(),
+                                      Unexplored.end(),
+                                      IsBB),
+                       Unexplored.end());
+      SplitInPlaceCount++;
+    } else {
+      purgeTranslation(BB);
+    }
+  }
   ToPurge.clear();
 
+  // Out of budget, stop here with what we have
+  if (OutOfBudget) {
+    abandonUnexplored();
+    markJumpTargets();
+  }
+
   if (Unexplored.empty())
     return NoMoreTargets;
   else {
@@ -996,11 +992,8 @@ void JumpTargetManager::unvisit(BasicBlock *BB) {
       for (BasicBlock *Successor : successors(BB)) {
         if (Visited.find(Successor) != Visited.end()
             && !Successor->empty()) {
-          auto *Call = dyn_cast<CallInst>(&*Successor->begin());
-          if (Call == nullptr
-              || Call->getCalledFunction()->getName() != "newpc") {
+          if (!isNewPC(&*Successor->begin()))
             WorkList.push_back(Successor);
-          }
         }
       }
     }
@@ -1013,7 +1006,8 @@ BasicBlock *JumpTargetManager::getBlockAt(uint64_t PC) {
   return TargetIt->second.head();
 }
 
-void JumpTargetManager::purgeTranslation(BasicBlock *Start) {
+std::set<BasicBlock *>
+JumpTargetManager::translationRegion(BasicBlock *Start) {
   OnceQueue<BasicBlock *> Queue;
   Queue.insert(Start);
 
@@ -1029,16 +1023,84 @@ void JumpTargetManager::purgeTranslation(BasicBlock *Start) {
     }
   }
 
+  return Queue.visited();
+}
+
+bool JumpTargetManager::canSplitInPlace(BasicBlock *Start) {
+  std::set<BasicBlock *> Region = translationRegion(Start);
+  BasicBlock *Entry = &TheFunction->getEntryBlock();
+
+  // Allocas and the casts capturing them live in the entry block and dominate
+  // everything
+  auto IsOutside = [&Region, Entry] (Value *V) {
+    auto *I = dyn_cast<Instruction>(V);
+    return I != nullptr
+      && I->getParent() != Entry
+      && Region.count(I->getParent()) == 0;
+  };
+
+  for (BasicBlock *BB : Region) {
+    // The only way into the region must be through Start, ignoring dead blocks
+    if (BB != Start)
+      for (BasicBlock *Predecessor : predecessors(BB))
+        if (Region.count(Predecessor) == 0
+            && (Predecessor == Entry || !pred_empty(Predecessor)))
+          return false;
+
+    for (Instruction &I : *BB) {
+      for (Value *Operand : I.operands())
+        if (IsOutside(Operand))
+          return false;
+
+      // The newpc capture preserves local temporaries across the split point,
+      // but the translation must not depend on what was stored before it
+      auto *Load = dyn_cast<LoadInst>(&I);
+      if (Load == nullptr)
+        continue;
+
+      Value *Pointer = Load->getPointerOperand()->stripPointerCasts();
+      auto *Local = dyn_cast<AllocaInst>(Pointer);
+      if (Local == nullptr)
+        continue;
+
+      for (User *U : Local->users()) {
+        std::vector<User *> Accesses = { U };
+        if (isa<CastInst>(U))
+          Accesses.insert(Accesses.end(), U->user_begin(), U->user_end());
+
+        for (User *Access : Accesses)
+          if (isa<StoreInst>(Access) && IsOutside(Access))
+            return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void JumpTargetManager::purgeTranslation(BasicBlock *Start) {
+  // We're about to erase basic blocks and calls to newpc
+  PCs.invalidate();
+
   // Erase all the visited basic blocks
-  std::set<BasicBlock *> Visited = Queue.visited();
+  std::set<BasicBlock *> Visited = translationRegion(Start);
 
   // Build a subgraph, so that we can visit it in post order, and purge the
   // content of each basic block
   SubGraph<BasicBlock *> TranslatedBBs(Start, Visited);
   for (auto *Node : post_order(TranslatedBBs)) {
     BasicBlock *BB = Node->get();
-    while (!BB->empty())
-      eraseInstruction(&*(--BB->end()));
+    while (!BB->empty()) {
+      Instruction *Last = &*(--BB->end());
+
+      // Keep track of the size of the instructions we'll translate again
+      if (getPCFromNewPCCall(Last) != 0) {
+        auto *Call = cast<CallInst>(Last);
+        RetranslatedBytes += getLimitedValue(Call->getArgOperand(1));
+      }
+
+      eraseInstruction(Last);
+    }
   }
 
   // Remove Start, since we want to keep it (even if empty)
@@ -1060,7 +1122,9 @@ void JumpTargetManager::purgeTranslation(BasicBlock *Start) {
 
 // TODO: register Reason
 BasicBlock *JumpTargetManager::registerJT(uint64_t PC, JTReason Reason) {
-  if (!isExecutableAddress(PC) || !isInstructionAligned(PC))
+  if (!isExecutableAddress(PC)
+      || !isInstructionAligned(PC)
+      || !isInTranslationRegion(PC))
     return nullptr;
 
   // Do we already have a BasicBlock for this PC?
@@ -1087,12 +1151,16 @@ BasicBlock *JumpTargetManager::registerJT(uint64_t PC, JTReason Reason) {
     } else {
       assert(I != nullptr && I != ContainingBlock->end());
       NewBlock = ContainingBlock->splitBasicBlock(I);
+      PCs.splitBlock(ContainingBlock, NewBlock);
+
+      // The analyses might be looking at the CFG right now
+      if (CFGView *View = CFGView::current())
+        View->invalidate();
     }
 
     // Register the basic block and all of its descendants to be purged so that
-    // we can retranslate this PC
-    // TODO: this might create a problem if QEMU generates control flow that
-    //       crosses an instruction boundary
+    // we can retranslate this PC. In split-in-place mode, peek will keep the
+    // existing translation, if possible.
     ToPurge.insert(NewBlock);
 
     unvisit(NewBlock);
@@ -1104,11 +1172,8 @@ BasicBlock *JumpTargetManager::registerJT(uint64_t PC, JTReason Reason) {
 
   Unexplored.push_back(BlockWithAddress(PC, NewBlock));
 
-  if (NewBlock->getName().empty()) {
-    std::stringstream Name;
-    Name << "bb." << nameForAddress(PC);
-    NewBlock->setName(Name.str());
-  }
+  if (NewBlock->getName().empty())
+    NewBlock->setName(blockName(PC));
 
   // Create a case for the address associated to the new block
   auto *PCRegType = PCReg->getType();
@@ -1163,45 +1228,53 @@ void JumpTargetManager::createDispatcher(Function *OutputFunction,
   Dispatcher = Entry;
   DispatcherSwitch = Switch;
   NoReturn.setDispatcher(Dispatcher);
+  PCs.setDispatcher(Dispatcher);
 
   // Create basic blocks to handle jumps to any PC and to a PC we didn't expect
   AnyPC = BasicBlock::Create(Context, "anypc", OutputFunction);
   UnexpectedPC = BasicBlock::Create(Context, "unexpectedpc", OutputFunction);
 
-  setCFGForm(SemanticPreservingCFG);
-}
+  // Jumps to any PC and to an unexpected PC go through the dispatcher, the
+  // analyses get to ignore them through a CFGView
+  BranchInst::Create(dispatcher(), AnyPC);
+  // TODO: Here we should have an hard fail, since it's the situation in which
+  //       we expected to know where execution could go but we made a mistake.
+  BranchInst::Create(dispatcher(), UnexpectedPC);
 
-static void purge(BasicBlock *BB) {
-  // Allow up to a single instruction in the basic block
-  if (!BB->empty())
-    BB->begin()->eraseFromParent();
-  assert(BB->empty());
+  AnyPC->getTerminator()->setMetadata("revamb.block.type",
+                                      QMD.tuple(AnyPCBlock));
+  UnexpectedPC->getTerminator()->setMetadata("revamb.block.type",
+                                             QMD.tuple(UnexpectedPCBlock));
 }
 
-void JumpTargetManager::setCFGForm(CFGForm NewForm) {
-  assert(CurrentCFGForm != NewForm);
-  assert(NewForm != UnknownFormCFG);
+void JumpTargetManager::restrictTranslation(RangesVector Region) {
+  assert(RegionExit == nullptr && !Region.empty());
+  TranslationRegion = std::move(Region);
+
+  // Direct jumps leaving the region land here, after having updated the PC,
+  // so that the user-provided `leftRegion` function can inspect it
+  RegionExit = BasicBlock::Create(Context, "region.exit", TheFunction);
+  IRBuilder<> Builder(RegionExit);
+  auto *LeftRegionTy = FunctionType::get(Type::getVoidTy(Context), { }, false);
+  Constant *LeftRegion = TheModule.getOrInsertFunction("leftRegion",
+                                                       LeftRegionTy);
+  Builder.CreateCall(cast<Function>(LeftRegion));
+  Builder.CreateUnreachable();
+}
 
-  CFGForm OldForm = CurrentCFGForm;
-  CurrentCFGForm = NewForm;
+CFGView::Form JumpTargetManager::viewForm(CFGForm Form) const {
+  CFGView::Form Result;
 
-  switch (NewForm) {
+  switch (Form) {
   case SemanticPreservingCFG:
-    purge(AnyPC);
-    BranchInst::Create(dispatcher(), AnyPC);
-    // TODO: Here we should have an hard fail, since it's the situation in
-    //       which we expected to know where execution could go but we made a
-    //       mistake.
-    purge(UnexpectedPC);
-    BranchInst::Create(dispatcher(), UnexpectedPC);
     break;
 
   case RecoveredOnlyCFG:
   case NoFunctionCallsCFG:
-    purge(AnyPC);
-    new UnreachableInst(Context, AnyPC);
-    purge(UnexpectedPC);
-    new UnreachableInst(Context, UnexpectedPC);
+    Result.Dispatcher = Dispatcher;
+    Result.AnyPC = AnyPC;
+    Result.UnexpectedPC = UnexpectedPC;
+    Result.NoFunctionCalls = Form == NoFunctionCallsCFG;
     break;
 
   default:
@@ -1209,58 +1282,79 @@ void JumpTargetManager::setCFGForm(CFGForm NewForm) {
     break;
   }
 
-  QuickMetadata QMD(Context);
-  AnyPC->getTerminator()->setMetadata("revamb.block.type",
-                                      QMD.tuple(AnyPCBlock));
-  UnexpectedPC->getTerminator()->setMetadata("revamb.block.type",
-                                             QMD.tuple(UnexpectedPCBlock));
+  return Result;
+}
 
-  // If we're entering or leaving the NoFunctionCallsCFG form, update all the
-  // branch instruction forming a function call
-  if (NewForm == NoFunctionCallsCFG || OldForm == NoFunctionCallsCFG) {
-    if (auto *FunctionCall = TheModule.getFunction("function_call")) {
-      for (User *U : FunctionCall->users()) {
-        auto *Call = cast<CallInst>(U);
-        auto *Terminator = cast<TerminatorInst>(Call->getNextNode());
-        assert(Terminator->getNumSuccessors() == 1);
-
-        // Get the correct argument, the first is the callee, the second the
-        // return basic block
-        Value *Op = Call->getArgOperand(NewForm == NoFunctionCallsCFG ? 1 : 0);
-        BasicBlock *NewSuccessor = cast<BlockAddress>(Op)->getBasicBlock();
-        Terminator->setSuccessor(0, NewSuccessor);
+void JumpTargetManager::markJumpTargets() {
+  // TODO: move me to a commit function
+  // Update the third argument of newpc calls (isJT, i.e., is this instruction
+  // a jump target?)
+  IRBuilder<> Builder(Context);
+  Function *NewPCFunction = PCs.newPCMarker();
+  if (NewPCFunction != nullptr) {
+    for (User *U : NewPCFunction->users()) {
+      auto *Call = cast<CallInst>(U);
+      if (Call->getParent() != nullptr) {
+        // Report the instruction on the coverage CSV
+        using CI = ConstantInt;
+        uint64_t PC = (cast<CI>(Call->getArgOperand(0)))->getLimitedValue();
+
+        bool IsJT = isJumpTarget(PC);
+        Call->setArgOperand(2, Builder.getInt32(static_cast<uint32_t>(IsJT)));
       }
     }
   }
-
-  rebuildDispatcher();
 }
 
-void JumpTargetManager::rebuildDispatcher() {
-  // Remove all cases
-  unsigned NumCases = DispatcherSwitch->getNumCases();
-  while (NumCases --> 0)
-    DispatcherSwitch->removeCase(DispatcherSwitch->case_begin());
-
-  auto *PCRegType = PCReg->getType()->getPointerElementType();
-  auto *SwitchType = cast<IntegerType>(PCRegType);
+bool JumpTargetManager::budgetExceeded() {
+  if (ExceededLimit != nullptr)
+    return true;
+
+  using namespace std::chrono;
+  auto Elapsed = steady_clock::now() - ExplorationStart;
+
+  if (Budget.MaxJumpTargets != 0
+      && JumpTargets.size() > Budget.MaxJumpTargets) {
+    ExceededLimit = "max-jump-targets";
+  } else if (Budget.MaxSeconds != 0
+             && duration_cast<seconds>(Elapsed).count() >= Budget.MaxSeconds) {
+    ExceededLimit = "max-time";
+  } else if (Budget.MaxRSS != 0) {
+    struct rusage Usage;
+    getrusage(RUSAGE_SELF, &Usage);
+    if (static_cast<uint64_t>(Usage.ru_maxrss) >= Budget.MaxRSS)
+      ExceededLimit = "max-rss";
+  }
 
-  // Add all the jump targets if we're using the SemanticPreservingCFG, or
-  // only those with no predecessors otherwise
-  for (auto &P : JumpTargets) {
-    uint64_t PC = P.first;
-    BasicBlock *BB = P.second.head();
-    if (CurrentCFGForm == SemanticPreservingCFG || !hasPredecessors(BB))
-      DispatcherSwitch->addCase(ConstantInt::get(SwitchType, PC), BB);
+  return ExceededLimit != nullptr;
+}
 
+bool JumpTargetManager::canRunAnalysisRound() {
+  if (Budget.MaxHarvestRounds != 0
+      && HarvestRounds >= Budget.MaxHarvestRounds) {
+    if (ExceededLimit == nullptr)
+      ExceededLimit = "max-harvest-rounds";
+    return false;
   }
+
+  return true;
 }
 
-bool JumpTargetManager::hasPredecessors(BasicBlock *BB) const {
-  for (BasicBlock *Pred : predecessors(BB))
-    if (isTranslatedBB(Pred))
-      return true;
-  return false;
+void JumpTargetManager::abandonUnexplored() {
+  // The abandoned jump targets are still reachable through the dispatcher and
+  // from direct jumps, handle them as unknown PCs
+  for (BlockWithAddress &Entry : Unexplored) {
+    BasicBlock *BB = Entry.second;
+    assert(BB->empty());
+    BranchInst::Create(DispatcherFail, BB);
+  }
+
+  DBG("jtcount", dbg << std::dec << Unexplored.size()
+                     << " jump targets abandoned, " << ExceededLimit
+                     << " exceeded\n");
+
+  AbandonedCount += Unexplored.size();
+  Unexplored.clear();
 }
 
 // Harvesting proceeds trying to avoid to run expensive analyses if not strictly
@@ -1271,55 +1365,42 @@ bool JumpTargetManager::hasPredecessors(BasicBlock *BB) const {
 // block to translate we proceed as long as we are able to create new edges on
 // the CFG (not considering the dispatcher).
 void JumpTargetManager::harvest() {
+  // New code has been translated since the last time, start from scratch
+  PCs.invalidate();
+
+  // Out of budget, peek will give up on what's left to explore
+  if (budgetExceeded())
+    return;
+
+  // Nothing left to translate and no more analysis rounds allowed, peek will
+  // give up on the code translated after the last one
+  if (empty() && !canRunAnalysisRound())
+    return;
+
   if (empty()) {
-    // TODO: move me to a commit function
-    // Update the third argument of newpc calls (isJT, i.e., is this instruction
-    // a jump target?)
-    IRBuilder<> Builder(Context);
-    Function *NewPCFunction = TheModule.getFunction("newpc");
-    if (NewPCFunction != nullptr) {
-      for (User *U : NewPCFunction->users()) {
-        auto *Call = cast<CallInst>(U);
-        if (Call->getParent() != nullptr) {
-          // Report the instruction on the coverage CSV
-          using CI = ConstantInt;
-          uint64_t PC = (cast<CI>(Call->getArgOperand(0)))->getLimitedValue();
-
-          bool IsJT = isJumpTarget(PC);
-          Call->setArgOperand(2, Builder.getInt32(static_cast<uint32_t>(IsJT)));
-        }
-      }
-    }
+    markJumpTargets();
 
     DBG("verify", if (verifyModule(TheModule, &dbgs())) { abort(); });
 
-    DBG("jtcount", dbg << "Harvesting: SROA, ConstProp, EarlyCSE and SET\n");
+    DBG("jtcount", dbg << "Harvesting: SROA, ConstProp, FoldReadOnlyLoads, "
+                       << "EarlyCSE and SET\n");
 
     legacy::PassManager OptimizingPM;
     OptimizingPM.add(createSROAPass());
     OptimizingPM.add(createConstantPropagationPass());
+    OptimizingPM.add(new FoldReadOnlyLoadsPass(this));
     OptimizingPM.add(createEarlyCSEPass());
     OptimizingPM.run(TheModule);
 
-    // To improve the quality of our analysis, keep in the CFG only the edges we
-    // where able to recover (e.g., no jumps to the dispatcher)
-    setCFGForm(RecoveredOnlyCFG);
-
     NewBranches = 0;
-    legacy::PassManager AnalysisPM;
-    AnalysisPM.add(new SETPass(this, false, &Visited));
-    AnalysisPM.add(new TranslateDirectBranchesPass(this));
-    AnalysisPM.run(TheModule);
-
-    // Restore the CFG
-    setCFGForm(SemanticPreservingCFG);
+    runAnalysisRound(false);
 
     DBG("jtcount", dbg << std::dec
                        << Unexplored.size() << " new jump targets and "
                        << NewBranches << " new branches were found\n");
   }
 
-  if (EnableOSRA && empty()) {
+  if (EnableOSRA && empty() && canRunAnalysisRound()) {
     DBG("verify", if (verifyModule(TheModule, &dbgs())) { abort(); });
 
     NoReturn.registerSyscalls(TheFunction);
@@ -1328,7 +1409,8 @@ void JumpTargetManager::harvest() {
 
       DBG("jtcount",
           dbg << "Harvesting: reset Visited, "
-              << (NewBranches > 0 ? "SROA, ConstProp, EarlyCSE, " : "")
+              << (NewBranches > 0 ?
+                  "SROA, ConstProp, FoldReadOnlyLoads, EarlyCSE, " : "")
               << "SET + OSRA\n");
 
       // TODO: decide what to do with Visited
@@ -1338,33 +1420,67 @@ void JumpTargetManager::harvest() {
         legacy::PassManager OptimizingPM;
         OptimizingPM.add(createSROAPass());
         OptimizingPM.add(createConstantPropagationPass());
+        OptimizingPM.add(new FoldReadOnlyLoadsPass(this));
         OptimizingPM.add(createEarlyCSEPass());
         OptimizingPM.run(TheModule);
       }
 
-      setCFGForm(RecoveredOnlyCFG);
-
       NewBranches = 0;
-      legacy::PassManager AnalysisPM;
-      AnalysisPM.add(new SETPass(this, true, &Visited));
-      AnalysisPM.add(new TranslateDirectBranchesPass(this));
-      AnalysisPM.run(TheModule);
-
-      // Restore the CFG
-      setCFGForm(SemanticPreservingCFG);
+      runAnalysisRound(true);
 
       DBG("jtcount", dbg << std::dec
                          << Unexplored.size() << " new jump targets and "
                          << NewBranches << " new branches were found\n");
 
-    } while (empty() && NewBranches > 0);
+    } while (empty()
+             && NewBranches > 0
+             && !budgetExceeded()
+             && canRunAnalysisRound());
   }
 
   if (empty()) {
     DBG("jtcount", dbg<< "We're done looking for jump targets\n");
+    DBG("jtcount", dbg << std::dec
+                       << RetranslatedBytes << " bytes translated again, "
+                       << SplitInPlaceCount << " blocks split in place\n");
   }
 
 }
 
+void JumpTargetManager::runAnalysisRound(bool UseOSRA) {
+  HarvestRounds++;
+
+  // To improve the quality of our analysis, let them see only the edges we
+  // where able to recover (e.g., no jumps to the dispatcher). The view has to
+  // outlive the passes too.
+  CFGView View(*TheFunction, viewForm(RecoveredOnlyCFG));
+  CFGView::Scope ActiveView(View);
+
+  {
+    // The arena has to outlive the passes, which are destroyed along with the
+    // pass manager. The "heapanalyses" debug feature allocates from the heap
+    // instead, for comparison.
+    bool UseHeap = DebuggingEnabled && isDebugFeatureEnabled("heapanalyses");
+    AnalysisArena Arena(UseHeap);
+    auto Start = std::chrono::steady_clock::now();
+
+    {
+      legacy::PassManager AnalysisPM;
+      AnalysisPM.add(new SETPass(this, UseOSRA, &Visited));
+      AnalysisPM.add(new TranslateDirectBranchesPass(this));
+      AnalysisPM.run(TheModule);
+    }
+
+    DBG("arena", {
+        using namespace std::chrono;
+        auto Elapsed = steady_clock::now() - Start;
+        dbg << std::dec << Arena.allocations() << " allocations ("
+            << Arena.allocatedBytes() << " bytes) from the "
+            << (UseHeap ? "heap" : "arena") << " in "
+            << duration_cast<milliseconds>(Elapsed).count() << " ms\n";
+      });
+  }
+}
+
 const JumpTargetManager::BlockWithAddress JumpTargetManager::NoMoreTargets =
   JumpTargetManager::BlockWithAddress(0, nullptr);
@@ -6,12 +6,12 @@
 //
 
 // Standard includes
+#include <chrono>
 #include <cstdint>
 #include <map>
 #include <set>
 #include <vector>
 #include <boost/icl/interval_set.hpp>
-#include <boost/icl/interval_map.hpp>
 #include <boost/type_traits/is_same.hpp>
 
 // LLVM includes
@@ -19,9 +19,11 @@
 
 // Local includes
 #include "binaryfile.h"
+#include "cfgview.h"
 #include "datastructures.h"
 #include "ir-helpers.h"
 #include "noreturnanalysis.h"
+#include "pcindex.h"
 #include "revamb.h"
 
 // Forward declarations
@@ -92,11 +94,6 @@ public:
   ///         been inserted.
   bool forceFallthroughAfterHelper(llvm::CallInst *Call);
 
-private:
-  /// Obtains the absolute address of the PC corresponding to the original
-  /// assembly instruction coming after the specified LLVM instruction
-  uint64_t getNextPC(llvm::Instruction *TheInstruction);
-
 private:
   JumpTargetManager *JTM;
 };
@@ -123,6 +120,7 @@ public:
                            ///  by SET. Likely a function pointer.
     Callee = 128, ///< This JT is the target of a call instruction.
     SumJump = 256, ///< Obtained from the "sumjump" heuristic
+    Seed = 512, ///< Provided from the outside (e.g., a function symbol)
   };
 
   class JumpTarget {
@@ -159,6 +157,8 @@ public:
         SS << " Callee";
       if (hasReason(SumJump))
         SS << " SumJump";
+      if (hasReason(Seed))
+        SS << " Seed";
 
       return SS.str();
     }
@@ -168,11 +168,11 @@ public:
     uint32_t Reasons;
   };
 
-  /// \brief Possible forms the CFG we're building can assume.
+  /// \brief Possible forms in which the CFG we're building can be seen.
   ///
-  /// Generally the CFG should stay in the SemanticPreservingCFG state, but it
-  /// can be temporarily changed to make certain analysis (e.g., computation of
-  /// the dominator tree) more effective for certain purposes.
+  /// The IR is always in the SemanticPreservingCFG form, the other forms are
+  /// exposed through a CFGView (see viewForm) to make certain analysis (e.g.,
+  /// computation of the dominator tree) more effective for certain purposes.
   enum CFGForm {
     UnknownFormCFG, ///< The CFG is an unknown state.
     SemanticPreservingCFG, ///< The dispatcher jumps to all the jump targets,
@@ -196,12 +196,13 @@ public:
   JumpTargetManager(llvm::Function *TheFunction,
                     llvm::Value *PCReg,
                     const BinaryFile &Binary,
-                    bool EnableOSRA);
-
-  /// \brief Transform the IR to represent the request form of CFG
-  void setCFGForm(CFGForm NewForm);
+                    bool EnableOSRA,
+                    bool SplitInPlace,
+                    bool DebugNames);
 
-  CFGForm cfgForm() const { return CurrentCFGForm; }
+  /// \brief Return the description of a CFGView presenting the CFG in the
+  ///        requested form
+  CFGView::Form viewForm(CFGForm Form) const;
 
   /// \brief Collect jump targets from the program's segments
   void harvestGlobalData();
@@ -282,6 +283,9 @@ public:
     return JumpTargets.count(PC);
   }
 
+  /// \brief Return the number of jump targets registered so far
+  size_t jumpTargetsCount() const { return JumpTargets.size(); }
+
   /// \brief Return true if the given basic block corresponds to a jump target
   bool isJumpTarget(llvm::BasicBlock *BB) {
     if (BB->empty())
@@ -294,6 +298,42 @@ public:
     return false;
   }
 
+  /// \brief Restrict the translation to the code in \p Region
+  ///
+  /// Jump targets outside \p Region will not be registered, direct jumps
+  /// leaving it will go to regionExit() and indirect ones to the dispatcher,
+  /// which doesn't know about them.
+  ///
+  /// \param Region a list of [start, end) address ranges.
+  void restrictTranslation(RangesVector Region);
+
+  /// \brief Limit the resources used to explore the program to \p Budget
+  ///
+  /// Once a limit is exceeded no more jump targets are explored: reaching the
+  /// unexplored ones is handled as reaching an unknown PC.
+  void setBudget(const ExplorationBudget &Budget) { this->Budget = Budget; }
+
+  /// \brief Return the name of the limit of the budget which has been
+  ///        exceeded (e.g., "max-time"), or `nullptr`
+  const char *exceededLimit() const { return ExceededLimit; }
+
+  /// \brief Return the number of jump targets left unexplored due to the
+  ///        budget
+  size_t abandonedJumpTargets() const { return AbandonedCount; }
+
+  /// \brief Return true if \p PC should be translated, i.e., if the
+  ///        translation is not restricted or \p PC is in the region to
+  ///        translate
+  bool isInTranslationRegion(uint64_t PC) const {
+    if (TranslationRegion.empty())
+      return true;
+
+    for (std::pair<uint64_t, uint64_t> Range : TranslationRegion)
+      if (Range.first <= PC && PC < Range.second)
+        return true;
+    return false;
+  }
+
   /// \brief Return true if \p PC is in an executable segment
   bool isExecutableAddress(uint64_t PC) const {
     for (std::pair<uint64_t, uint64_t> Range : ExecutableRanges)
@@ -302,6 +342,15 @@ public:
     return false;
   }
 
+  /// \brief Return true if the \p Size bytes at \p Address are in a segment
+  ///        which is readable but not writeable
+  bool isReadOnlyAddress(uint64_t Address, unsigned Size) const {
+    for (auto &Segment : Binary.segments())
+      if (Segment.contains(Address, Size))
+        return Segment.IsReadable && !Segment.IsWriteable;
+    return false;
+  }
+
   /// \brief Get the basic block associated to the original address \p PC
   ///
   /// If the given address has never been met, assert.
@@ -322,6 +371,17 @@ public:
   ///         valid or another error occurred.
   llvm::BasicBlock *registerJT(uint64_t PC, JTReason Reason);
 
+  /// \brief Return the basic block to jump to in order to reach \p PC
+  ///
+  /// Same as registerJT, except that if \p PC is a valid PC outside the region
+  /// to translate, the basic block handling jumps leaving the region is
+  /// returned.
+  llvm::BasicBlock *registerJTOrExit(uint64_t PC, JTReason Reason) {
+    if (isPC(PC) && !isInTranslationRegion(PC))
+      return regionExit();
+    return registerJT(PC, Reason);
+  }
+
   std::map<uint64_t, JumpTarget>::const_iterator begin() const {
     return JumpTargets.begin();
   }
@@ -332,10 +392,8 @@ public:
 
   void registerJT(llvm::BasicBlock *BB, JTReason Reason) {
     assert(!BB->empty());
-    auto *CallNewPC = llvm::dyn_cast<llvm::CallInst>(&*BB->begin());
+    llvm::CallInst *CallNewPC = PCs.getNewPC(&*BB->begin());
     assert(CallNewPC != nullptr);
-    llvm::Function *Callee = CallNewPC->getCalledFunction();
-    assert(Callee != nullptr && Callee->getName() == "newpc");
     registerJT(getLimitedValue(CallNewPC->getArgOperand(0)), Reason);
   }
 
@@ -347,7 +405,8 @@ public:
     return BB != anyPC()
       && BB != unexpectedPC()
       && BB != dispatcher()
-      && BB != dispatcherFail();
+      && BB != dispatcherFail()
+      && BB != regionExit();
   }
 
   /// \brief Return the dispatcher basic block.
@@ -365,20 +424,29 @@ public:
   /// \brief Return the basic block handling a jump to an unexpected PC
   llvm::BasicBlock *unexpectedPC() const { return UnexpectedPC; }
 
+  /// \brief Return the basic block handling a direct jump outside the region
+  ///        to translate, `nullptr` if the translation is not restricted
+  llvm::BasicBlock *regionExit() const { return RegionExit; }
+
   bool isPCReg(llvm::Value *TheValue) const { return TheValue == PCReg; }
 
   llvm::Value *pcReg() const { return PCReg; }
 
-  // TODO: can this be replaced by the corresponding method in
-  // GeneratedCodeBasicInfo?
+  /// \brief Set the function whose calls mark the beginning of each input
+  ///        instruction
+  void setNewPCMarker(llvm::Function *Marker) { PCs.setNewPCMarker(Marker); }
+
+  /// \brief Check if \p I is a call to `newpc`
+  bool isNewPC(llvm::Instruction *I) const { return PCs.isNewPC(I); }
+
   /// \brief Get the PC associated to \p TheInstruction and the next one
   ///
   /// \return a pair containing the PC associated to \p TheInstruction and the
   ///         next one.
-  std::pair<uint64_t, uint64_t> getPC(llvm::Instruction *TheInstruction) const;
+  std::pair<uint64_t, uint64_t> getPC(llvm::Instruction *TheInstruction) const {
+    return PCs.getPC(TheInstruction);
+  }
 
-  // TODO: can this be replaced by the corresponding method in
-  // GeneratedCodeBasicInfo?
   uint64_t getNextPC(llvm::Instruction *TheInstruction) const {
     auto Pair = getPC(TheInstruction);
     return Pair.first + Pair.second;
@@ -402,16 +470,25 @@ public:
                                      unsigned Size,
                                      Endianess ReadEndianess);
 
-  /// \brief Reads a pointer-sized value from a segment
-  /// \see readConstantInt
-  llvm::Constant *readConstantPointer(llvm::Constant *Address,
-                                      llvm::Type *PointerTy,
-                                      Endianess ReadEndianess);
+  /// \brief Read an integer number from a segment without creating constants
+  ///
+  /// Like readConstantInt, but works on plain integers, so that speculative
+  /// reads (e.g., those performed by SET) do not leave a `ConstantInt` in the
+  /// `LLVMContext` for each value they consider.
+  ///
+  /// \return the read value, or nothing in case \p Address is not inside any
+  ///         of the segments.
+  llvm::Optional<uint64_t> readInteger(uint64_t Address,
+                                       unsigned Size,
+                                       Endianess ReadEndianess);
 
   llvm::Optional<uint64_t> readRawValue(uint64_t Address,
                                         unsigned Size,
                                         Endianess ReadEndianess) const;
 
+  /// \brief Size in bits of a pointer in the input architecture
+  unsigned pointerSize() const { return Binary.architecture().pointerSize(); }
+
   /// \brief Increment the counter of emitted branches since the last reset
   void newBranch() { NewBranches++; }
 
@@ -441,8 +518,17 @@ public:
 
     // We no longer need this information
     freeContainer(UnusedCodePointers);
+
+    // Many basic blocks have been created and erased since the last harvest
+    PCs.invalidate();
   }
 
+  /// \brief Forget the cached PC information
+  ///
+  /// Call this function after erasing basic blocks or calls to `newpc` outside
+  /// of JumpTargetManager.
+  void invalidatePCIndex() { PCs.invalidate(); }
+
   unsigned delaySlotSize() const {
     return Binary.architecture().delaySlotSize();
   }
@@ -477,6 +563,12 @@ public:
   ///         or if no symbol can be found, just the address.
   std::string nameForAddress(uint64_t Address) const;
 
+  /// \brief Return the name for the basic block starting at \p PC
+  ///
+  /// If debug names are enabled, the name is based on the closest symbol (see
+  /// nameForAddress), otherwise it's simply `bb.0x` followed by the address.
+  std::string blockName(uint64_t PC) const;
+
 private:
 
   /// \brief Helper function to check if an instruction is a call to `newpc`
@@ -484,13 +576,8 @@ private:
   /// \return 0 if \p I is not a call to `newpc`, otherwise the PC address of
   ///         associated to the call to `newpc`
   uint64_t getPCFromNewPCCall(llvm::Instruction *I) {
-    if (auto *CallNewPC = llvm::dyn_cast<llvm::CallInst>(I)) {
-      if (CallNewPC->getCalledFunction() == nullptr
-          || CallNewPC->getCalledFunction()->getName() != "newpc")
-        return 0;
-
+    if (llvm::CallInst *CallNewPC = PCs.getNewPC(I))
       return getLimitedValue(CallNewPC->getArgOperand(0));
-    }
 
     return 0;
   }
@@ -505,19 +592,25 @@ private:
     I->eraseFromParent();
   }
 
+  /// \brief Collect \p Start and all the descendants, stopping when a JT is
+  ///        met
+  std::set<llvm::BasicBlock *> translationRegion(llvm::BasicBlock *Start);
+
   /// \brief Drop \p Start and all the descendants, stopping when a JT is met
   void purgeTranslation(llvm::BasicBlock *Start);
 
-  /// \brief Check if \p BB has at least a predecessor, excluding the dispatcher
-  bool hasPredecessors(llvm::BasicBlock *BB) const;
-
-  /// \brief Rebuild the dispatcher switch
+  /// \brief Check if the translation starting from \p Start, which has just
+  ///        been split from its original basic block, can be kept as is
   ///
-  /// Depending on the CFG form we're currently adopting the dispatcher might go
-  /// to all the jump targets or only to those who have no other predecessor.
-  void rebuildDispatcher();
-
-  /// \brief Populate the interval -> Symbol map from Binary.Symbols
+  /// The existing translation can be reused only if it can be entered from
+  /// the dispatcher without depending on the code preceding the split point.
+  /// Specifically, there must be no branches from outside the region into its
+  /// body (i.e., QEMU's control flow doesn't cross the instruction boundary),
+  /// no uses of SSA values defined outside the region and no loads of local
+  /// temporaries written outside the region.
+  bool canSplitInPlace(llvm::BasicBlock *Start);
+
+  /// \brief Populate the sorted array of symbols from Binary.Symbols
   void initializeSymbolMap();
 
   // TODO: instead of a gigantic switch case we could map the original memory
@@ -534,6 +627,35 @@ private:
 
   void harvest();
 
+  /// \brief Set the third argument of the calls to newpc, i.e., whether the
+  ///        instruction is a jump target or not
+  void markJumpTargets();
+
+  /// \brief Check if the budget has been exceeded, recording the first limit
+  ///        which has been exceeded
+  ///
+  /// The limit on the analysis rounds is not considered here, see
+  /// canRunAnalysisRound.
+  bool budgetExceeded();
+
+  /// \brief Check if another analysis round can be run, recording the limit
+  ///        as exceeded otherwise
+  ///
+  /// This has to be checked only when a new round is actually needed: the
+  /// jump targets found by the last allowed round can still be translated and
+  /// an exploration ending exactly after the last allowed round doesn't
+  /// exceed the limit.
+  bool canRunAnalysisRound();
+
+  /// \brief Give up on exploring the jump targets still in Unexplored
+  void abandonUnexplored();
+
+  /// \brief Run SET, and OSRA if \p UseOSRA, on the recovered CFG
+  ///
+  /// The state of the analyses is allocated in an AnalysisArena released at
+  /// the end of the round.
+  void runAnalysisRound(bool UseOSRA);
+
   void handleSumJump(llvm::Instruction *SumJump);
 
 private:
@@ -558,22 +680,46 @@ private:
   llvm::BasicBlock *DispatcherFail;
   llvm::BasicBlock *AnyPC;
   llvm::BasicBlock *UnexpectedPC;
+  /// Address ranges to translate, empty if the translation is not restricted
+  RangesVector TranslationRegion;
+  llvm::BasicBlock *RegionExit;
   std::set<llvm::BasicBlock *> Visited;
 
   const BinaryFile &Binary;
 
   bool EnableOSRA;
+  bool SplitInPlace;
 
   unsigned NewBranches = 0;
 
   std::set<uint64_t> UnusedCodePointers;
   interval_set ReadIntervalSet;
   NoReturnAnalysis NoReturn;
-  using SymbolInfoSet = std::set<const SymbolInfo *>;
-  boost::icl::interval_map<uint64_t, SymbolInfoSet> SymbolMap;
+  bool DebugNames;
+  /// For each address where the closest symbol changes, the new closest
+  /// symbol, sorted by address
+  std::vector<std::pair<uint64_t, const SymbolInfo *>> SymbolMap;
 
-  CFGForm CurrentCFGForm;
   std::set<llvm::BasicBlock *> ToPurge;
+
+  /// Calls to newpc in each basic block, to quickly find the PC of an
+  /// instruction
+  PCIndex PCs;
+
+  /// Number of bytes of the input we had to translate more than once
+  uint64_t RetranslatedBytes = 0;
+  /// Number of blocks split without purging their translation
+  unsigned SplitInPlaceCount = 0;
+
+  ExplorationBudget Budget;
+  /// When the exploration started, to enforce Budget.MaxSeconds
+  std::chrono::steady_clock::time_point ExplorationStart;
+  /// Number of times runAnalysisRound has been called
+  unsigned HarvestRounds = 0;
+  /// The first limit of Budget which has been exceeded, if any
+  const char *ExceededLimit = nullptr;
+  /// Number of jump targets left unexplored due to Budget
+  size_t AbandonedCount = 0;
 };
 
 template<>
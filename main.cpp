@@ -7,33 +7,56 @@
 //
 
 // Standard includes
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <map>
 #include <memory>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 extern "C" {
 #include <dlfcn.h>
 #include <libgen.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 }
 
 // LLVM includes
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
 #include "llvm/Object/Binary.h"
 #include "llvm/Object/ELF.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/SourceMgr.h"
 
 // Local includes
 #include "argparse.h"
 #include "binaryfile.h"
 #include "codegenerator.h"
 #include "debug.h"
+#include "helperinlining.h"
+#include "objectemitter.h"
 #include "ptcinterface.h"
 #include "revamb.h"
+#include "variablemanager.h"
 
 PTCInterface ptc = {}; ///< The interface with the PTC library.
 static std::string LibTinycodePath;
@@ -43,6 +66,9 @@ struct ProgramParameters {
   const char *InputPath;
   const char *OutputPath;
   size_t EntryPointAddress;
+  const char *Only;
+  bool SeedSymbols;
+  const char *SeedsPath;
   DebugInfoType DebugInfo;
   const char *DebugPath;
   const char *LinkingInfoPath;
@@ -53,6 +79,22 @@ struct ProgramParameters {
   bool DetectFunctionsBoundaries;
   bool NoLink;
   bool External;
+  bool InlineHelpers;
+  int InlineThreshold;
+  const char *BatchPath;
+  int Jobs;
+  bool SplitInPlace;
+  bool DebugNames;
+  bool ProfileDispatcher;
+  const char *ObjectPath;
+  const char *SupportPath;
+  int OptimizationLevel;
+  const char *Passes;
+  int CodeGenThreads;
+  int MaxTime;
+  int MaxRSS;
+  int MaxHarvestRounds;
+  int MaxJumpTargets;
 };
 
 using LibraryDestructor = GenericFunctor<decltype(&dlclose), &dlclose>;
@@ -60,6 +102,7 @@ using LibraryPointer = std::unique_ptr<void, LibraryDestructor>;
 
 static const char *const Usage[] = {
   "revamb [options] [--] INFILE OUTFILE",
+  "revamb [options] --batch LIST",
   nullptr,
 };
 
@@ -89,6 +132,30 @@ static void findQemu(const char *Architecture) {
         && access(HelpersPath.str().c_str(), F_OK) != -1) {
       LibTinycodePath = LibraryPath.str();
       LibHelpersPath = HelpersPath.str();
+
+      // Prefer the bitcode version of the helpers produced at build time, which
+      // can be loaded lazily, as long as it's not older than the textual one
+      struct stat HelpersStat;
+      if (stat(LibHelpersPath.c_str(), &HelpersStat) != 0)
+        return;
+
+      std::vector<std::string> BitcodeSearchPaths = { Directory };
+      BitcodeSearchPaths.insert(BitcodeSearchPaths.end(),
+                                SearchPaths.begin(),
+                                SearchPaths.end());
+      for (auto &BitcodePath : BitcodeSearchPaths) {
+        std::stringstream BitcodeHelpersPath;
+        BitcodeHelpersPath << BitcodePath << "/libtinycode-helpers-"
+                           << Architecture << ".bc";
+
+        struct stat BitcodeStat;
+        if (stat(BitcodeHelpersPath.str().c_str(), &BitcodeStat) == 0
+            && BitcodeStat.st_mtime >= HelpersStat.st_mtime) {
+          LibHelpersPath = BitcodeHelpersPath.str();
+          break;
+        }
+      }
+
       return;
     }
 
@@ -97,6 +164,78 @@ static void findQemu(const char *Architecture) {
   assert(false && "Couldn't find libtinycode and the helpers");
 }
 
+/// \brief Load the QEMU helpers found by findQemu and elect the CPU state type
+///
+/// \return the module of the helpers, or nullptr in case of failure.
+static std::unique_ptr<llvm::Module> loadHelpers() {
+  llvm::SMDiagnostic Errors;
+  std::unique_ptr<llvm::Module> Helpers;
+  Helpers = llvm::getLazyIRFileModule(LibHelpersPath,
+                                      Errors,
+                                      llvm::getGlobalContext());
+  if (Helpers.get() == nullptr) {
+    Errors.print("revamb", llvm::dbgs());
+    return nullptr;
+  }
+
+  // The election result is cached in the module itself
+  VariableManager::electCPUStateType(*Helpers);
+
+  return Helpers;
+}
+
+/// \brief Obtain the name of the architecture of the binary at \p Path
+///
+/// Only the headers are inspected, which is enough to look for the appropriate
+/// libtinycode and helpers without waiting for BinaryFile.
+///
+/// \return the architecture name, as in Architecture::name(), or an empty
+///         string in case of failure.
+static std::string readArchitecture(const char *Path) {
+  auto BinaryOrErr = llvm::object::createBinary(Path);
+  if (!BinaryOrErr) {
+    fprintf(stderr, "Couldn't open %s.\n", Path);
+    return "";
+  }
+
+  using llvm::object::ObjectFile;
+  auto *Object = llvm::dyn_cast<ObjectFile>(BinaryOrErr->getBinary());
+  if (Object == nullptr) {
+    fprintf(stderr, "%s is not an object file.\n", Path);
+    return "";
+  }
+
+  return llvm::Triple::getArchTypeName(Object->getArch());
+}
+
+/// Look for the support module for \p Architecture in the default
+/// configuration, in the same places the `translate` script looks for it.
+///
+/// \return the path of the support module, or an empty string if it couldn't
+///         be found.
+static std::string findSupport(const char *Architecture) {
+  char *FullPath = realpath("/proc/self/exe", nullptr);
+  assert(FullPath != nullptr);
+  std::string Directory(dirname(FullPath));
+  free(FullPath);
+
+  std::vector<std::string> SearchPaths;
+  SearchPaths.push_back(Directory + "/../share/revamb");
+#ifdef INSTALL_PATH
+  SearchPaths.push_back(std::string(INSTALL_PATH) + "/share/revamb");
+#endif
+  SearchPaths.push_back(Directory);
+
+  for (auto &Path : SearchPaths) {
+    std::stringstream SupportPath;
+    SupportPath << Path << "/support-" << Architecture << "-normal.ll";
+    if (access(SupportPath.str().c_str(), F_OK) != -1)
+      return SupportPath.str();
+  }
+
+  return "";
+}
+
 /// Given an architecture name, loads the appropriate version of the PTC library,
 /// and initializes the PTC interface.
 ///
@@ -159,6 +298,16 @@ static int parseArgs(int Argc, const char *Argv[],
     OPT_STRING('e', "entry",
                &EntryPointAddressString,
                "virtual address of the entry point where to start."),
+    OPT_STRING(0, "only",
+               &Parameters->Only,
+               "translate only the code in the given comma-separated list of "
+               "address ranges (START-END) and symbols."),
+    OPT_BOOLEAN(0, "seed-symbols", &Parameters->SeedSymbols,
+                "start the exploration also from all the function symbols."),
+    OPT_STRING(0, "seeds",
+               &Parameters->SeedsPath,
+               "path of a CSV whose first column lists additional addresses "
+               "from where to start the exploration."),
     OPT_STRING('s', "debug-path",
                &Parameters->DebugPath,
                "destination path for the generated debug source."),
@@ -193,6 +342,56 @@ static int parseArgs(int Argc, const char *Argv[],
     OPT_BOOLEAN('f', "functions-boundaries",
                 &Parameters->DetectFunctionsBoundaries,
                 "enable functions boundaries detection."),
+    OPT_BOOLEAN('I', "inline-helpers", &Parameters->InlineHelpers,
+                "inline and specialize small QEMU helpers in the translated "
+                "code."),
+    OPT_INTEGER(0, "inline-threshold", &Parameters->InlineThreshold,
+                "maximum cost of a QEMU helper to be inlined, requires -I."),
+    OPT_BOOLEAN(0, "debug-names", &Parameters->DebugNames,
+                "name basic blocks after the closest symbol, implied by -g."),
+    OPT_BOOLEAN(0, "split-in-place", &Parameters->SplitInPlace,
+                "when a jump target is found in the middle of a translated "
+                "basic block, keep the existing translation if possible."),
+    OPT_BOOLEAN(0, "profile-dispatcher", &Parameters->ProfileDispatcher,
+                "call dispatcher_hit each time the dispatcher is reached."),
+    OPT_GROUP("Exploration budget"),
+    OPT_INTEGER(0, "max-time", &Parameters->MaxTime,
+                "maximum number of seconds to spend exploring the code."),
+    OPT_INTEGER(0, "max-rss", &Parameters->MaxRSS,
+                "maximum peak memory usage, in KiB, to explore more code."),
+    OPT_INTEGER(0, "max-harvest-rounds", &Parameters->MaxHarvestRounds,
+                "maximum number of rounds of analyses looking for new jump "
+                "targets."),
+    OPT_INTEGER(0, "max-jump-targets", &Parameters->MaxJumpTargets,
+                "maximum number of jump targets to explore."),
+    OPT_GROUP("Batch mode"),
+    OPT_STRING('B', "batch",
+               &Parameters->BatchPath,
+               "path of a file listing a pair of input and output paths per "
+               "line to translate in a single invocation."),
+    OPT_INTEGER('j', "jobs", &Parameters->Jobs,
+                "maximum number of concurrent translations in batch mode, by "
+                "default the number of online CPUs."),
+    OPT_GROUP("Object emission"),
+    OPT_STRING(0, "emit-obj",
+               &Parameters->ObjectPath,
+               "also produce an object file at the given path. The arguments "
+               "to link it are written to the same path plus .ld-options."),
+    OPT_STRING(0, "support",
+               &Parameters->SupportPath,
+               "path of the support module to link, 'none' to skip it. By "
+               "default, support-ARCH-normal.ll."),
+    OPT_INTEGER(0, "opt-level", &Parameters->OptimizationLevel,
+                "0 to optimize nothing, 1 to optimize only code generation, 2 "
+                "to optimize the IR too."),
+    OPT_STRING(0, "passes",
+               &Parameters->Passes,
+               "comma-separated list of passes to run instead of the default "
+               "optimization pipeline."),
+    OPT_INTEGER(0, "codegen-threads", &Parameters->CodeGenThreads,
+                "number of partitions, and threads, for code generation, by "
+                "default 1. root is never split, it always ends up in a "
+                "single partition."),
     OPT_END(),
   };
 
@@ -203,14 +402,52 @@ static int parseArgs(int Argc, const char *Argv[],
   Argc = argparse_parse(&Arguments, Argc, Argv);
 
   // Handle positional arguments
-  if (Argc != 2) {
+  if (Parameters->BatchPath != nullptr) {
+    if (Argc != 0) {
+      fprintf(stderr, "Batch mode (-B, --batch) takes no positional"
+              " arguments.\n");
+      return EXIT_FAILURE;
+    }
+
+    // The other outputs are derived from the path of each output file
+    if (Parameters->DebugPath != nullptr
+        || Parameters->LinkingInfoPath != nullptr
+        || Parameters->CoveragePath != nullptr
+        || Parameters->BBSummaryPath != nullptr) {
+      fprintf(stderr, "Batch mode (-B, --batch) doesn't support custom paths"
+              " for the additional outputs.\n");
+      return EXIT_FAILURE;
+    }
+
+    if (Parameters->ObjectPath != nullptr) {
+      fprintf(stderr, "Batch mode (-B, --batch) doesn't support object"
+              " emission (--emit-obj).\n");
+      return EXIT_FAILURE;
+    }
+
+    if (Parameters->SeedsPath != nullptr) {
+      fprintf(stderr, "Batch mode (-B, --batch) doesn't support a list of"
+              " seeds (--seeds), since it's specific to a binary.\n");
+      return EXIT_FAILURE;
+    }
+
+    if (Parameters->Jobs < 0) {
+      fprintf(stderr, "Jobs parameter (-j, --jobs) must be a positive"
+              " number.\n");
+      return EXIT_FAILURE;
+    }
+
+    if (Parameters->Jobs == 0)
+      Parameters->Jobs = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+
+  } else if (Argc != 2) {
     fprintf(stderr, "Too many arguments.\n");
     return EXIT_FAILURE;
+  } else {
+    Parameters->InputPath = Argv[0];
+    Parameters->OutputPath = Argv[1];
   }
 
-  Parameters->InputPath = Argv[0];
-  Parameters->OutputPath = Argv[1];
-
   // Check parameters
   if (EntryPointAddressString != nullptr) {
     if (sscanf(EntryPointAddressString, "%lld", &EntryPointAddress) != 1) {
@@ -238,6 +475,10 @@ static int parseArgs(int Argc, const char *Argv[],
     }
   }
 
+  // Debug information refers to basic blocks by name
+  if (Parameters->DebugInfo != DebugInfoType::None)
+    Parameters->DebugNames = true;
+
   if (DebugLoggingString != nullptr) {
     DebuggingEnabled = true;
     std::string Input(DebugLoggingString);
@@ -259,30 +500,204 @@ static int parseArgs(int Argc, const char *Argv[],
   if (Parameters->BBSummaryPath == nullptr)
     Parameters->BBSummaryPath = "";
 
+  if (Parameters->InlineThreshold < 0) {
+    fprintf(stderr, "Inline threshold parameter (--inline-threshold) must be a"
+            " positive number.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (!Parameters->InlineHelpers && Parameters->InlineThreshold != 0) {
+    fprintf(stderr, "Inline threshold parameter (--inline-threshold) requires"
+            " helper inlining (-I, --inline-helpers).\n");
+    return EXIT_FAILURE;
+  }
+
+  if (Parameters->InlineHelpers && Parameters->InlineThreshold == 0)
+    Parameters->InlineThreshold = HelperInliningPass::DefaultThreshold;
+
+  if (Parameters->OptimizationLevel < 0 || Parameters->OptimizationLevel > 2) {
+    fprintf(stderr, "Optimization level parameter (--opt-level) must be 0, 1"
+            " or 2.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (Parameters->CodeGenThreads < 0) {
+    fprintf(stderr, "Code generation threads parameter (--codegen-threads)"
+            " must be a positive number.\n");
+    return EXIT_FAILURE;
+  }
+
+  // All the translated code is in root, which can't be split in partitions
+  if (Parameters->CodeGenThreads == 0)
+    Parameters->CodeGenThreads = 1;
+
+  if (Parameters->Passes == nullptr)
+    Parameters->Passes = "";
+
+  if (Parameters->MaxTime < 0
+      || Parameters->MaxRSS < 0
+      || Parameters->MaxHarvestRounds < 0
+      || Parameters->MaxJumpTargets < 0) {
+    fprintf(stderr, "Exploration budget parameters (--max-time, --max-rss,"
+            " --max-harvest-rounds and --max-jump-targets) must be positive"
+            " numbers.\n");
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
 
-int main(int argc, const char *argv[]) {
-  // Parse arguments
-  ProgramParameters Parameters {};
-  if (parseArgs(argc, argv, &Parameters) != EXIT_SUCCESS)
+/// Parse the argument of --only, resolving symbol names in \p TheBinary.
+///
+/// \param Only a comma-separated list of address ranges, in the START-END
+///        form, and symbol names.
+/// \param Region where to store the resulting [start, end) address ranges.
+///
+/// \return true if all the elements of the list are valid.
+static bool parseRegion(const BinaryFile &TheBinary,
+                        const char *Only,
+                        std::vector<std::pair<uint64_t, uint64_t>> &Region) {
+  llvm::SmallVector<llvm::StringRef, 4> Elements;
+  llvm::StringRef(Only).split(Elements, ",", -1, false);
+
+  for (llvm::StringRef Element : Elements) {
+    // Is it an address range?
+    llvm::StringRef StartString, EndString;
+    std::tie(StartString, EndString) = Element.split('-');
+    uint64_t Start, End;
+    if (!EndString.empty()
+        && !StartString.getAsInteger(0, Start)
+        && !EndString.getAsInteger(0, End)) {
+      if (Start >= End) {
+        fprintf(stderr, "Empty address range %s (--only).\n",
+                Element.str().c_str());
+        return false;
+      }
+
+      Region.push_back({ Start, End });
+      continue;
+    }
+
+    // It must be a symbol, consider all the symbols with that name
+    bool Found = false;
+    for (const SymbolInfo &Symbol : TheBinary.symbols()) {
+      if (Symbol.Name == Element && Symbol.Size != 0) {
+        Region.push_back({ Symbol.Address, Symbol.Address + Symbol.Size });
+        Found = true;
+      }
+    }
+
+    if (!Found) {
+      fprintf(stderr, "Couldn't find a symbol named %s with a size"
+              " (--only).\n", Element.str().c_str());
+      return false;
+    }
+  }
+
+  if (Region.empty()) {
+    fprintf(stderr, "No address ranges or symbols specified (--only).\n");
+    return false;
+  }
+
+  return true;
+}
+
+/// Collect the addresses from where the exploration should start, in addition
+/// to the entry point.
+///
+/// \param Seeds where to store the function symbols of \p TheBinary, if
+///        Parameters.SeedSymbols is set, and the addresses listed in the CSV
+///        at Parameters.SeedsPath, if any.
+///
+/// \return true if the list of seeds, if any, has been successfully parsed.
+static bool collectSeeds(const BinaryFile &TheBinary,
+                         const ProgramParameters &Parameters,
+                         std::vector<uint64_t> &Seeds) {
+  if (Parameters.SeedSymbols)
+    for (const SymbolInfo &Symbol : TheBinary.symbols())
+      if (Symbol.IsFunction && Symbol.Address != 0)
+        Seeds.push_back(Symbol.Address);
+
+  if (Parameters.SeedsPath == nullptr)
+    return true;
+
+  std::ifstream Input(Parameters.SeedsPath);
+  if (!Input) {
+    fprintf(stderr, "Couldn't open the list of seeds %s.\n",
+            Parameters.SeedsPath);
+    return false;
+  }
+
+  // Only the first column is considered, the first line might be a header
+  std::string Line;
+  for (unsigned LineNumber = 1; std::getline(Input, Line); LineNumber++) {
+    llvm::StringRef Address = llvm::StringRef(Line).split(',').first.trim();
+    if (Address.empty())
+      continue;
+
+    uint64_t Seed;
+    if (Address.getAsInteger(0, Seed)) {
+      if (LineNumber == 1)
+        continue;
+
+      fprintf(stderr, "Invalid address \"%s\" at %s:%u (--seeds).\n",
+              Address.str().c_str(),
+              Parameters.SeedsPath,
+              LineNumber);
+      return false;
+    }
+
+    Seeds.push_back(Seed);
+  }
+
+  return true;
+}
+
+/// Translate \p TheBinary into \p OutputPath.
+///
+/// \param Helpers either the path of the QEMU helpers module or the module
+///        itself, if it has already been loaded.
+///
+/// \param LimitFD if not -1, file descriptor where to write the name of the
+///        exceeded limit of the exploration budget, if any.
+///
+/// \return EXIT_SUCCESS if the translation and, if requested, the object
+///         emission have been successful.
+template<typename T>
+static int translate(BinaryFile &TheBinary,
+                      const ProgramParameters &Parameters,
+                      std::string OutputPath,
+                      T Helpers,
+                      int LimitFD = -1) {
+  // In partial translation mode, resolve the region to translate
+  std::vector<std::pair<uint64_t, uint64_t>> Region;
+  if (Parameters.Only != nullptr
+      && !parseRegion(TheBinary, Parameters.Only, Region))
     return EXIT_FAILURE;
 
-  BinaryFile TheBinary(Parameters.InputPath, Parameters.UseSections);
+  // Don't silently start from somewhere else than the requested entry point
+  if (Parameters.EntryPointAddress != 0 && !Region.empty()) {
+    uint64_t EntryPoint = Parameters.EntryPointAddress;
+    auto Contains = [EntryPoint] (std::pair<uint64_t, uint64_t> Range) {
+      return Range.first <= EntryPoint && EntryPoint < Range.second;
+    };
 
-  findQemu(TheBinary.architecture().name());
+    if (std::none_of(Region.begin(), Region.end(), Contains)) {
+      fprintf(stderr, "The entry point (-e, --entry) is outside the region to"
+              " translate (--only).\n");
+      return EXIT_FAILURE;
+    }
+  }
 
-  // Load the appropriate libtyncode version
-  LibraryPointer PTCLibrary;
-  if (loadPTCLibrary(PTCLibrary) != EXIT_SUCCESS)
+  std::vector<uint64_t> Seeds;
+  if (!collectSeeds(TheBinary, Parameters, Seeds))
     return EXIT_FAILURE;
 
-  // Translate everything
   Architecture TargetArchitecture;
   CodeGenerator Generator(TheBinary,
                           TargetArchitecture,
-                          std::string(Parameters.OutputPath),
-                          LibHelpersPath,
+                          OutputPath,
+                          std::move(Helpers),
                           Parameters.DebugInfo,
                           std::string(Parameters.DebugPath),
                           std::string(Parameters.LinkingInfoPath),
@@ -291,11 +706,294 @@ int main(int argc, const char *argv[]) {
                           !Parameters.NoOSRA,
                           Parameters.DetectFunctionsBoundaries,
                           !Parameters.NoLink,
-                          Parameters.External);
-
-  Generator.translate(Parameters.EntryPointAddress);
+                          Parameters.External,
+                          Parameters.InlineHelpers ? Parameters.InlineThreshold
+                                                   : 0,
+                          Parameters.SplitInPlace,
+                          Parameters.DebugNames,
+                          Parameters.ProfileDispatcher);
+
+  ExplorationBudget Budget;
+  Budget.MaxSeconds = Parameters.MaxTime;
+  Budget.MaxRSS = Parameters.MaxRSS;
+  Budget.MaxHarvestRounds = Parameters.MaxHarvestRounds;
+  Budget.MaxJumpTargets = Parameters.MaxJumpTargets;
+
+  Generator.translate(Parameters.EntryPointAddress, Region, Budget, Seeds);
+
+  // The output is still valid, but incomplete
+  const std::string &Limit = Generator.exceededLimit();
+  if (!Limit.empty()) {
+    fprintf(stderr, "Exploration budget exceeded (--%s), %zu jump targets"
+            " have not been explored.\n",
+            Limit.c_str(),
+            Generator.abandonedJumpTargets());
+
+    if (LimitFD != -1 && write(LimitFD, Limit.data(), Limit.size()) < 0)
+      perror("Couldn't report the exceeded limit");
+  }
 
   Generator.serialize();
 
+  if (Parameters.ObjectPath == nullptr)
+    return EXIT_SUCCESS;
+
+  std::string SupportPath;
+  if (Parameters.SupportPath == nullptr) {
+    SupportPath = findSupport(TheBinary.architecture().name());
+    if (SupportPath.empty()) {
+      fprintf(stderr, "Couldn't find the support module, use --support.\n");
+      return EXIT_FAILURE;
+    }
+  } else if (strcmp("none", Parameters.SupportPath) != 0) {
+    SupportPath = Parameters.SupportPath;
+  }
+
+  ObjectEmitter Emitter(SupportPath,
+                        Parameters.OptimizationLevel,
+                        std::string(Parameters.Passes),
+                        Parameters.CodeGenThreads);
+  if (!Generator.emitObject(Emitter, std::string(Parameters.ObjectPath)))
+    return EXIT_FAILURE;
+
   return EXIT_SUCCESS;
 }
+
+/// \brief libtinycode and QEMU helpers for a certain input architecture
+struct LoadedArchitecture {
+  LibraryPointer Library;
+  PTCInterface Interface;
+  std::unique_ptr<llvm::Module> Helpers;
+};
+
+/// Translate all the binaries listed in Parameters.BatchPath.
+///
+/// libtinycode and the QEMU helpers are loaded only once per architecture.
+/// Since both libtinycode and the LLVMContext are not thread-safe, each binary
+/// is translated in a child process, which inherits the loaded library and
+/// helpers from the parent. At most Parameters.Jobs translations run
+/// concurrently.
+///
+/// For each binary, a line reporting the exit code, the wall-clock time, the
+/// peak memory usage of the translation and which limit of the exploration
+/// budget has been exceeded, if any, is printed on the standard output. A
+/// failure to start a translation is reported in the same way and doesn't
+/// stop the others.
+///
+/// \return EXIT_SUCCESS if all the translations have been successful.
+static int runBatch(const ProgramParameters &Parameters) {
+  using Clock = std::chrono::steady_clock;
+
+  std::ifstream List(Parameters.BatchPath);
+  if (!List) {
+    fprintf(stderr, "Couldn't open the batch list %s.\n",
+            Parameters.BatchPath);
+    return EXIT_FAILURE;
+  }
+
+  std::map<std::string, LoadedArchitecture> Architectures;
+  /// \brief A translation running in a child process
+  struct Translation {
+    std::string InputPath;
+    Clock::time_point Start;
+    /// Read end of the pipe where the child reports the exceeded limit
+    int LimitFD;
+  };
+
+  std::map<pid_t, Translation> Running;
+  unsigned Failures = 0;
+
+  printf("input,exit_code,seconds,max_rss_kb,exceeded_limit\n");
+
+  // Wait for a translation to complete and report about it
+  auto Reap = [&Running, &Failures] () {
+    int Status = 0;
+    struct rusage Usage;
+    pid_t Child = wait4(-1, &Status, 0, &Usage);
+    assert(Child != -1);
+
+    auto It = Running.find(Child);
+    assert(It != Running.end());
+    std::chrono::duration<double> Elapsed = Clock::now() - It->second.Start;
+
+    // The child has exited, whatever it reported is in the pipe
+    char Limit[64] = { 0 };
+    if (read(It->second.LimitFD, Limit, sizeof(Limit) - 1) < 0)
+      Limit[0] = '\0';
+    close(It->second.LimitFD);
+
+    int ExitCode = EXIT_FAILURE;
+    if (WIFEXITED(Status))
+      ExitCode = WEXITSTATUS(Status);
+    else if (WIFSIGNALED(Status))
+      ExitCode = 128 + WTERMSIG(Status);
+
+    if (ExitCode != EXIT_SUCCESS)
+      Failures++;
+
+    printf("%s,%d,%.3f,%ld,%s\n",
+           It->second.InputPath.c_str(),
+           ExitCode,
+           Elapsed.count(),
+           Usage.ru_maxrss,
+           Limit);
+    fflush(stdout);
+
+    Running.erase(It);
+  };
+
+  // Report an input whose translation couldn't even start
+  auto Fail = [&Failures] (const std::string &InputPath) {
+    Failures++;
+    printf("%s,%d,0.000,0,\n", InputPath.c_str(), EXIT_FAILURE);
+    fflush(stdout);
+  };
+
+  std::string Line;
+  while (std::getline(List, Line)) {
+    std::stringstream Stream(Line);
+    std::string InputPath;
+    std::string OutputPath;
+    if (!(Stream >> InputPath) || InputPath[0] == '#')
+      continue;
+
+    if (!(Stream >> OutputPath)) {
+      fprintf(stderr, "Missing output path for %s.\n", InputPath.c_str());
+      Failures++;
+      continue;
+    }
+
+    while (Running.size() >= static_cast<size_t>(Parameters.Jobs))
+      Reap();
+
+    BinaryFile TheBinary(InputPath, Parameters.UseSections);
+
+    // Load the appropriate libtinycode version, if we haven't already
+    std::string Name = TheBinary.architecture().name();
+    auto It = Architectures.find(Name);
+    if (It == Architectures.end()) {
+      findQemu(Name.c_str());
+
+      // Perform the CPU state election once, the children will inherit it.
+      // In case of failure, inputs with the same architecture will try again.
+      LoadedArchitecture New;
+      if (loadPTCLibrary(New.Library) == EXIT_SUCCESS)
+        New.Helpers = loadHelpers();
+
+      if (New.Helpers.get() == nullptr) {
+        Fail(InputPath);
+        continue;
+      }
+      New.Interface = ptc;
+
+      It = Architectures.insert({ Name, std::move(New) }).first;
+    }
+
+    // Don't let the child inherit pending output
+    fflush(stdout);
+    fflush(stderr);
+
+    int LimitPipe[2];
+    if (pipe(LimitPipe) != 0) {
+      perror("Couldn't create a pipe");
+      Fail(InputPath);
+      continue;
+    }
+
+    Clock::time_point Start = Clock::now();
+    pid_t Child = fork();
+    if (Child == -1) {
+      perror("Couldn't start a new translation");
+      close(LimitPipe[0]);
+      close(LimitPipe[1]);
+      Fail(InputPath);
+      continue;
+    }
+
+    if (Child == 0) {
+      close(LimitPipe[0]);
+      ptc = It->second.Interface;
+      exit(translate(TheBinary,
+                     Parameters,
+                     OutputPath,
+                     std::move(It->second.Helpers),
+                     LimitPipe[1]));
+    }
+
+    close(LimitPipe[1]);
+    Running[Child] = { InputPath, Start, LimitPipe[0] };
+  }
+
+  while (!Running.empty())
+    Reap();
+
+  return Failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, const char *argv[]) {
+  // Parse arguments
+  ProgramParameters Parameters {};
+  if (parseArgs(argc, argv, &Parameters) != EXIT_SUCCESS)
+    return EXIT_FAILURE;
+
+  if (Parameters.BatchPath != nullptr)
+    return runBatch(Parameters);
+
+  using Clock = PhaseReporter::Clock;
+  Clock::time_point StartupStart = Clock::now();
+
+  // The libtinycode version and the helpers to load depend only on the
+  // architecture, which can be obtained without parsing the whole binary
+  std::string ArchitectureName = readArchitecture(Parameters.InputPath);
+  if (ArchitectureName.empty())
+    return EXIT_FAILURE;
+
+  findQemu(ArchitectureName.c_str());
+
+  // Parsing the input binary, loading libtinycode and loading the helpers are
+  // independent from each other, perform them concurrently. The helpers are
+  // loaded on this thread, the only one using the LLVMContext.
+  Clock::duration BinaryTime;
+  auto ParseBinary = [&Parameters, &BinaryTime] () {
+    Clock::time_point Start = Clock::now();
+    std::unique_ptr<BinaryFile> Result(new BinaryFile(Parameters.InputPath,
+                                                      Parameters.UseSections));
+    BinaryTime = Clock::now() - Start;
+    return Result;
+  };
+  auto BinaryLoader = std::async(std::launch::async, ParseBinary);
+
+  // Load the appropriate libtyncode version
+  LibraryPointer PTCLibrary;
+  Clock::duration PTCTime;
+  auto LoadPTC = [&PTCLibrary, &PTCTime] () {
+    Clock::time_point Start = Clock::now();
+    int Result = loadPTCLibrary(PTCLibrary);
+    PTCTime = Clock::now() - Start;
+    return Result;
+  };
+  auto PTCLoader = std::async(std::launch::async, LoadPTC);
+
+  Clock::time_point HelpersStart = Clock::now();
+  std::unique_ptr<llvm::Module> Helpers = loadHelpers();
+  Clock::duration HelpersTime = Clock::now() - HelpersStart;
+
+  std::unique_ptr<BinaryFile> TheBinary = BinaryLoader.get();
+  int PTCResult = PTCLoader.get();
+
+  PhaseReporter::report("startup.binary", BinaryTime, 0);
+  PhaseReporter::report("startup.libtinycode", PTCTime, 0);
+  PhaseReporter::report("startup.helpers", HelpersTime, 0);
+  PhaseReporter::report("startup", Clock::now() - StartupStart, 0);
+
+  if (PTCResult != EXIT_SUCCESS || Helpers.get() == nullptr)
+    return EXIT_FAILURE;
+
+  assert(ArchitectureName == TheBinary->architecture().name());
+
+  // Translate everything
+  return translate(*TheBinary,
+                   Parameters,
+                   std::string(Parameters.OutputPath),
+                   std::move(Helpers));
+}
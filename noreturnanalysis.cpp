@@ -6,7 +6,7 @@
 //
 
 // LLVM includes
-#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/ADT/SCCIterator.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
@@ -131,26 +131,45 @@ void NoReturnAnalysis::registerKiller(uint64_t StoredValue,
   registerKiller(Setter->getParent());
 }
 
-void NoReturnAnalysis::findInfinteLoops() {
-  Function *F = Dispatcher->getParent();
-  DominatorTreeBase<BasicBlock> DT(false);
-  DT.recalculate(*F);
-
-  LoopInfo LI(DT);
-  for (Loop *L : LI) {
-    SmallVector<BasicBlock *, 3> ExitingBlocks;
-    L->getExitingBlocks(ExitingBlocks);
-    if (ExitingBlocks.size() == 0) {
-      for (BasicBlock *Member : L->blocks())
-        KillerBBs.insert(Member);
+void NoReturnAnalysis::findInfinteLoops(CFGView &View) {
+  // Each strongly connected component with no way out is an infinite loop
+  for (auto It = scc_begin(&View); !It.isAtEnd(); ++It) {
+    if (!It.hasLoop())
+      continue;
+
+    const std::vector<CFGView::Node *> &SCC = *It;
+    std::set<CFGView::Node *> Members(SCC.begin(), SCC.end());
+
+    bool HasExit = false;
+    for (CFGView::Node *Member : SCC) {
+      for (auto *Successor : make_range(Member->succ_begin(),
+                                        Member->succ_end())) {
+        if (Members.count(Successor) == 0) {
+          HasExit = true;
+          break;
+        }
+      }
+
+      if (HasExit)
+        break;
     }
+
+    if (!HasExit)
+      for (CFGView::Node *Member : SCC)
+        KillerBBs.insert(Member->block());
   }
 }
 
-void NoReturnAnalysis::computeKillerSet(PredecessorsMap &CallPredecessors,
+void NoReturnAnalysis::computeKillerSet(const CFGView::Form &Form,
+                                        PredecessorsMap &CallPredecessors,
                                         std::set<TerminatorInst *> &Returns) {
+  Function *F = Dispatcher->getParent();
+
   // Enrich the KillerBBs set with blocks participating in infinite loops
-  findInfinteLoops();
+  {
+    CFGView View(*F, Form);
+    findInfinteLoops(View);
+  }
 
   if (KillerBBs.size() == 0)
     return;
@@ -162,27 +181,20 @@ void NoReturnAnalysis::computeKillerSet(PredecessorsMap &CallPredecessors,
   // Note: computing the post-dominated basic blocks from the sink is different
   // from computing the union of all the basic blocks post-dominated by a killer
   // basic block.
-  Function *F = Dispatcher->getParent();
+  //
+  // The sink is not part of the function, it's only visible in the view, as
+  // the edges from the killer basic blocks.
   LLVMContext &C = F->getParent()->getContext();
-  auto *Sink = BasicBlock::Create(C, "sink", F);
+  auto *Sink = BasicBlock::Create(C, "sink");
   new UnreachableInst(C, Sink);
 
-  std::vector<std::pair<BasicBlock *, TerminatorInst *>> Backup;
-  for (BasicBlock *KillerBB : KillerBBs) {
-    // Save a reference to the original terminator and detach it from the basic
-    // block
-    TerminatorInst *Terminator = KillerBB->getTerminator();
-    Backup.push_back({ KillerBB, Terminator });
-    Terminator->removeFromParent();
-
-    // Replace the old terminator with an unconditional branch to the sink
-    // TODO: this is dangerous, we might break some relevant edge
-    BranchInst::Create(Sink, KillerBB);
-  }
+  CFGView View(*F, Form);
+  for (BasicBlock *KillerBB : KillerBBs)
+    View.replaceSuccessors(KillerBB, Sink);
 
-  // Compute the post-dominator tree on the CFG (in NoFunctionCallsCFG state)
-  DominatorTreeBase<BasicBlock> PDT(true);
-  PDT.recalculate(*F);
+  // Compute the post-dominator tree on the CFG (in NoFunctionCallsCFG form)
+  DominatorTreeBase<CFGView::Node> PDT(true);
+  PDT.recalculate(View);
 
   // The worklist initially contains only the sink but will be populated with
   // the basic blocks calling a killer basic block (i.e., function)
@@ -193,8 +205,13 @@ void NoReturnAnalysis::computeKillerSet(PredecessorsMap &CallPredecessors,
     BasicBlock *BB = WorkList.pop();
 
     // Collect all the post-dominated basic blocks
+    SmallVector<CFGView::Node *, 5> DescendantNodes;
+    PDT.getDescendants(View.node(BB), DescendantNodes);
+
     SmallVector<BasicBlock *, 5> Descendants;
-    PDT.getDescendants(BB, Descendants);
+    for (CFGView::Node *Descendant : DescendantNodes)
+      if (Descendant->block() != Sink)
+        Descendants.push_back(Descendant->block());
 
     // These are all killer basic blocks
     for (BasicBlock *NewKiller : Descendants)
@@ -231,21 +248,8 @@ void NoReturnAnalysis::computeKillerSet(PredecessorsMap &CallPredecessors,
 
   }
 
-  // Restore the backup
-  for (auto &P : Backup) {
-    BasicBlock *KillerBB = P.first;
-    TerminatorInst *Terminator = P.second;
-    KillerBB->getTerminator()->eraseFromParent();
-    if (KillerBB->empty()) {
-      auto &List = KillerBB->getInstList();
-      List.insert(List.begin(), Terminator);
-    } else {
-      Terminator->insertAfter(&KillerBB->back());
-    }
-  }
-
   // We no longer need the sink
-  Sink->eraseFromParent();
+  delete Sink;
 
   DBG("nra", {
       for (BasicBlock *KillerBB : KillerBBs)
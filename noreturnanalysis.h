@@ -16,6 +16,7 @@
 #include "llvm/ADT/StringRef.h"
 
 // Local includes
+#include "cfgview.h"
 #include "reachingdefinitions.h"
 #include "revamb.h"
 
@@ -60,7 +61,10 @@ public:
                                    std::vector<llvm::BasicBlock *>>;
   /// Add to the set of killer basic blocks all the basic blocks who can only
   /// end in one of those already registered.
-  void computeKillerSet(PredecessorsMap &CallPredecessors,
+  ///
+  /// \param Form the form of the CFG to consider, the IR is not affected.
+  void computeKillerSet(const CFGView::Form &Form,
+                        PredecessorsMap &CallPredecessors,
                         std::set<llvm::TerminatorInst *> &Returns);
 
   void setDispatcher(llvm::BasicBlock *BB) { Dispatcher = BB; }
@@ -116,7 +120,7 @@ private:
   bool hasSyscalls() const { return NoDCE != nullptr; }
 
   /// \brief Register as killer basic blocks those parts of infinite loops
-  void findInfinteLoops();
+  void findInfinteLoops(CFGView &View);
 
 private:
   Architecture SourceArchitecture;
@@ -0,0 +1,200 @@
+/// \file objectemitter.cpp
+/// \brief Implementation of the in-process linking, optimization and code
+///        generation of the translated module
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cassert>
+#include <cstdio>
+#include <sstream>
+#include <system_error>
+
+// LLVM includes
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/CodeGen/RegAllocRegistry.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+
+// Local includes
+#include "debug.h"
+#include "objectemitter.h"
+
+using namespace llvm;
+
+ObjectEmitter::ObjectEmitter(std::string SupportPath,
+                             unsigned OptimizationLevel,
+                             std::string Passes,
+                             unsigned Threads) :
+  SupportPath(SupportPath),
+  OptimizationLevel(OptimizationLevel),
+  Passes(Passes),
+  Threads(Threads) {
+
+  assert(Threads > 0);
+
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  // Make the LLVM passes available by name
+  PassRegistry &Registry = *PassRegistry::getPassRegistry();
+  initializeCore(Registry);
+  initializeScalarOpts(Registry);
+  initializeIPO(Registry);
+  initializeAnalysis(Registry);
+  initializeTransformUtils(Registry);
+  initializeInstCombine(Registry);
+  initializeVectorization(Registry);
+
+  // Generate code as the translate script does with llc -regalloc=fast
+  // -disable-machine-licm: the greedy register allocator and machine LICM are
+  // very slow on the huge root function and bring little benefit
+  if (OptimizationLevel >= 1) {
+    RegisterRegAlloc::setDefault(createFastRegisterAllocator);
+
+    StringMap<cl::Option *>& Options(cl::getRegisteredOptions());
+    auto *DisableMachineLICM = Options["disable-machine-licm"];
+    static_cast<cl::opt<bool> *>(DisableMachineLICM)->setInitialValue(true);
+  }
+}
+
+bool ObjectEmitter::linkSupport(Module &TheModule) {
+  SMDiagnostic Errors;
+  std::unique_ptr<Module> Support = parseIRFile(SupportPath,
+                                                Errors,
+                                                TheModule.getContext());
+  if (Support.get() == nullptr) {
+    Errors.print("revamb", dbgs());
+    return false;
+  }
+
+  Linker TheLinker(TheModule);
+  if (TheLinker.linkInModule(std::move(Support))) {
+    fprintf(stderr, "Couldn't link the support module %s.\n",
+            SupportPath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool ObjectEmitter::optimize(Module &TheModule) {
+  legacy::PassManager PM;
+
+  if (!Passes.empty()) {
+    // Custom pipeline
+    PassRegistry &Registry = *PassRegistry::getPassRegistry();
+    std::stringstream Stream(Passes);
+    std::string Name;
+    while (std::getline(Stream, Name, ',')) {
+      const PassInfo *Info = Registry.getPassInfo(Name);
+      if (Info == nullptr || Info->getNormalCtor() == nullptr) {
+        fprintf(stderr, "Unknown pass %s.\n", Name.c_str());
+        return false;
+      }
+      PM.add(Info->createPass());
+    }
+  } else if (OptimizationLevel >= 2) {
+    // Same pipeline as opt -O2
+    PassManagerBuilder Builder;
+    Builder.OptLevel = 2;
+    Builder.Inliner = createFunctionInliningPass(2, 0);
+
+    legacy::FunctionPassManager FPM(&TheModule);
+    Builder.populateFunctionPassManager(FPM);
+    Builder.populateModulePassManager(PM);
+
+    FPM.doInitialization();
+    for (Function &F : TheModule)
+      FPM.run(F);
+    FPM.doFinalization();
+  } else {
+    return true;
+  }
+
+  DBG("passes", { dbg << "Optimizing the translated module\n"; });
+  PM.run(TheModule);
+  return true;
+}
+
+std::vector<std::string>
+ObjectEmitter::emit(std::unique_ptr<Module> &TheModule,
+                    std::string ObjectPath) {
+  if (!SupportPath.empty() && !linkSupport(*TheModule))
+    return { };
+
+  if (TheModule->getTargetTriple().empty())
+    TheModule->setTargetTriple(sys::getDefaultTargetTriple());
+
+  std::string Error;
+  if (TargetRegistry::lookupTarget(TheModule->getTargetTriple(),
+                                   Error) == nullptr) {
+    fprintf(stderr, "%s\n", Error.c_str());
+    return { };
+  }
+
+  if (!optimize(*TheModule))
+    return { };
+
+  // Prepare an output stream for each partition
+  std::vector<std::string> Paths;
+  std::vector<std::unique_ptr<raw_fd_ostream>> Streams;
+  std::vector<raw_pwrite_stream *> StreamPointers;
+  for (unsigned I = 0; I < Threads; I++) {
+    std::string Path = ObjectPath;
+    if (I != 0)
+      Path += "." + std::to_string(I);
+
+    std::error_code EC;
+    Streams.emplace_back(new raw_fd_ostream(Path, EC, sys::fs::F_None));
+    if (EC) {
+      fprintf(stderr, "Couldn't open %s: %s.\n",
+              Path.c_str(),
+              EC.message().c_str());
+      return { };
+    }
+
+    StreamPointers.push_back(Streams.back().get());
+    Paths.push_back(Path);
+  }
+
+  CodeGenOpt::Level CodeGenLevel = CodeGenOpt::Default;
+  if (OptimizationLevel == 0)
+    CodeGenLevel = CodeGenOpt::None;
+
+  DBG("passes", {
+      dbg << "Generating code in " << std::dec << Threads << " partitions\n";
+    });
+
+  // The translated code has to be loaded at the original addresses, so
+  // position independent code is not an option. With a single partition
+  // splitCodeGen gives the module back, otherwise it returns nullptr.
+  TheModule = splitCodeGen(std::move(TheModule),
+                           StreamPointers,
+                           "",
+                           "",
+                           TargetOptions(),
+                           Reloc::Static,
+                           CodeModel::Default,
+                           CodeGenLevel,
+                           TargetMachine::CGFT_ObjectFile);
+
+  return Paths;
+}
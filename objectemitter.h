@@ -0,0 +1,69 @@
+#ifndef _OBJECTEMITTER_H
+#define _OBJECTEMITTER_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <memory>
+#include <string>
+#include <vector>
+
+// Forward declarations
+namespace llvm {
+class Module;
+}
+
+/// \brief Produce object files out of the translated module, in-process
+///
+/// Performs the same steps of the `translate` script (`llvm-link` with the
+/// support module, `opt` and `llc`) without serializing and parsing the module
+/// at each step. Code generation can split the module in partitions, which are
+/// compiled concurrently, one per thread, each to a separate object file.
+/// Since all the translated code is in `root`, which can't be split, more than
+/// one partition is useful only if the support module is large.
+class ObjectEmitter {
+public:
+  /// \param SupportPath path of the support module to link in, or an empty
+  ///        string to skip linking.
+  /// \param OptimizationLevel 0 to neither optimize the IR nor the generated
+  ///        code, 1 to optimize only the generated code, 2 to optimize both.
+  ///        As in the `translate` script, the generated code is optimized
+  ///        using the fast register allocator and without machine LICM.
+  /// \param Passes comma-separated list of the names of the passes to run on
+  ///        the IR in place of the default pipeline for \p OptimizationLevel.
+  ///        An empty string selects the default pipeline.
+  /// \param Threads number of threads to use for code generation.
+  ObjectEmitter(std::string SupportPath,
+                unsigned OptimizationLevel,
+                std::string Passes,
+                unsigned Threads);
+
+  /// \brief Link, optimize and compile \p TheModule
+  ///
+  /// \p TheModule is consumed and, if a single thread is used for code
+  /// generation, given back in its final state. Otherwise, it's not given
+  /// back, since it has been split in partitions.
+  ///
+  /// \param ObjectPath path of the object file to produce. If more than a
+  ///        partition is produced, the partitions after the first are written
+  ///        to \p ObjectPath plus a ".N" suffix.
+  ///
+  /// \return the paths of the object files produced, or an empty vector in
+  ///         case of error.
+  std::vector<std::string> emit(std::unique_ptr<llvm::Module> &TheModule,
+                                std::string ObjectPath);
+
+private:
+  bool linkSupport(llvm::Module &TheModule);
+  bool optimize(llvm::Module &TheModule);
+
+private:
+  std::string SupportPath;
+  unsigned OptimizationLevel;
+  std::string Passes;
+  unsigned Threads;
+};
+
+#endif // _OBJECTEMITTER_H
@@ -26,6 +26,7 @@
 #include <boost/icl/interval_set.hpp>
 
 // Local includes
+#include "cfgview.h"
 #include "datastructures.h"
 #include "debug.h"
 #include "memoryaccess.h"
@@ -40,7 +41,6 @@ using boost::icl::interval_bounds;
 using Predicate = CmpInst::Predicate;
 using OSR = OSRAPass::OSR;
 using BoundedValue = OSRAPass::BoundedValue;
-using CE = ConstantExpr;
 using CI = ConstantInt;
 using std::pair;
 using std::make_pair;
@@ -246,7 +246,7 @@ private:
   BoundedValue &summarize(BasicBlock *Target,
                           MapValue *BVOVectorLoopInfoWrapperPass);
 
-  bool isForced(std::map<MapIndex, MapValue>::iterator &It) const {
+  bool isForced(ArenaMap<MapIndex, MapValue>::iterator &It) const {
     const MapIndex &Index = It->first;
 
     if (auto *I = dyn_cast<Instruction>(Index.second)) {
@@ -261,7 +261,7 @@ private:
   std::set<BasicBlock *> *BlockBlackList;
   const DataLayout *DL;
   Type *Int64;
-  std::map<MapIndex, MapValue> TheMap;
+  ArenaMap<MapIndex, MapValue> TheMap;
   mutable std::map<const BasicBlock *, std::vector<MapValue>> BBMap;
 };
 
@@ -271,12 +271,14 @@ public:
 
 public:
   OSRA(Function &F,
+       CFGView &View,
        SimplifyComparisonsPass &SCP,
        ConditionalReachedLoadsPass &RDP,
        FunctionCallIdentification &FCI,
        std::map<const Value *, const OSR> &OSRs,
        BVMap &BVs) :
     F(F),
+    View(View),
     DL(F.getParent()->getDataLayout()),
     SCP(SCP),
     RDP(RDP),
@@ -315,12 +317,12 @@ public:
   ///
   /// \return a new BoundedValue constraining the BoundedValue associated to \p
   ///         BaseOp with the specified comparison
-  BoundedValue mergePredicate(OSR &BaseOp, Predicate P, Constant *ConstOp);
+  BoundedValue mergePredicate(OSR &BaseOp, Predicate P, const APInt &ConstOp);
 
   Optional<BoundedValue> applyConstraint(Instruction *I,
                                          OSR &BaseOp,
                                          Predicate P,
-                                         Constant *ConstOp);
+                                         const APInt &ConstOp);
 
   std::pair<Constant *, Value *>
   identifyOperands(const Instruction *I, const DataLayout &DL) {
@@ -375,6 +377,12 @@ public:
     return Base;
   }
 
+  /// \brief Check if \p A post-dominates \p B in the view of the CFG
+  bool postDominates(const BasicBlock *A, const BasicBlock *B) {
+    return PDT.dominates(View.node(const_cast<BasicBlock *>(A)),
+                         View.node(const_cast<BasicBlock *>(B)));
+  }
+
   pred_iterator getValidPred(BasicBlock *BB) {
     pred_iterator Result = pred_begin(BB);
     nextValidPred(Result, pred_end(BB));
@@ -415,6 +423,7 @@ private:
   // References provided by OSRAPass
   //
   Function &F;
+  CFGView &View;
   const DataLayout &DL;
   SimplifyComparisonsPass &SCP;
   ConditionalReachedLoadsPass &RDP;
@@ -435,17 +444,18 @@ private:
   std::map<const Value *, const OSR> &OSRs;
   BVMap &BVs;
 
-  // Temporary
-  std::map<const Instruction *, BVVector> Constraints;
+  // Temporary, allocated in the arena of the current harvest round
+  ArenaMap<const Instruction *, BVVector> Constraints;
   using InstructionOSRVector = std::vector<std::pair<Instruction *, OSR>>;
-  std::map<const LoadInst *, InstructionOSRVector> LoadReachers;
+  ArenaMap<const LoadInst *, InstructionOSRVector> LoadReachers;
 
   /// Keeps track of those instruction that need to be updated when the reachers
   /// of a certain Load are updated
   using SubscribersType = SmallSet<Instruction *, 3>;
-  std::map<const LoadInst *, SubscribersType> Subscriptions;
+  ArenaMap<const LoadInst *, SubscribersType> Subscriptions;
 
-  DominatorTreeBase<BasicBlock> PDT;
+  /// Post-dominator tree of the view of the CFG
+  DominatorTreeBase<CFGView::Node> PDT;
 };
 
 void OSRA::propagateConstraints(Instruction *I,
@@ -599,7 +609,9 @@ void OSRA::handleLogicalOperator(Instruction *I) {
 }
 
 // TODO: give a better name
-BoundedValue OSRA::mergePredicate(OSR &BaseOp, Predicate P, Constant *ConstOp) {
+BoundedValue OSRA::mergePredicate(OSR &BaseOp,
+                                  Predicate P,
+                                  const APInt &ConstOp) {
   const Value *V = BaseOp.boundedValue()->value();
   bool IsSigned = BaseOp.boundedValue()->isSigned();
   // Solve the equation to obtain the new boundary value
@@ -612,11 +624,11 @@ BoundedValue OSRA::mergePredicate(OSR &BaseOp, Predicate P, Constant *ConstOp) {
                   || P == CmpInst::ICMP_ULT
                   || P == CmpInst::ICMP_SLT);
 
-  Constant *NewBoundC = BaseOp.solveEquation(ConstOp, RoundUp, DL);
-  if (isa<UndefValue>(NewBoundC))
+  Optional<uint64_t> Solution = BaseOp.solveEquation(ConstOp, RoundUp);
+  if (!Solution.hasValue())
     return BoundedValue::createBottom(V);
 
-  uint64_t NewBound = getExtValue(NewBoundC, IsSigned, DL);
+  uint64_t NewBound = Solution.getValue();
 
   // TODO: this is an hack
   if (NewBound == 0
@@ -656,7 +668,7 @@ BoundedValue OSRA::mergePredicate(OSR &BaseOp, Predicate P, Constant *ConstOp) {
 Optional<BoundedValue> OSRA::applyConstraint(Instruction *I,
                                              OSR &BaseOp,
                                              Predicate P,
-                                             Constant *ConstOp) {
+                                             const APInt &ConstOp) {
   BasicBlock *BB = I->getParent();
   const BoundedValue *OriginalBV = BaseOp.boundedValue();
 
@@ -703,7 +715,7 @@ Optional<BoundedValue> OSRA::applyConstraint(Instruction *I,
     if (Flip)
       Result.flip();
 
-    auto *Zero = ConstantInt::get(ConstOp->getType(), 0);
+    APInt Zero(ConstOp.getBitWidth(), 0);
     Result.merge(mergePredicate(BaseOp, CmpInst::ICMP_UGE, Zero), DL, Int64);
 
     if (Flip)
@@ -905,12 +917,12 @@ void OSRA::handleComparison(Instruction *I) {
 
       // Check if the comparison holds. If not, set to bottom the associate
       // value
-      Constant *LHSConstant = CI::get(T, LHSPair.first);
-      Constant *RHSConstant = CI::get(T, RHSPair.first);
-      Constant *Compare = CE::getICmp(P, LHSConstant, RHSConstant);
+      unsigned Width = cast<IntegerType>(T)->getBitWidth();
+      APInt LHSConstant(Width, LHSPair.first);
+      APInt RHSConstant(Width, RHSPair.first);
 
       // Does the comparison hold?
-      if (getLimitedValue(Compare) == 0) {
+      if (!compareIntegers(P, LHSConstant, RHSConstant)) {
         // It doens't: send everything to bottom
         if (LHSPair.second != nullptr)
           NewConstraints.push_back(BoundedValue::createBottom(LHSPair.second));
@@ -921,11 +933,12 @@ void OSRA::handleComparison(Instruction *I) {
     }
   }
 
-  Type *T = I->getOperand(0)->getType();
+  auto *T = cast<IntegerType>(I->getOperand(0)->getType());
+  unsigned Width = T->getBitWidth();
 
   // OSR vs const
   for (auto &RHSPair : RHS.Constants) {
-    Constant *ConstOp = CI::get(T, RHSPair.first);
+    APInt ConstOp(Width, RHSPair.first);
 
     for (OSR &LHSOSR : LHS.OSRs) {
       OSR TheOSR = switchBlock(LHSOSR, BB);
@@ -939,7 +952,7 @@ void OSRA::handleComparison(Instruction *I) {
   // const vs OSR
   ICmpInst::Predicate FP = ICmpInst::getInversePredicate(P);
   for (auto &LHSPair : LHS.Constants) {
-    Constant *ConstOp = CI::get(T, LHSPair.first);
+    APInt ConstOp(Width, LHSPair.first);
 
     for (OSR &RHSOSR : RHS.OSRs) {
       OSR TheOSR = switchBlock(RHSOSR, BB);
@@ -1121,7 +1134,7 @@ void OSRA::handleBranch(Instruction *I) {
   for (const BasicBlock *ToCheck : AffectedSet) {
     bool Dominated = false;
     for (const BasicBlock *Other : AffectedSet) {
-      if (ToCheck != Other && PDT.dominates(Other, ToCheck)) {
+      if (ToCheck != Other && postDominates(Other, ToCheck)) {
         Dominated = true;
         break;
       }
@@ -1250,7 +1263,7 @@ void OSRA::handleBranch(Instruction *I) {
     if (std::all_of(RecursivelyAffected.begin(),
                     RecursivelyAffected.end(),
                     [this, &Entry] (const BasicBlock *BB) {
-                      return PDT.dominates(Entry.Target, BB);
+                      return postDominates(Entry.Target, BB);
                     }))
       continue;
 
@@ -1389,59 +1402,43 @@ void OSRAPass::releaseMemory() {
   }
 }
 
-Constant *OSR::evaluate(Constant *Value, Type *Int64) const {
-  Constant *BaseC = CI::get(Int64, Base, BV->isSigned());
-  Constant *FactorC = CI::get(Int64, Factor, BV->isSigned());
-
-  return CE::getAdd(BaseC, CE::getMul(FactorC, Value));
+pair<uint64_t, uint64_t> OSR::boundaries() const {
+  uint64_t Min, Max;
+  std::tie(Min, Max) = BV->actualBoundaries();
+  return { evaluate(Min), evaluate(Max) };
 }
 
-pair<Constant *, Constant *>
-OSR::boundaries(Type *Int64, const DataLayout &DL) const {
-  Constant *Min = nullptr;
-  Constant *Max = nullptr;
-  std::tie(Min, Max) = BV->actualBoundaries(Int64);
-  Min = evaluate(Min, Int64);
-  Max = evaluate(Max, Int64);
-
-  return { Min, Max };
-}
-
-/// \brief Combine two constants using \p Opcode operation
+/// \brief Combine two integers using \p Opcode operation
 ///
 /// \param Opcode the opcode of the binary operator.
 /// \param Signed whether the operands are signed or not.
 /// \param Op1 the first operand.
 /// \param Op2 the second operand.
-/// \param T the type of the operands the result.
-/// \param DL the DataLayout to compute the result.
-/// \return the result of the operation.
+/// \return the result of the operation, extended to 64 bits.
 static uint64_t combineImpl(unsigned Opcode,
                             bool Signed,
-                            Constant *Op1,
-                            Constant *Op2,
-                            IntegerType *T,
-                            const DataLayout &DL) {
-  auto *R = ConstantFoldInstOperands(Opcode, T, { Op1, Op2 }, DL);
-  return getExtValue(R, Signed, DL);
+                            const APInt &Op1,
+                            const APInt &Op2) {
+  Optional<APInt> Result = foldBinaryOperator(Opcode, Op1, Op2);
+  assert(Result.hasValue() && "The result of the operation is undefined");
+  if (Signed)
+    return Result->getSExtValue();
+  else
+    return Result->getZExtValue();
 }
 
 static uint64_t combineImpl(unsigned Opcode,
                             bool Signed,
                             uint64_t Op1,
-                            Constant *Op2,
-                            IntegerType *T,
-                            const DataLayout &DL) {
-  return combineImpl(Opcode, Signed, CI::get(T, Op1, Signed), Op2, T, DL);
+                            const APInt &Op2) {
+  return combineImpl(Opcode, Signed, APInt(Op2.getBitWidth(), Op1), Op2);
 }
 
 static uint64_t combineImpl(unsigned Opcode,
                             bool Signed,
-                            Constant *Op1,
-                            uint64_t Op2,
-                            IntegerType *T,
-                            const DataLayout &DL) {
-  return combineImpl(Opcode, Signed, Op1, CI::get(T, Op2, Signed), T, DL);
+                            const APInt &Op1,
+                            uint64_t Op2) {
+  return combineImpl(Opcode, Signed, Op1, APInt(Op1.getBitWidth(), Op2));
 }
 
 uint64_t BoundedValue::performOp(uint64_t Op1,
@@ -1460,13 +1457,12 @@ uint64_t BoundedValue::performOp(uint64_t Op1,
   }
 
   // Build operands
-  bool IsSigned = isSigned();
-  auto *COp1 = CI::get(Ty, Op1, IsSigned);
-  auto *COp2 = CI::get(Ty, Op2, IsSigned);
+  unsigned Width = Ty->getBitWidth();
+  APInt IntOp1(Width, Op1);
+  APInt IntOp2(Width, Op2);
 
   // Compute the result
-  auto *Result = ConstantFoldInstOperands(Opcode, Ty, { COp1, COp2 }, DL);
-  return getExtValue(Result, IsSigned, DL);
+  return combineImpl(Opcode, isSigned(), IntOp1, IntOp2);
 }
 
 BoundedValue BoundedValue::moveTo(llvm::Value *V,
@@ -1497,11 +1493,10 @@ bool OSR::combine(unsigned Opcode,
                   unsigned FreeOpIndex,
                   const DataLayout &DL) {
   using I = Instruction;
-  auto *TheType = cast<IntegerType>(Operand->getType());
   bool Multiplicative = !(Opcode == I::Add || Opcode == I::Sub);
   bool Signed = (Opcode == I::SDiv || Opcode == I::AShr);
 
-  Operand = getConstValue(Operand, DL);
+  const APInt &OperandValue = getConstValue(Operand, DL)->getValue();
 
   uint64_t OldValue = Base;
   uint64_t OldFactor = Factor;
@@ -1515,18 +1510,18 @@ bool OSR::combine(unsigned Opcode,
     // c - x
     // x = a + b * y
     // (c - a) + (-b) * y
-    Base = combineImpl(Opcode, Signed, Operand, Base, TheType, DL);
+    Base = combineImpl(Opcode, Signed, OperandValue, Base);
     Changed |= Base != OldValue;
-    auto *MinusOne = Constant::getAllOnesValue(TheType);
-    Factor = combineImpl(I::Mul, Signed, MinusOne, Factor, TheType, DL);
+    auto MinusOne = APInt::getAllOnesValue(OperandValue.getBitWidth());
+    Factor = combineImpl(I::Mul, Signed, MinusOne, Factor);
     Changed |= OldFactor != Factor;
   } else {
     // Commutative/second operand constant case
-    Base = combineImpl(Opcode, Signed, Base, Operand, TheType, DL);
+    Base = combineImpl(Opcode, Signed, Base, OperandValue);
     Changed |= Base != OldValue;
 
     if (Multiplicative) {
-      Factor = combineImpl(Opcode, Signed, Factor, Operand, TheType, DL);
+      Factor = combineImpl(Opcode, Signed, Factor, OperandValue);
       Changed |= OldFactor != Factor;
 
     }
@@ -1536,20 +1531,16 @@ bool OSR::combine(unsigned Opcode,
 }
 
 uint64_t OSR::BoundsIterator::operator*() const {
-  bool IsSigned = TheOSR.BV->isSigned();
+  unsigned Width = DL.getTypeSizeInBits(TheType);
 
-  auto Const = [&] (uint64_t V) { return CI::get(TheType, V, IsSigned); };
-  auto *RangeStart = Const(Current->first);
-  auto *RangePosition = Const(Index);
-  auto *Base = Const(TheOSR.Base);
-  auto *Factor = Const(TheOSR.Factor);
+  auto Int = [Width] (uint64_t V) { return APInt(Width, V); };
+  APInt RangeStart = Int(Current->first);
+  APInt RangePosition = Int(Index);
+  APInt Base = Int(TheOSR.Base);
+  APInt Factor = Int(TheOSR.Factor);
 
-  auto *Result = CE::getAdd(CE::getMul(CE::getAdd(RangeStart,
-                                                  RangePosition),
-                                       Factor),
-                            Base);
-
-  return getLimitedValue(Result);
+  APInt Result = (RangeStart + RangePosition) * Factor + Base;
+  return Result.getLimitedValue();
 }
 
 class OSRAnnotationWriter : public AssemblyAnnotationWriter {
@@ -1572,16 +1563,14 @@ private:
 
 void OSRA::run() {
   BVs.initialize(&BlockBlackList, &DL, Int64);
-  PDT.recalculate(F);
+  PDT.recalculate(View);
 
+  Function *NewPC = F.getParent()->getFunction("newpc");
   for (auto &BB : F) {
     if (!BB.empty()) {
-      if (auto *Call = dyn_cast<CallInst>(&*BB.begin())) {
-        Function *Callee = Call->getCalledFunction();
-        // TODO: comparing with "newpc" string is sad
-        if (Callee != nullptr && Callee->getName() == "newpc")
+      if (auto *Call = dyn_cast<CallInst>(&*BB.begin()))
+        if (NewPC != nullptr && Call->getCalledFunction() == NewPC)
           break;
-      }
     }
 
     BlockBlackList.insert(&BB);
@@ -1744,34 +1733,38 @@ void OSRA::describe(formatted_raw_ostream &O, const Instruction *I) const {
   }
 }
 
-Constant *OSR::solveEquation(Constant *KnownTerm,
-                             bool CeilingRounding,
-                             const DataLayout &DL) {
+Optional<uint64_t> OSR::solveEquation(const APInt &KnownTerm,
+                                      bool CeilingRounding) {
   // (KnownTerm - Base) udiv Factor
+  using I = Instruction;
   bool IsSigned = BV->isSigned();
+  unsigned Width = KnownTerm.getBitWidth();
 
-  auto *BaseConst = CI::get(KnownTerm->getType(), Base, IsSigned);
-  auto *Numerator = CE::getSub(KnownTerm, BaseConst);
-  auto *Denominator = CI::get(KnownTerm->getType(), Factor, IsSigned);
+  APInt Numerator = KnownTerm - APInt(Width, Base);
+  APInt Denominator(Width, Factor);
 
-  Constant *Remainder = nullptr;
-  Constant *Division = nullptr;
+  Optional<APInt> Remainder;
+  Optional<APInt> Division;
   if (IsSigned) {
-    Remainder = CE::getSRem(Numerator, Denominator);
-    Division = CE::getSDiv(Numerator, Denominator);
+    Remainder = foldBinaryOperator(I::SRem, Numerator, Denominator);
+    Division = foldBinaryOperator(I::SDiv, Numerator, Denominator);
   } else {
-    Remainder = CE::getURem(Numerator, Denominator);
-    Division = CE::getUDiv(Numerator, Denominator);
+    Remainder = foldBinaryOperator(I::URem, Numerator, Denominator);
+    Division = foldBinaryOperator(I::UDiv, Numerator, Denominator);
   }
 
-  if (isa<UndefValue>(Division))
-    return Division;
+  if (!Division.hasValue())
+    return Optional<uint64_t>();
 
-  bool HasRemainder = getConstValue(Remainder, DL)->getLimitedValue() != 0;
+  APInt Result = Division.getValue();
+  bool HasRemainder = Remainder.getValue() != 0;
   if (CeilingRounding && HasRemainder)
-    Division = CE::getAdd(Division, CI::get(Division->getType(), 1));
+    ++Result;
 
-  return Division;
+  if (IsSigned)
+    return Result.getSExtValue();
+  else
+    return Result.getZExtValue();
 }
 
 OSR OSRA::createOSR(Value *V, BasicBlock *BB) const {
@@ -2285,7 +2278,14 @@ bool OSRAPass::runOnFunction(Function &F) {
   releaseMemory();
   BVs = new BVMap();
 
+  // Use the form of the CFG chosen by the caller, if any
+  CFGView IRView(F);
+  CFGView *View = CFGView::current();
+  if (View == nullptr)
+    View = &IRView;
+
   OSRA TheOSRA(F,
+               *View,
                getAnalysis<SimplifyComparisonsPass>(),
                getAnalysis<ConditionalReachedLoadsPass>(),
                getAnalysis<FunctionCallIdentification>(),
@@ -2430,13 +2430,8 @@ BoundedValue &BVMap::summarize(BasicBlock *Target, MapValue *BVOVector) {
   return BVOVector->Summary;
 }
 
-bool OSR::compare(unsigned short P,
-                  Constant *C,
-                  const DataLayout &DL,
-                  Type *Int64) {
-  Constant *BaseConstant = CI::get(Int64, Base);
-  Constant *Compare = CE::getCompare(P, BaseConstant, C);
-  return getConstValue(Compare, DL)->getLimitedValue() != 0;
+bool OSR::compare(unsigned short P, uint64_t C) const {
+  return compareIntegers(P, APInt(64, Base), APInt(64, C));
 }
 
 void BoundedValue::setSignedness(bool IsSigned) {
@@ -147,23 +147,18 @@ public:
     ///
     /// Do not invoke this method on unlimited BVs.
     // TODO: should this method perform a cast to the type of Value?
-    std::pair<llvm::Constant *, llvm::Constant *>
-    actualBoundaries(llvm::Type *Int64) const {
+    std::pair<uint64_t, uint64_t> actualBoundaries() const {
       assert(!(Negated && isConstant()));
       assert(Bounds.size() > 0);
 
-      using CI = llvm::ConstantInt;
       uint64_t LowerBound = Bounds.front().first;
       uint64_t UpperBound = Bounds.back().second;
       if (!Negated) {
-        return std::make_pair(CI::get(Int64, LowerBound, isSigned()),
-                              CI::get(Int64, UpperBound, isSigned()));
+        return std::make_pair(LowerBound, UpperBound);
       } else if (LowerBound == lowerExtreme()) {
-        return std::make_pair(CI::get(Int64, UpperBound + 1, isSigned()),
-                              CI::get(Int64, upperExtreme(), isSigned()));
+        return std::make_pair(UpperBound + 1, upperExtreme());
       } else if (UpperBound == upperExtreme()) {
-        return std::make_pair(CI::get(Int64, lowerExtreme(), isSigned()),
-                              CI::get(Int64, LowerBound - 1, isSigned()));
+        return std::make_pair(lowerExtreme(), LowerBound - 1);
       }
 
       assert(false && "The BV is unlimited");
@@ -439,15 +434,12 @@ public:
       BV(Other.BV) { }
 
     uint64_t constant() const {
-      using CE = llvm::ConstantExpr;
-      using CI = llvm::ConstantInt;
-      using Constant = llvm::Constant;
-      llvm::Type *T = BV->value()->getType();
+      using APInt = llvm::APInt;
+      unsigned Width = BV->value()->getType()->getIntegerBitWidth();
 
-      Constant *ConstantC = CI::get(T, BV->constant());
-      Constant *FactorC = CI::get(T, Factor);
-      Constant *BaseC = CI::get(T, Base);
-      return getLimitedValue(CE::getAdd(CE::getMul(ConstantC, FactorC), BaseC));
+      APInt ConstantValue(Width, BV->constant());
+      APInt Result = ConstantValue * APInt(Width, Factor) + APInt(Width, Base);
+      return Result.getLimitedValue();
     }
 
     /// \brief Combine this OSR with \p Operand through \p Opcode
@@ -471,10 +463,9 @@ public:
     /// \param CeilingRounding the rounding mode, round for excess if true.
     ///
     /// \return the solution of the integer equation using the specified
-    ///         rounding mode.
-    llvm::Constant *solveEquation(llvm::Constant *KnownTerm,
-                                  bool CeilingRounding,
-                                  const llvm::DataLayout &DL);
+    ///         rounding mode, or nothing if it's undefined.
+    llvm::Optional<uint64_t> solveEquation(const llvm::APInt &KnownTerm,
+                                           bool CeilingRounding);
 
     /// \brief Checks if this OSR is relative to \p V
     bool isRelativeTo(const llvm::Value *V) const {
@@ -510,25 +501,19 @@ public:
     }
 
     /// \brief Helper function to performe the comparison \p P with \p C
-    bool compare(unsigned short P,
-                 llvm::Constant *C,
-                 const llvm::DataLayout &DL,
-                 llvm::Type *Int64);
+    bool compare(unsigned short P, uint64_t C) const;
 
-    // TODO: are we sure we want to use Int64 here?
+    // TODO: are we sure we want to use 64-bit integers here?
     /// \brief Compute `a + b * Value`
-    llvm::Constant *evaluate(llvm::Constant *Value,
-                             llvm::Type *Int64) const;
+    uint64_t evaluate(uint64_t Value) const { return Base + Factor * Value; }
 
     /// \brief Compute the boundaries value
     ///
     /// This method basically evaluates `a + b * c` and `a + b * d` being `c`
     /// and `d` the boundaries of the associated BoundedValue.
     ///
-    /// \return a pair of `Constant` representing the lower and upper bounds.
-    std::pair<llvm::Constant *,
-              llvm::Constant *> boundaries(llvm::Type *Int64,
-                                           const llvm::DataLayout &DL) const;
+    /// \return a pair representing the lower and upper bounds.
+    std::pair<uint64_t, uint64_t> boundaries() const;
 
     class BoundsIterator {
     public:
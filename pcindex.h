@@ -0,0 +1,251 @@
+#ifndef _PCINDEX_H
+#define _PCINDEX_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <utility>
+
+// LLVM includes
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+// Local includes
+#include "ir-helpers.h"
+
+/// \brief Index of the calls to `newpc` in the translated code
+///
+/// For each basic block, the index records the calls to `newpc` it contains,
+/// in order, and the call to `newpc` reaching its entry, i.e., the last one
+/// met on all the paths leading to it. This way, to find the PC associated to
+/// an instruction it's enough to look backward for a call to `newpc` in its
+/// basic block and, if there's none, take the one reaching the entry, which is
+/// computed only once.
+///
+/// Basic blocks are indexed lazily, the first time they are involved in a
+/// query, or explicitly through index(). The index has to be informed when a
+/// basic block is split (see splitBlock) and invalidated when basic blocks or
+/// calls to `newpc` are erased.
+class PCIndex {
+public:
+  PCIndex() : NewPCMarker(nullptr), Dispatcher(nullptr) { }
+
+  /// \brief Set the function marking the beginning of each input instruction
+  void setNewPCMarker(llvm::Function *Marker) {
+    NewPCMarker = Marker;
+    invalidate();
+  }
+
+  llvm::Function *newPCMarker() const { return NewPCMarker; }
+
+  /// \brief Set the dispatcher, which is never expected to be met going
+  ///        backward from an instruction
+  void setDispatcher(llvm::BasicBlock *BB) { Dispatcher = BB; }
+
+  /// \brief Return \p I as a call to `newpc`, or nullptr if it isn't one
+  llvm::CallInst *getNewPC(llvm::Instruction *I) const {
+    auto *Call = llvm::dyn_cast<llvm::CallInst>(I);
+    if (Call == nullptr
+        || NewPCMarker == nullptr
+        || Call->getCalledFunction() != NewPCMarker)
+      return nullptr;
+
+    return Call;
+  }
+
+  bool isNewPC(llvm::Instruction *I) const { return getNewPC(I) != nullptr; }
+
+  /// \brief Return the PC and the size of the instruction a call to `newpc`
+  ///        refers to
+  static std::pair<uint64_t, uint64_t>
+  decodeNewPC(llvm::CallInst *NewPCCall) {
+    uint64_t PC = getLimitedValue(NewPCCall->getArgOperand(0));
+    uint64_t Size = getLimitedValue(NewPCCall->getArgOperand(1));
+    assert(Size != 0);
+    return { PC, Size };
+  }
+
+  /// \brief Find the PC which lead to generated \p TheInstruction
+  ///
+  /// \return a pair of integers: the first element represents the PC and the
+  ///         second the size of the instruction. If the PC can't be determined
+  ///         uniquely, both are zero.
+  std::pair<uint64_t, uint64_t>
+  getPC(llvm::Instruction *TheInstruction) const {
+    llvm::BasicBlock *BB = TheInstruction->getParent();
+    const BlockInfo &Info = info(BB);
+
+    // Look for the closest call to newpc in the basic block, if there's any
+    if (!Info.NewPCs.empty()) {
+      llvm::BasicBlock::iterator It = TheInstruction->getIterator();
+      llvm::BasicBlock::iterator Begin(BB->begin());
+      while (true) {
+        if (llvm::CallInst *Call = getNewPC(&*It))
+          return decodeNewPC(Call);
+
+        if (It == Begin)
+          break;
+
+        It--;
+      }
+    }
+
+    ReachingNewPC Entry = entry(BB);
+    if (Entry.Kind != ReachingNewPC::Unique)
+      return { 0, 0 };
+
+    return decodeNewPC(Entry.Call);
+  }
+
+  /// \brief Record the calls to `newpc` in \p BB
+  void index(llvm::BasicBlock *BB) const { info(BB); }
+
+  /// \brief Update the index after \p Head has been split in \p Head and
+  ///        \p Tail
+  void splitBlock(llvm::BasicBlock *Head, llvm::BasicBlock *Tail) {
+    Blocks.erase(Tail);
+
+    auto It = Blocks.find(Head);
+    if (It == Blocks.end())
+      return;
+
+    // Move the calls to newpc now in Tail
+    BlockInfo &HeadInfo = It->second;
+    BlockInfo &TailInfo = Blocks[Tail];
+    auto FirstMoved = std::find_if(HeadInfo.NewPCs.begin(),
+                                   HeadInfo.NewPCs.end(),
+                                   [Head] (llvm::CallInst *Call) {
+                                     return Call->getParent() != Head;
+                                   });
+    TailInfo.NewPCs.append(FirstMoved, HeadInfo.NewPCs.end());
+    HeadInfo.NewPCs.erase(FirstMoved, HeadInfo.NewPCs.end());
+
+    // Head is the only predecessor of Tail
+    if (!HeadInfo.NewPCs.empty()) {
+      TailInfo.Entry = ReachingNewPC(HeadInfo.NewPCs.back());
+      TailInfo.EntryKnown = true;
+    } else if (HeadInfo.EntryKnown) {
+      TailInfo.Entry = HeadInfo.Entry;
+      TailInfo.EntryKnown = true;
+    }
+  }
+
+  /// \brief Drop all the information collected so far
+  void invalidate() { Blocks.clear(); }
+
+private:
+  /// \brief The call to `newpc` reaching a certain program point
+  struct ReachingNewPC {
+    enum KindType {
+      None, ///< No call to newpc reaches the program point
+      Unique, ///< A single call to newpc reaches the program point
+      Ambiguous ///< Multiple calls to newpc reach the program point
+    };
+
+    ReachingNewPC() : Kind(None), Call(nullptr) { }
+    ReachingNewPC(llvm::CallInst *Call) : Kind(Unique), Call(Call) { }
+
+    void merge(const ReachingNewPC &Other) {
+      if (Other.Kind == None
+          || (Kind == Unique && Other.Kind == Unique && Call == Other.Call))
+        return;
+
+      if (Kind == None) {
+        *this = Other;
+      } else {
+        Kind = Ambiguous;
+        Call = nullptr;
+      }
+    }
+
+    KindType Kind;
+    llvm::CallInst *Call;
+  };
+
+  struct BlockInfo {
+    BlockInfo() : EntryKnown(false) { }
+
+    /// The calls to newpc in the basic block, in order
+    llvm::SmallVector<llvm::CallInst *, 4> NewPCs;
+
+    /// Whether Entry has already been computed
+    bool EntryKnown;
+
+    /// The call to newpc reaching the beginning of the basic block
+    ReachingNewPC Entry;
+  };
+
+private:
+  BlockInfo &info(llvm::BasicBlock *BB) const {
+    auto It = Blocks.find(BB);
+    if (It != Blocks.end())
+      return It->second;
+
+    BlockInfo &Result = Blocks[BB];
+    for (llvm::Instruction &I : *BB)
+      if (llvm::CallInst *Call = getNewPC(&I))
+        Result.NewPCs.push_back(Call);
+
+    return Result;
+  }
+
+  /// \brief Compute the call to `newpc` reaching the entry of \p BB
+  ///
+  /// Goes backward through the predecessors until a call to `newpc` is met,
+  /// reusing the results for the basic blocks already handled.
+  ReachingNewPC entry(llvm::BasicBlock *BB) const {
+    BlockInfo &Info = info(BB);
+    if (Info.EntryKnown)
+      return Info.Entry;
+
+    ReachingNewPC Result;
+    llvm::SmallPtrSet<llvm::BasicBlock *, 16> Visited;
+    llvm::SmallVector<llvm::BasicBlock *, 16> WorkList;
+    WorkList.append(pred_begin(BB), pred_end(BB));
+
+    while (!WorkList.empty() && Result.Kind != ReachingNewPC::Ambiguous) {
+      llvm::BasicBlock *Predecessor = WorkList.pop_back_val();
+
+      // Ignore already visited or empty basic blocks
+      if (Predecessor->empty() || !Visited.insert(Predecessor).second)
+        continue;
+
+      // We should never reach the almighty dispatcher, if it happens, give up
+      if (Predecessor == Dispatcher) {
+        Result.Kind = ReachingNewPC::Ambiguous;
+        break;
+      }
+
+      const BlockInfo &PredecessorInfo = info(Predecessor);
+      if (!PredecessorInfo.NewPCs.empty())
+        Result.merge(ReachingNewPC(PredecessorInfo.NewPCs.back()));
+      else if (PredecessorInfo.EntryKnown)
+        Result.merge(PredecessorInfo.Entry);
+      else
+        WorkList.append(pred_begin(Predecessor), pred_end(Predecessor));
+    }
+
+    Info.Entry = Result;
+    Info.EntryKnown = true;
+    return Result;
+  }
+
+private:
+  llvm::Function *NewPCMarker;
+  llvm::BasicBlock *Dispatcher;
+
+  // Note: std::map never moves its elements when inserting
+  mutable std::map<llvm::BasicBlock *, BlockInfo> Blocks;
+};
+
+#endif // _PCINDEX_H
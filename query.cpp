@@ -0,0 +1,158 @@
+/// \file query.cpp
+/// \brief Standalone program to query a `revamb-dump --serve` instance
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Local includes
+#include "argparse.h"
+
+struct ProgramParameters {
+  const char *SocketPath;
+  std::string Query;
+};
+
+static const char *const Usage[] = {
+  "revamb-query [options] SOCKET [QUERY...]",
+  nullptr,
+};
+
+static bool parseArgs(int Argc, const char *Argv[], ProgramParameters &Result) {
+  // Initialize argument parser
+  struct argparse Arguments;
+  struct argparse_option Options[] = {
+    OPT_HELP(),
+    OPT_END(),
+  };
+
+  argparse_init(&Arguments, Options, Usage, ARGPARSE_STOP_AT_NON_OPTION);
+  argparse_describe(&Arguments, "\nrevamb-query.",
+                    "\nSend a query to a server started with "
+                    "`revamb-dump --serve SOCKET` and print the answer. If no "
+                    "query is specified, send each line read from the "
+                    "standard input.\n");
+  Argc = argparse_parse(&Arguments, Argc, Argv);
+
+  // Handle positional arguments
+  if (Argc < 1) {
+    fprintf(stderr, "Please specify the path of the socket.\n");
+    return false;
+  }
+
+  Result.SocketPath = Argv[0];
+
+  // The rest of the arguments form a single query
+  for (int I = 1; I < Argc; I++) {
+    if (I != 1)
+      Result.Query += " ";
+    Result.Query += Argv[I];
+  }
+
+  return true;
+}
+
+static int connectTo(const char *Path) {
+  sockaddr_un Address;
+  if (strlen(Path) >= sizeof(Address.sun_path)) {
+    fprintf(stderr, "The socket path \"%s\" is too long.\n", Path);
+    return -1;
+  }
+
+  memset(&Address, 0, sizeof(Address));
+  Address.sun_family = AF_UNIX;
+  strcpy(Address.sun_path, Path);
+
+  int Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Socket == -1) {
+    perror("socket");
+    return -1;
+  }
+
+  auto *GenericAddress = reinterpret_cast<sockaddr *>(&Address);
+  if (connect(Socket, GenericAddress, sizeof(Address)) != 0) {
+    perror("Couldn't connect to the server");
+    close(Socket);
+    return -1;
+  }
+
+  return Socket;
+}
+
+/// \brief Send \p Query on \p Socket and print the answer on stdout
+///
+/// \param Buffer data received but not consumed yet, preserved across calls.
+static bool query(int Socket, const std::string &Query, std::string &Buffer) {
+  std::string Request = Query + "\n";
+  const char *Data = Request.data();
+  size_t Left = Request.size();
+  while (Left != 0) {
+    ssize_t Written = send(Socket, Data, Left, MSG_NOSIGNAL);
+    if (Written < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("send");
+      return false;
+    }
+    Data += Written;
+    Left -= Written;
+  }
+
+  // Each answer is a single line
+  char Chunk[4096];
+  size_t End;
+  while ((End = Buffer.find('\n')) == std::string::npos) {
+    ssize_t Size = read(Socket, Chunk, sizeof(Chunk));
+    if (Size < 0 && errno == EINTR)
+      continue;
+
+    if (Size <= 0) {
+      fprintf(stderr, "The server closed the connection.\n");
+      return false;
+    }
+
+    Buffer.append(Chunk, Size);
+  }
+
+  std::cout.write(Buffer.data(), End + 1);
+  Buffer.erase(0, End + 1);
+  return true;
+}
+
+int main(int argc, const char *argv[]) {
+  ProgramParameters Parameters;
+  Parameters.SocketPath = nullptr;
+
+  if (!parseArgs(argc, argv, Parameters))
+    return EXIT_FAILURE;
+
+  int Socket = connectTo(Parameters.SocketPath);
+  if (Socket == -1)
+    return EXIT_FAILURE;
+
+  bool Success = true;
+  std::string Buffer;
+  if (!Parameters.Query.empty()) {
+    Success = query(Socket, Parameters.Query, Buffer);
+  } else {
+    std::string Line;
+    while (Success && std::getline(std::cin, Line))
+      if (!Line.empty())
+        Success = query(Socket, Line, Buffer);
+  }
+
+  std::cout.flush();
+  close(Socket);
+  return Success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,377 @@
+/// \file queryserver.cpp
+/// \brief Implementation of the server answering queries about a module
+///        generated by revamb
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// LLVM includes
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueSymbolTable.h"
+
+// Local includes
+#include "ir-helpers.h"
+#include "queryserver.h"
+
+using namespace llvm;
+
+/// \brief Return \p String as a JSON string literal
+static std::string quote(StringRef String) {
+  std::string Result = "\"";
+  for (char C : String) {
+    switch (C) {
+    case '"':
+      Result += "\\\"";
+      break;
+    case '\\':
+      Result += "\\\\";
+      break;
+    default:
+      if (static_cast<unsigned char>(C) < 0x20) {
+        char Escaped[7];
+        snprintf(Escaped, sizeof(Escaped), "\\u%04x", C);
+        Result += Escaped;
+      } else {
+        Result += C;
+      }
+    }
+  }
+  Result += "\"";
+  return Result;
+}
+
+static std::string quote(const BasicBlock *BB) {
+  return quote(BB->getName());
+}
+
+/// \brief Return \p Address as a JSON string containing its hexadecimal
+///        representation
+///
+/// Addresses are not emitted as JSON numbers since many JSON parsers can't
+/// represent 64-bit integers exactly.
+static std::string quoteAddress(uint64_t Address) {
+  std::stringstream Stream;
+  Stream << "\"0x" << std::hex << Address << "\"";
+  return Stream.str();
+}
+
+static std::string error(const Twine &Message) {
+  return "{\"error\":" + quote(Message.str()) + "}";
+}
+
+/// \brief Write all of \p Data on \p Socket
+static bool writeAll(int Socket, StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t Written = send(Socket, Data.data(), Data.size(), MSG_NOSIGNAL);
+    if (Written < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("send");
+      return false;
+    }
+
+    Data = Data.drop_front(Written);
+  }
+
+  return true;
+}
+
+QueryServer::QueryServer(Function &F) : F(F),
+                                        ShutdownRequested(false),
+                                        InstructionsReady(false) { }
+
+bool QueryServer::serve(const char *Path) {
+  sockaddr_un Address;
+  if (strlen(Path) >= sizeof(Address.sun_path)) {
+    fprintf(stderr, "The socket path \"%s\" is too long.\n", Path);
+    return false;
+  }
+
+  memset(&Address, 0, sizeof(Address));
+  Address.sun_family = AF_UNIX;
+  strcpy(Address.sun_path, Path);
+
+  // Remove a socket left behind by a previous instance, but nothing else
+  struct stat Stat;
+  if (lstat(Path, &Stat) == 0 && S_ISSOCK(Stat.st_mode))
+    unlink(Path);
+
+  int Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Socket == -1) {
+    perror("socket");
+    return false;
+  }
+
+  auto *GenericAddress = reinterpret_cast<sockaddr *>(&Address);
+  if (bind(Socket, GenericAddress, sizeof(Address)) != 0
+      || listen(Socket, 8) != 0) {
+    perror("Couldn't listen on the socket");
+    close(Socket);
+    return false;
+  }
+
+  bool Result = true;
+  while (!ShutdownRequested) {
+    int Connection = accept(Socket, nullptr, nullptr);
+    if (Connection == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("accept");
+      Result = false;
+      break;
+    }
+
+    // A failure on a single connection doesn't affect the others
+    serveConnection(Connection);
+    close(Connection);
+  }
+
+  close(Socket);
+  unlink(Path);
+  return Result;
+}
+
+bool QueryServer::serveConnection(int Connection) {
+  std::string Buffer;
+  char Chunk[4096];
+
+  while (!ShutdownRequested) {
+    ssize_t Size = read(Connection, Chunk, sizeof(Chunk));
+    if (Size == 0)
+      return true;
+
+    if (Size < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("read");
+      return false;
+    }
+
+    Buffer.append(Chunk, Size);
+
+    // Answer all the complete queries received so far
+    size_t Start = 0;
+    size_t End;
+    while (!ShutdownRequested
+           && (End = Buffer.find('\n', Start)) != std::string::npos) {
+      StringRef Query(Buffer.data() + Start, End - Start);
+      if (!writeAll(Connection, answer(Query.trim()) + "\n"))
+        return false;
+      Start = End + 1;
+    }
+
+    Buffer.erase(0, Start);
+  }
+
+  return true;
+}
+
+std::string QueryServer::answer(StringRef Query) {
+  SmallVector<StringRef, 4> Words;
+  Query.split(Words, " ", -1, false);
+
+  if (Words.empty())
+    return error("Empty query");
+
+  StringRef Command = Words[0];
+  ArrayRef<StringRef> Arguments = makeArrayRef(Words).drop_front();
+
+  auto ExpectArguments = [&Arguments] (unsigned Count) {
+    return Arguments.size() == Count;
+  };
+
+  if (Command == "shutdown") {
+    ShutdownRequested = true;
+    return "{\"shutdown\":true}";
+  }
+
+  if (Command == "block") {
+    uint64_t PC;
+    if (!ExpectArguments(1) || Arguments[0].getAsInteger(0, PC))
+      return error("Usage: block PC");
+
+    auto It = findInstruction(PC);
+    if (It == instructions().end())
+      return error("No instruction at " + Arguments[0]);
+
+    return "{\"block\":" + quote(It->second.BB)
+      + ",\"pc\":" + quoteAddress(It->first)
+      + ",\"size\":" + std::to_string(It->second.Size) + "}";
+  }
+
+  if (Command == "cfg") {
+    uint64_t Start, End;
+    if (!ExpectArguments(2)
+        || Arguments[0].getAsInteger(0, Start)
+        || Arguments[1].getAsInteger(0, End))
+      return error("Usage: cfg START END");
+
+    std::string Result = "{\"edges\":[";
+    bool First = true;
+    auto It = instructions().lower_bound(Start);
+    for (; It != instructions().end() && It->first < End; It++) {
+      if (!It->second.Starts)
+        continue;
+
+      BasicBlock *Source = It->second.BB;
+      for (BasicBlock *Destination : cfg().successorsOf(Source)) {
+        if (!First)
+          Result += ",";
+        First = false;
+        Result += "[" + quote(Source) + "," + quote(Destination) + "]";
+      }
+    }
+    Result += "]}";
+    return Result;
+  }
+
+  // All the other queries take a basic block as argument
+  if (Command != "successors" && Command != "function" && Command != "noreturn")
+    return error("Unknown query \"" + Command + "\"");
+
+  if (!ExpectArguments(1))
+    return error("Usage: " + Command + " BLOCK");
+
+  BasicBlock *BB = resolveBlock(Arguments[0]);
+  if (BB == nullptr)
+    return error("Unknown basic block " + Arguments[0]);
+
+  std::string Result = "{\"block\":" + quote(BB) + ",";
+
+  if (Command == "successors") {
+    Result += "\"successors\":[";
+    bool First = true;
+    for (BasicBlock *Successor : cfg().successorsOf(BB)) {
+      if (!First)
+        Result += ",";
+      First = false;
+      Result += quote(Successor);
+    }
+    Result += "]";
+  } else if (Command == "function") {
+    Result += "\"functions\":[";
+    bool First = true;
+    for (StringRef Function : functionsOf(BB)) {
+      if (!First)
+        Result += ",";
+      First = false;
+      Result += quote(Function);
+    }
+    Result += "]";
+  } else {
+    Result += "\"noreturn\":";
+    Result += noreturn().isNoreturn(BB) ? "true" : "false";
+  }
+
+  Result += "}";
+  return Result;
+}
+
+const QueryServer::InstructionsMap &QueryServer::instructions() {
+  if (InstructionsReady)
+    return Instructions;
+
+  Function *NewPC = F.getParent()->getFunction("newpc");
+  if (NewPC != nullptr) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        auto *Call = dyn_cast<CallInst>(&I);
+        if (Call == nullptr || Call->getCalledFunction() != NewPC)
+          continue;
+
+        uint64_t PC = getLimitedValue(Call->getArgOperand(0));
+        uint64_t Size = getLimitedValue(Call->getArgOperand(1));
+        bool Starts = &I == &*BB.begin();
+
+        // In case the same instruction has been translated more than once,
+        // prefer the copy starting a basic block, i.e., a node of the CFG
+        auto It = Instructions.find(PC);
+        if (It == Instructions.end() || (Starts && !It->second.Starts))
+          Instructions[PC] = InstructionInfo { Size, &BB, Starts };
+      }
+    }
+  }
+
+  InstructionsReady = true;
+  return Instructions;
+}
+
+QueryServer::InstructionsMap::const_iterator
+QueryServer::findInstruction(uint64_t PC) {
+  const InstructionsMap &Map = instructions();
+
+  // Find the last instruction starting at or before PC
+  auto It = Map.upper_bound(PC);
+  if (It == Map.begin())
+    return Map.end();
+  It--;
+
+  if (PC - It->first >= It->second.Size)
+    return Map.end();
+
+  return It;
+}
+
+BasicBlock *QueryServer::resolveBlock(StringRef Argument) {
+  uint64_t PC;
+  if (!Argument.getAsInteger(0, PC)) {
+    auto It = findInstruction(PC);
+    if (It == instructions().end())
+      return nullptr;
+    return It->second.BB;
+  }
+
+  return dyn_cast_or_null<BasicBlock>(F.getValueSymbolTable().lookup(Argument));
+}
+
+CollectCFG &QueryServer::cfg() {
+  if (!CFG) {
+    CFG.reset(new CollectCFG());
+    CFG->runOnFunction(F);
+  }
+
+  return *CFG;
+}
+
+CollectNoreturn &QueryServer::noreturn() {
+  if (!Noreturn) {
+    Noreturn.reset(new CollectNoreturn());
+    Noreturn->runOnFunction(F);
+  }
+
+  return *Noreturn;
+}
+
+const std::vector<StringRef> &QueryServer::functionsOf(BasicBlock *BB) {
+  if (!FunctionBoundaries) {
+    FunctionBoundaries.reset(new CollectFunctionBoundaries());
+    FunctionBoundaries->runOnFunction(F);
+
+    for (auto &P : FunctionBoundaries->functions())
+      for (BasicBlock *Member : P.second)
+        Membership[Member].push_back(P.first);
+  }
+
+  static const std::vector<StringRef> None;
+  auto It = Membership.find(BB);
+  if (It == Membership.end())
+    return None;
+
+  return It->second;
+}
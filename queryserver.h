@@ -0,0 +1,95 @@
+#ifndef _QUERYSERVER_H
+#define _QUERYSERVER_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// LLVM includes
+#include "llvm/ADT/StringRef.h"
+
+// Local includes
+#include "collectcfg.h"
+#include "collectfunctionboundaries.h"
+#include "collectnoreturn.h"
+
+namespace llvm {
+class BasicBlock;
+class Function;
+}
+
+/// \brief Answers queries about a module generated by revamb
+///
+/// The module is loaded once and the analyses are run lazily, the first time
+/// a query needs them, and then kept around. Queries and answers are single
+/// lines of text: a query is a command followed by its arguments, separated by
+/// spaces, the answer is a JSON object. The following queries are supported:
+///
+/// * `block PC`: the basic block containing the instruction at `PC`.
+/// * `successors BLOCK`: the successors of `BLOCK` in the CFG.
+/// * `function BLOCK`: the functions `BLOCK` belongs to.
+/// * `noreturn BLOCK`: whether `BLOCK` has been marked as noreturn.
+/// * `cfg START END`: the edges of the CFG leaving the basic blocks starting at
+///   an address in [`START`, `END`).
+/// * `shutdown`: stop the server.
+///
+/// `BLOCK` can be either the name of a basic block or an address, in which
+/// case it refers to the basic block containing the instruction at that
+/// address. Basic blocks and edges are the same produced by `revamb-dump`.
+class QueryServer {
+public:
+  QueryServer(llvm::Function &F);
+
+  /// \brief Listen on the Unix domain socket \p Path and serve the incoming
+  ///        connections, one at a time, until a `shutdown` query is received
+  ///
+  /// \return true if the server has been shut down, false in case of error.
+  bool serve(const char *Path);
+
+  /// \brief Return the JSON answer to \p Query, without the final new line
+  std::string answer(llvm::StringRef Query);
+
+private:
+  /// \brief An input instruction, as described by a call to `newpc`
+  struct InstructionInfo {
+    uint64_t Size;
+    /// The basic block containing the call to `newpc`
+    llvm::BasicBlock *BB;
+    /// Whether the call to `newpc` is the first instruction of BB
+    bool Starts;
+  };
+
+  using InstructionsMap = std::map<uint64_t, InstructionInfo>;
+
+private:
+  bool serveConnection(int Connection);
+
+  const InstructionsMap &instructions();
+  InstructionsMap::const_iterator findInstruction(uint64_t PC);
+  llvm::BasicBlock *resolveBlock(llvm::StringRef Argument);
+
+  CollectCFG &cfg();
+  CollectNoreturn &noreturn();
+  const std::vector<llvm::StringRef> &functionsOf(llvm::BasicBlock *BB);
+
+private:
+  llvm::Function &F;
+  bool ShutdownRequested;
+
+  bool InstructionsReady;
+  InstructionsMap Instructions;
+
+  std::unique_ptr<CollectCFG> CFG;
+  std::unique_ptr<CollectNoreturn> Noreturn;
+  std::unique_ptr<CollectFunctionBoundaries> FunctionBoundaries;
+  std::map<llvm::BasicBlock *, std::vector<llvm::StringRef>> Membership;
+};
+
+#endif // _QUERYSERVER_H
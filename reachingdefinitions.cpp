@@ -23,6 +23,7 @@
 #include "llvm/Support/Casting.h"
 
 // Local includes
+#include "cfgview.h"
 #include "datastructures.h"
 #include "debug.h"
 #include "functioncallidentification.h"
@@ -390,76 +391,6 @@ static bool pushIfAbsent(C &Container, T Element) {
   return Result;
 }
 
-/// \brief Support class for easily adding edges on the CFG using switch
-///        instructions.
-///
-/// FakeSwitch creates a SwitchInst to which the user can easily add cases,
-/// without caring about the label value. Moreover, FakeSwitch automatically
-/// backups and replaces the terminator instruction, if present, adds its
-/// successors to the switch, and, when restore is called, restore it.
-class FakeSwitch {
-public:
-  FakeSwitch(BasicBlock *Target, unsigned NumCases) :
-    Target(Target), SavedTerminator(nullptr), Switch(nullptr),
-    Ty(IntegerType::get(getContext(Target), 32)), NumCases(NumCases) {
-
-    SavedTerminator = Target->getTerminator();
-    if (SavedTerminator != nullptr)
-      this->NumCases += SavedTerminator->getNumSuccessors();
-
-  }
-
-  void add(BasicBlock *New) {
-    // Is this the first basic block being added? If so, create the switch and
-    // detach the old terminator instruction.
-    if (Switch == nullptr) {
-      // Create the switch statement and append it to the basic block
-      Switch = SwitchInst::Create(ConstantInt::get(Ty, 0),
-                                  New,
-                                  NumCases,
-                                  Target);
-
-      // If there was a terminator save it and add all its successors to the
-      // switch
-      if (SavedTerminator != nullptr) {
-        SavedTerminator->removeFromParent();
-        for (BasicBlock *Successor : SavedTerminator->successors()) {
-          // Note: this will never cause infinite recursion since we just
-          // initialized the Switch field
-          add(Successor);
-        }
-      }
-
-    }
-
-    // Add the requested basic block
-    Switch->addCase(ConstantInt::get(Ty, Switch->getNumCases() + 1), New);
-  }
-
-  void restore() {
-    // Check if we ever did anything
-    if (Switch == nullptr)
-      return;
-
-    // We no longer need the switch
-    Switch->eraseFromParent();
-
-    // Restore the old terminator
-    if (SavedTerminator != nullptr) {
-      Target->getInstList().push_back(SavedTerminator);
-      assert(Target->getTerminator() == SavedTerminator);
-    }
-
-  }
-
-private:
-  BasicBlock *Target;
-  TerminatorInst *SavedTerminator;
-  SwitchInst *Switch;
-  IntegerType *Ty;
-  unsigned NumCases;
-};
-
 bool ConditionNumberingPass::runOnFunction(Function &F) {
 
   DBG("passes", { dbg << "Starting ConditionNumberingPass\n"; });
@@ -486,6 +417,10 @@ bool ConditionNumberingPass::runOnFunction(Function &F) {
   using BB = BasicBlock;
   std::vector<BasicBlock *> CommonPredecessors;
 
+  // The common predecessors are not part of the function, they only live in
+  // this view of its CFG
+  CFGView View(F, CFGView::currentForm());
+
   // Debugging purposes only
   std::map<uint32_t, SmallVector<BasicBlock *, 2>> ResettingBasicBlocks;
 
@@ -496,15 +431,12 @@ bool ConditionNumberingPass::runOnFunction(Function &F) {
       // value
       ConditionIndex++;
 
-      // Create the common predecessor and register it
-      auto *CommonPredecessor = BB::Create(C, "cp" + Twine(ConditionIndex), &F);
+      // Create the common predecessor, outside of the function, and register
+      // it
+      auto *CommonPredecessor = BB::Create(C, "cp" + Twine(ConditionIndex));
+      new UnreachableInst(C, CommonPredecessor);
       CommonPredecessors.push_back(CommonPredecessor);
 
-      // Create the fake switch which will create the edges from the common
-      // predecessor to all the basic blocks containing the branches associated
-      // with this condition
-      FakeSwitch Switch(CommonPredecessor, P.second.size());
-
       for (BranchInst *B : P.second) {
         // Build the branch -> condition index mapping
         BranchConditionNumberMap[B] = ConditionIndex;
@@ -521,7 +453,7 @@ bool ConditionNumberingPass::runOnFunction(Function &F) {
         }
 
         // Add an edge from the common predecessor to this basic block
-        Switch.add(B->getParent());
+        View.addEdge(CommonPredecessor, B->getParent());
       }
 
       DBG("cnp",
@@ -546,13 +478,12 @@ bool ConditionNumberingPass::runOnFunction(Function &F) {
 
   // Make each common predecessor reachable from the entry point, so that the
   // PDT can take them into account.
-  FakeSwitch EntrySwitch(&F.getEntryBlock(), CommonPredecessors.size());
   for (BasicBlock *CommonPredecessor : CommonPredecessors)
-    EntrySwitch.add(CommonPredecessor);
+    View.addEdge(&F.getEntryBlock(), CommonPredecessor);
 
   // Compute the post-dominator tree
-  DominatorTreeBase<BasicBlock> PDT(true);
-  PDT.recalculate(F);
+  DominatorTreeBase<CFGView::Node> PDT(true);
+  PDT.recalculate(View);
 
   // Get the immediate post-dominator of each temporary basic block and then
   // delete it
@@ -561,7 +492,7 @@ bool ConditionNumberingPass::runOnFunction(Function &F) {
 
     DBG("cnp", {
         dbg << "Condition index " << (I + 1) << " (";
-        for (BasicBlock *Successor : successors(CommonPredecessor))
+        for (BasicBlock *Successor : View.successors(CommonPredecessor))
           dbg << getName(Successor) << " ";
         dbg << ")";
 
@@ -571,20 +502,21 @@ bool ConditionNumberingPass::runOnFunction(Function &F) {
       });
 
     // Get the immediate post-dominator of the common predecessor
-    auto *PDTNode = PDT.getNode(CommonPredecessor);
+    auto *PDTNode = PDT.getNode(View.node(CommonPredecessor));
 
     // Check if it's reachable from the exit (i.e., it's not part of an infinite
     // loop).
     BasicBlock *ImmediatePostDominator = nullptr;
     // TODO: for some reason getBlock() might give nullptr, investigate
     if (PDTNode != nullptr)
-      ImmediatePostDominator = PDTNode->getIDom()->getBlock();
+      if (CFGView::Node *IDom = PDTNode->getIDom()->getBlock())
+        ImmediatePostDominator = IDom->block();
 
     if (ImmediatePostDominator != nullptr) {
 
       // Add the current ConditionIndex to those defined by it
       // Note: ConditionIndex 0 is reserved, so we add one
-      for (BasicBlock *Successor : successors(ImmediatePostDominator))
+      for (BasicBlock *Successor : View.successors(ImmediatePostDominator))
         pushIfAbsent(DefinedConditions[Successor], I + 1);
 
       DBG("cnp", {
@@ -597,12 +529,9 @@ bool ConditionNumberingPass::runOnFunction(Function &F) {
     }
   }
 
-  // Restore the entry block's terminator instruction
-  EntrySwitch.restore();
-
   // Delete all the common predecessor basic blocks, we no longer need them
   for (BasicBlock *CommonPredecessor : CommonPredecessors)
-    CommonPredecessor->eraseFromParent();
+    delete CommonPredecessor;
 
   DBG("passes", { dbg << "Ending ConditionNumberingPass\n"; });
   return false;
@@ -993,14 +922,12 @@ bool ReachingDefinitionsImplPass<BBI, R>::runOnFunction(Function &F) {
         dbg << "Starting ReachingDefinitionsPass\n";
     });
 
+  Function *NewPC = F.getParent()->getFunction("newpc");
   for (auto &BB : F) {
     if (!BB.empty()) {
-      if (auto *Call = dyn_cast<CallInst>(&*BB.begin())) {
-        Function *Callee = Call->getCalledFunction();
-        // TODO: comparing with "newpc" string is sad
-        if (Callee != nullptr && Callee->getName() == "newpc")
+      if (auto *Call = dyn_cast<CallInst>(&*BB.begin()))
+        if (NewPC != nullptr && Call->getCalledFunction() == NewPC)
           break;
-      }
     }
     BasicBlockBlackList.insert(&BB);
   }
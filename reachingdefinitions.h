@@ -272,13 +272,13 @@ private:
   using BasicBlock = llvm::BasicBlock;
   using LoadInst = llvm::LoadInst;
   using Instruction = llvm::Instruction;
-  std::map<BasicBlock *, BBI> DefinitionsMap;
-  std::set<BasicBlock *> BasicBlockBlackList;
+  ArenaMap<BasicBlock *, BBI> DefinitionsMap;
+  ArenaSet<BasicBlock *> BasicBlockBlackList;
   std::set<LoadInst *> NRDLoads;
   std::set<LoadInst *> SelfReachingLoads;
-  std::map<const Instruction *, std::vector<LoadInst *>> ReachedLoads;
-  std::map<const LoadInst *, std::vector<Instruction *>> ReachingDefinitions;
-  std::map<const LoadInst *, unsigned>  ReachingDefinitionsCount;
+  ArenaMap<const Instruction *, std::vector<LoadInst *>> ReachedLoads;
+  ArenaMap<const LoadInst *, std::vector<Instruction *>> ReachingDefinitions;
+  ArenaMap<const LoadInst *, unsigned>  ReachingDefinitionsCount;
 };
 
 /// The ConditionNumberingPass loops over all the conditional branch
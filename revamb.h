@@ -29,6 +29,18 @@ enum class DebugInfoType {
   LLVMIR ///< produce an LLVM IR with debug metadata referring to itself.
 };
 
+/// \brief Limits to the resources the exploration of the input program can use
+///
+/// A limit set to 0 is not enforced. When a limit is exceeded, the exploration
+/// stops and what has been translated so far is emitted.
+struct ExplorationBudget {
+  unsigned MaxSeconds = 0; ///< Wall-clock time spent exploring
+  uint64_t MaxRSS = 0; ///< Peak resident set size of the process, in KiB
+  unsigned MaxHarvestRounds = 0; ///< Rounds of analyses (SET and OSRA) run
+                                 ///  looking for new jump targets
+  size_t MaxJumpTargets = 0; ///< Jump targets registered
+};
+
 // TODO: move me to another header file
 /// \brief Classification of the various basic blocks we are creating
 enum BlockType {
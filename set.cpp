@@ -17,6 +17,7 @@
 #include "llvm/IR/Module.h"
 
 // Local includes
+#include "cfgview.h"
 #include "datastructures.h"
 #include "debug.h"
 #include "revamb.h"
@@ -50,8 +51,8 @@ public:
     reset();
   }
 
-  void explore(Constant *NewOperand);
-  uint64_t materialize(Constant *NewOperand);
+  void explore(const APInt &NewOperand);
+  uint64_t materialize(APInt NewOperand);
 
   /// \brief What values should be tracked
   enum TrackingType {
@@ -192,9 +193,9 @@ private:
   const DataLayout &DL;
 
   std::vector<Instruction *> Operations;
-  std::set<Instruction *> OperationsSet;
-  std::set<std::pair<uint64_t, bool>> NewPCs;
-  std::set<uint64_t> TrackedValues;
+  ArenaSet<Instruction *> OperationsSet;
+  ArenaSet<std::pair<uint64_t, bool>> NewPCs;
+  ArenaSet<uint64_t> TrackedValues;
 
   bool Approximate;
   TrackingType Tracking;
@@ -205,89 +206,87 @@ private:
   Instruction *Target;
 };
 
-uint64_t OperationsStack::materialize(Constant *NewOperand) {
+uint64_t OperationsStack::materialize(APInt NewOperand) {
+  // Note: we work on plain integers instead of Constants, since each Constant
+  //       would be uniqued by the LLVMContext and kept alive until the end of
+  //       the translation, while most of the values computed here are just
+  //       speculative and will be thrown away
   for (Instruction *I : make_range(Operations.rbegin(), Operations.rend())) {
     if (auto *Load = dyn_cast<LoadInst>(I)) {
       // OK, we've got a load, let's see if the load address is
       // constant
-      assert(NewOperand != nullptr && !isa<UndefValue>(NewOperand));
 
       // Read the value using the endianess of the destination architecture,
       // since, if there's a mismatch, in the stack we will also have a byteswap
       // instruction
       JumpTargetManager::Endianess E = JumpTargetManager::DestinationEndianess;
+      unsigned Size = 0;
       if (Load->getType()->isIntegerTy()) {
-        unsigned Size = Load->getType()->getPrimitiveSizeInBits() / 8;
-        assert(Size != 0);
-        NewOperand = JTM->readConstantInt(NewOperand, Size, E);
+        Size = Load->getType()->getPrimitiveSizeInBits() / 8;
       } else if (Load->getType()->isPointerTy()) {
-        NewOperand = JTM->readConstantPointer(NewOperand, Load->getType(), E);
+        Size = JTM->pointerSize() / 8;
       } else {
         assert(false);
       }
+      assert(Size != 0);
 
-      if (NewOperand == nullptr)
-        break;
+      uint64_t Address = NewOperand.getLimitedValue();
+      auto Result = JTM->readInteger(Address, Size, E);
+      if (!Result.hasValue())
+        return 0;
+
+      NewOperand = APInt(Size * 8, Result.getValue());
 
     } else if (auto *Call = dyn_cast<CallInst>(I)) {
       Function *Callee = Call->getCalledFunction();
       assert(Callee != nullptr && Callee->getIntrinsicID() == Intrinsic::bswap);
       (void) Callee;
 
-      uint64_t Value = NewOperand->getUniqueInteger().getLimitedValue();
-
-      Type *T = NewOperand->getType();
-      if (T->isIntegerTy(16))
-        Value = ByteSwap_16(Value);
-      else if (T->isIntegerTy(32))
-        Value = ByteSwap_32(Value);
-      else if (T->isIntegerTy(64))
-        Value = ByteSwap_64(Value);
-      else
+      unsigned Width = NewOperand.getBitWidth();
+      if (Width != 16 && Width != 32 && Width != 64)
         llvm_unreachable("Unexpected type");
 
-      NewOperand = ConstantInt::get(T, Value);
+      NewOperand = NewOperand.byteSwap();
     } else {
-      // Replace non-const operand with NewOperand
-      std::vector<Constant *> Operands;
-      bool NonConstFound = false;
-      (void) NonConstFound;
-
-      for (Value *Op : I->operand_values()) {
-        if (auto *Const = dyn_cast<Constant>(Op)) {
-          Operands.push_back(Const);
-        } else {
-          assert(!NonConstFound);
-          NonConstFound = true;
-          NewOperand = ConstantExpr::getTruncOrBitCast(NewOperand,
-                                                       Op->getType());
-          Operands.push_back(NewOperand);
-        }
+      // Only integers and pointers can be computed here
+      Type *ResultType = I->getType();
+      if (!ResultType->isIntegerTy() && !ResultType->isPointerTy())
+        return 0;
+
+      Optional<APInt> Result;
+      if (I->getNumOperands() == 1) {
+        unsigned Width = DL.getTypeSizeInBits(ResultType);
+        Result = foldCast(I->getOpcode(), NewOperand, Width);
+      } else {
+        // Replace the non-const operand with NewOperand
+        assert(I->getNumOperands() == 2);
+        bool IsFirstConstant = isa<Constant>(I->getOperand(0));
+        Value *ConstOp = I->getOperand(IsFirstConstant ? 0 : 1);
+        auto *Known = dyn_cast<ConstantInt>(ConstOp);
+        if (Known == nullptr)
+          return 0;
+
+        const APInt &KnownValue = Known->getValue();
+        APInt FreeValue = NewOperand.zextOrTrunc(KnownValue.getBitWidth());
+        if (IsFirstConstant)
+          Result = foldBinaryOperator(I->getOpcode(), KnownValue, FreeValue);
+        else
+          Result = foldBinaryOperator(I->getOpcode(), FreeValue, KnownValue);
       }
 
-      NewOperand = ConstantFoldInstOperands(I->getOpcode(),
-                                            I->getType(),
-                                            Operands,
-                                            DL);
-      assert(NewOperand != nullptr);
       // TODO: this is an hack hiding a bigger problem
-      if (isa<UndefValue>(NewOperand)) {
-        NewOperand = nullptr;
-        break;
-      }
+      if (!Result.hasValue())
+        return 0;
+
+      NewOperand = Result.getValue();
     }
   }
 
   // We made it, mark the value to be explored
-  if (NewOperand != nullptr) {
-    assert(!isa<UndefValue>(NewOperand));
-    return getZExtValue(NewOperand, DL);
-  }
-
-  return 0;
+  return NewOperand.getLimitedValue();
 }
 
-void OperationsStack::explore(Constant *NewOperand) {
+void OperationsStack::explore(const APInt &NewOperand) {
   uint64_t PC = materialize(NewOperand);
 
   if (PC != 0 && JTM->isPC(PC))
@@ -311,6 +310,7 @@ class SET {
 
 public:
   SET(Function &F,
+      CFGView &View,
       JumpTargetManager *JTM,
       OSRAPass *OSRA,
       std::set<BasicBlock *> *Visited,
@@ -319,6 +319,7 @@ public:
     JTM(JTM),
     OS(JTM, DL),
     F(F),
+    View(View),
     OSRA(OSRA),
     Visited(Visited),
     Jumps(Jumps) { }
@@ -347,6 +348,7 @@ private:
   JumpTargetManager *JTM;
   OperationsStack OS;
   Function& F;
+  CFGView &View;
   OSRAPass *OSRA;
   std::set<BasicBlock *> *Visited;
   std::vector<std::pair<Value *, unsigned>> WorkList;
@@ -407,7 +409,7 @@ bool SET::enqueueStores(LoadInst *Start) {
       if (Depth >= MaxDepth) {
         Handled = false;
       } else {
-        for (BasicBlock *Predecessor : predecessors(BB)) {
+        for (BasicBlock *Predecessor : View.predecessors(BB)) {
           // Skip if the predecessor is the dispatcher
           if (!JTM->isTranslatedBB(Predecessor)) {
             Handled = false;
@@ -509,7 +511,13 @@ bool SETPass::runOnFunction(Function &F) {
     JTM->noReturn().collectDefinitions(CRDP);
   }
 
-  SET SimpleExpressionTracker(F, JTM, OSRA, Visited, Jumps);
+  // Use the form of the CFG chosen by the caller, if any
+  CFGView IRView(F);
+  CFGView *View = CFGView::current();
+  if (View == nullptr)
+    View = &IRView;
+
+  SET SimpleExpressionTracker(F, *View, JTM, OSRA, Visited, Jumps);
 
   DBG("passes", { dbg << "Ending SETPass\n"; });
   return SimpleExpressionTracker.run();
@@ -521,8 +529,6 @@ bool SET::handleInstructionWithOSRA(Instruction *Target, Value *V) {
   // We don't know how to proceed, but we can still check if the current
   // instruction is associated with a suitable OSR
   const OSRAPass::OSR *O = OSRA->getOSR(V);
-  using CI = ConstantInt;
-  Type *Int64 = IntegerType::get(F.getParent()->getContext(), 64);
 
   if (O == nullptr
       || O->boundedValue()->isTop()
@@ -530,7 +536,7 @@ bool SET::handleInstructionWithOSRA(Instruction *Target, Value *V) {
     return false;
   } else if (O->isConstant()) {
     // If it's just a single constant, use it
-    OS.explore(CI::get(Int64, O->constant()));
+    OS.explore(APInt(64, O->constant()));
   } else {
     // Hard limit
     if (O->size() >= 10000)
@@ -540,8 +546,8 @@ bool SET::handleInstructionWithOSRA(Instruction *Target, Value *V) {
 
     // Perform a preliminary check that whole range fits into the executable
     // area
-    Constant *MinConst, *MaxConst;
-    std::tie(MinConst, MaxConst) = O->boundaries(Int64, DL);
+    uint64_t Min, Max;
+    std::tie(Min, Max) = O->boundaries();
 
     // TODO: note that since we check if isExecutableRange, this part will never
     //       affect the noreturn syscalls detection
@@ -549,9 +555,9 @@ bool SET::handleInstructionWithOSRA(Instruction *Target, Value *V) {
     //       here is probably restore it to int64_t::max(), assert if it's
     //       larger than 10000 and only apply it to store to memory, pc and
     //       maybe other registers (lr?)
-    auto MaterializedMin = OS.materialize(MinConst);
-    auto MaterializedMax = OS.materialize(MaxConst);
-    auto MaterializedStep = OS.materialize(CI::get(Int64, O->factor()));
+    auto MaterializedMin = OS.materialize(APInt(64, Min));
+    auto MaterializedMax = OS.materialize(APInt(64, Max));
+    auto MaterializedStep = OS.materialize(APInt(64, O->factor()));
 
     if (OS.readsMemory()) {
       // If there's a load in the stack only check the first and last element
@@ -577,7 +583,7 @@ bool SET::handleInstructionWithOSRA(Instruction *Target, Value *V) {
     // Note: addition and comparison for equality are all sign-safe
     // operations, no need to use Constants in this case.
     for (uint64_t Address : O->bounds(OS.topType())) {
-      OS.explore(CI::get(Int64, Address));
+      OS.explore(APInt(64, Address));
     }
   }
 
@@ -594,7 +600,7 @@ Value *SET::handleInstruction(Instruction *Target, Value *V) {
 
   if (auto *C = dyn_cast<ConstantInt>(V)) {
     // We reached the end of the path, materialize the value
-    OS.explore(C);
+    OS.explore(C->getValue());
     return nullptr;
   }
 
@@ -625,7 +631,7 @@ Value *SET::handleInstruction(Instruction *Target, Value *V) {
 
       if (FreeOp == nullptr && ConstantOp != nullptr) {
         // The operation has been folded
-        OS.explore(ConstantOp);
+        OS.explore(getConstValue(ConstantOp, DL)->getValue());
         return nullptr;
       } else if (FreeOp != nullptr && ConstantOp != nullptr) {
         // We were able to identify a constant operand
@@ -226,6 +226,48 @@ void unknownPC() {
   abort();
 }
 
+void leftRegion() {
+  int arg;
+  const char *error = "Jump outside the translated region\n";
+  write(2, error, strlen(error));
+  for (arg = 0; arg < saved_argc; arg++) {
+    write(2, saved_argv[arg], strlen(saved_argv[arg]));
+    write(2, " ", 1);
+  }
+  write(2, "\n", 1);
+  abort();
+}
+
+#ifdef PROFILE
+
+// Dispatcher profiling support, requires the translated code to be produced
+// with revamb --profile-dispatcher
+static uint64_t dispatcher_hits = 0;
+
+void dispatcher_hit(void) {
+  dispatcher_hits++;
+}
+
+// If REVAMB_PROFILE_PATH contains a path, write the counters there
+static void dump_profile(void) {
+  char *profile_path = getenv("REVAMB_PROFILE_PATH");
+  if (profile_path == NULL || strlen(profile_path) == 0)
+    return;
+
+  FILE *profile = fopen(profile_path, "w");
+  assert(profile != NULL);
+  fprintf(profile, "dispatcher_hits,%llu\n",
+          (unsigned long long) dispatcher_hits);
+  fclose(profile);
+}
+
+#else
+
+static void dump_profile(void) {
+}
+
+#endif
+
 #ifdef TRACE
 
 // Execution tracing support
@@ -296,6 +338,7 @@ void flush_trace_buffer_signal_handler(int signal) {
 // This function is called by the syscall helpers in case of exit/exit_group
 void on_exit_syscall(void) {
   flush_trace_buffer();
+  dump_profile();
 }
 
 void newpc(uint64_t pc,
@@ -320,6 +363,7 @@ void init_tracing(void) {
 }
 
 void on_exit_syscall(void) {
+  dump_profile();
 }
 
 void newpc(uint64_t pc,
@@ -32,13 +32,45 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
     set_tests_properties(translate-${TEST_NAME}-${ARCH}
       PROPERTIES LABELS "analysis;translate;${TEST_NAME}-${ARCH}")
 
+    # Translate again running out of budget immediately, the exceeded limit
+    # must be recorded in the module
+    add_test(NAME translate-max-jump-targets-${TEST_NAME}-${ARCH}
+      COMMAND $<TARGET_FILE:revamb> --max-jump-targets 1 "${BINARY}" "${BINARY}.max-jump-targets.ll")
+    set_tests_properties(translate-max-jump-targets-${TEST_NAME}-${ARCH}
+      PROPERTIES LABELS "analysis;translate-max-jump-targets;${TEST_NAME}-${ARCH}")
+
+    add_test(NAME check-exploration-limit-${TEST_NAME}-${ARCH}
+      COMMAND sh -c "grep -q '^!revamb.exploration.limit = ' ${BINARY}.max-jump-targets.ll && grep -q '!{!\"max-jump-targets\"}' ${BINARY}.max-jump-targets.ll")
+    set_tests_properties(check-exploration-limit-${TEST_NAME}-${ARCH}
+      PROPERTIES DEPENDS translate-max-jump-targets-${TEST_NAME}-${ARCH}
+                 LABELS "analysis;check-exploration-limit;${TEST_NAME}-${ARCH}")
+
     # Extract all the information in a single shot
     add_test(NAME extract-info-${TEST_NAME}-${ARCH}
-      COMMAND $<TARGET_FILE:revamb-dump> --cfg "${BINARY}.cfg.csv" --noreturn "${BINARY}.noreturn.csv" --functions-boundaries "${BINARY}.functions-boundaries.csv" "${BINARY}.ll")
+      COMMAND $<TARGET_FILE:revamb-dump> --cfg "${BINARY}.cfg.csv" --noreturn "${BINARY}.noreturn.csv" --functions-boundaries "${BINARY}.functions-boundaries.csv" --binary "${BINARY}.dump" "${BINARY}.ll")
     set_tests_properties(extract-info-${TEST_NAME}-${ARCH}
       PROPERTIES DEPENDS translate-${TEST_NAME}-${ARCH}
                  LABELS "analysis;extract-info;${TEST_NAME}-${ARCH}")
 
+    # Convert the binary dump back to CSV, it must match the reference too
+    add_test(NAME convert-binary-dump-${TEST_NAME}-${ARCH}
+      COMMAND $<TARGET_FILE:revamb-dump-convert> --cfg "${BINARY}.from-binary.cfg.csv" --noreturn "${BINARY}.from-binary.noreturn.csv" --functions-boundaries "${BINARY}.from-binary.functions-boundaries.csv" "${BINARY}.dump")
+    set_tests_properties(convert-binary-dump-${TEST_NAME}-${ARCH}
+      PROPERTIES DEPENDS extract-info-${TEST_NAME}-${ARCH}
+                 LABELS "analysis;convert-binary-dump;${TEST_NAME}-${ARCH}")
+
+    # Query a revamb-dump server, its answers must match the extracted CSVs
+    add_test(NAME check-query-server-${TEST_NAME}-${ARCH}
+      COMMAND "${SRC}/check-query-server"
+        --revamb-dump $<TARGET_FILE:revamb-dump>
+        --revamb-query $<TARGET_FILE:revamb-query>
+        --cfg "${BINARY}.cfg.csv"
+        --noreturn "${BINARY}.noreturn.csv"
+        "${BINARY}.ll")
+    set_tests_properties(check-query-server-${TEST_NAME}-${ARCH}
+      PROPERTIES DEPENDS extract-info-${TEST_NAME}-${ARCH}
+                 LABELS "analysis;check-query-server;${TEST_NAME}-${ARCH}")
+
     foreach(OUTPUT_NAME ${OUTPUT_NAMES})
       set(REFERENCE_OUTPUT "${SRC}/${ARCH}/${TEST_NAME}${OUTPUT_SUFFIX_${OUTPUT_NAME}}")
       set(OUTPUT "${BINARY}${OUTPUT_SUFFIX_${OUTPUT_NAME}}")
@@ -49,6 +81,12 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
         set_tests_properties(check-${TEST_NAME}-${ARCH}-${OUTPUT_NAME}
           PROPERTIES DEPENDS extract-info-${TEST_NAME}-${ARCH}
                      LABELS "analysis;check-with-reference;${TEST_NAME};${ARCH};${OUTPUT_NAME};${TEST_NAME}-${ARCH}")
+
+        add_test(NAME check-binary-dump-${TEST_NAME}-${ARCH}-${OUTPUT_NAME}
+          COMMAND "${DIFF}" "${REFERENCE_OUTPUT}" "${BINARY}.from-binary${OUTPUT_SUFFIX_${OUTPUT_NAME}}")
+        set_tests_properties(check-binary-dump-${TEST_NAME}-${ARCH}-${OUTPUT_NAME}
+          PROPERTIES DEPENDS convert-binary-dump-${TEST_NAME}-${ARCH}
+                     LABELS "analysis;check-binary-dump;${TEST_NAME};${ARCH};${OUTPUT_NAME};${TEST_NAME}-${ARCH}")
       else()
         message(AUTHOR_WARNING "Can't find reference output ${REFERENCE_OUTPUT}")
       endif()
@@ -56,3 +94,31 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
 
   endforeach()
 endforeach()
+
+# Tests specific to x86-64 programs
+list(FIND SUPPORTED_ARCHITECTURES "x86_64" X86_64_INDEX)
+if(NOT X86_64_INDEX EQUAL -1)
+  # The first round of analyses translates the direct jumps of _start, finding
+  # _start.0x5. Its jump through the jump table would need another round, but
+  # _start.0x5 itself must be explored anyway.
+  set(BINARY "${INSTALL_DIR_x86_64}/bin/switch-jump-table")
+  add_test(NAME translate-max-harvest-rounds-switch-jump-table-x86_64
+    COMMAND $<TARGET_FILE:revamb> --debug-names --max-harvest-rounds 1 "${BINARY}" "${BINARY}.max-harvest-rounds.ll")
+  set_tests_properties(translate-max-harvest-rounds-switch-jump-table-x86_64
+    PROPERTIES LABELS "analysis;translate-max-harvest-rounds;switch-jump-table-x86_64")
+
+  add_test(NAME check-max-harvest-rounds-switch-jump-table-x86_64
+    COMMAND "${SRC}/check-explored" "${BINARY}.max-harvest-rounds.ll" max-harvest-rounds bb._start.0x5)
+  set_tests_properties(check-max-harvest-rounds-switch-jump-table-x86_64
+    PROPERTIES DEPENDS translate-max-harvest-rounds-switch-jump-table-x86_64
+               LABELS "analysis;check-max-harvest-rounds;switch-jump-table-x86_64")
+
+  # A function reachable only from the outside must be translated if it's a
+  # seed
+  register_for_compilation("x86_64" "seeds" "${SRC}/x86_64/seeds.S" "-nostdlib" BINARY)
+
+  add_test(NAME check-seeds-x86_64
+    COMMAND "${SRC}/check-seeds" $<TARGET_FILE:revamb> "${BINARY}" seeded "${BINARY}.seeds")
+  set_tests_properties(check-seeds-x86_64
+    PROPERTIES LABELS "analysis;check-seeds;seeds-x86_64")
+endif()
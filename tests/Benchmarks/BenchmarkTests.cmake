@@ -0,0 +1,140 @@
+#
+# This file is distributed under the MIT License. See LICENSE.md for details.
+#
+
+# Benchmark definitions
+set(SRC ${CMAKE_SOURCE_DIR}/tests/Benchmarks)
+set(BENCHMARK_SOURCES_DIR ${CMAKE_CURRENT_BINARY_DIR}/tests/Benchmarks)
+
+set(BENCHMARK_RESULTS "${CMAKE_BINARY_DIR}/benchmarks.csv")
+set(BENCHMARK_BASELINE "${CMAKE_BINARY_DIR}/benchmarks-baseline.csv"
+  CACHE
+  FILEPATH
+  "Results of a previous run of the benchmarks to compare against.")
+set(BENCHMARK_TOLERANCE "0.1"
+  CACHE
+  STRING
+  "Fraction by which time and memory can exceed the baseline before a benchmark is reported as a regression.")
+set(BENCHMARK_REPEAT "3"
+  CACHE
+  STRING
+  "Number of translations of each benchmark, the best figures are compared with the baseline.")
+
+set(BENCHMARK_ARCHITECTURES "arm" "mips" "x86_64")
+set(BENCHMARKS "small" "medium" "large")
+
+# Arguments for generate-benchmark
+set(BENCHMARK_ARGS_small --functions 100 --jump-tables 10 --jump-table-size 16 --indirect-calls 0.25 --data-size 65536)
+set(BENCHMARK_ARGS_medium --functions 1000 --jump-tables 100 --jump-table-size 32 --indirect-calls 0.25 --data-size 1048576)
+set(BENCHMARK_ARGS_large --functions 5000 --jump-tables 500 --jump-table-size 64 --indirect-calls 0.5 --data-size 16777216)
+
+# Generate the sources
+file(MAKE_DIRECTORY ${BENCHMARK_SOURCES_DIR})
+foreach(BENCHMARK_NAME ${BENCHMARKS})
+  execute_process(COMMAND "${SRC}/generate-benchmark"
+    ${BENCHMARK_ARGS_${BENCHMARK_NAME}}
+    "${BENCHMARK_SOURCES_DIR}/${BENCHMARK_NAME}.c"
+    RESULT_VARIABLE GENERATE_RESULT)
+  if(NOT GENERATE_RESULT EQUAL 0)
+    message(FATAL_ERROR "Couldn't generate the ${BENCHMARK_NAME} benchmark")
+  endif()
+endforeach()
+
+set(BENCHMARK_BINARIES "")
+set(BENCHMARK_PROJECTS "")
+foreach(ARCH ${BENCHMARK_ARCHITECTURES})
+  list(FIND SUPPORTED_ARCHITECTURES "${ARCH}" ARCH_INDEX)
+  if(NOT ARCH_INDEX EQUAL -1)
+    list(APPEND BENCHMARK_PROJECTS TEST_PROJECT_${ARCH})
+    foreach(BENCHMARK_NAME ${BENCHMARKS})
+      # Optimize, so that switch statements are compiled to jump tables
+      register_for_compilation("${ARCH}"
+        "benchmark-${BENCHMARK_NAME}"
+        "${BENCHMARK_SOURCES_DIR}/${BENCHMARK_NAME}.c"
+        "-O2"
+        BINARY)
+      list(APPEND BENCHMARK_BINARIES "${BENCHMARK_NAME}-${ARCH}=${BINARY}")
+    endforeach()
+  endif()
+endforeach()
+
+# Translate all the benchmarks, collect the results and compare them with the
+# baseline
+if(BENCHMARK_BINARIES)
+  add_custom_target(bench
+    COMMAND "${SRC}/run-benchmarks"
+      --revamb $<TARGET_FILE:revamb>
+      --results "${BENCHMARK_RESULTS}"
+      --baseline "${BENCHMARK_BASELINE}"
+      --tolerance "${BENCHMARK_TOLERANCE}"
+      --repeat "${BENCHMARK_REPEAT}"
+      ${BENCHMARK_BINARIES}
+    VERBATIM)
+  add_dependencies(bench revamb ${BENCHMARK_PROJECTS})
+
+  # Make the results of the last run the new baseline
+  add_custom_target(bench-update-baseline
+    COMMAND ${CMAKE_COMMAND} -E copy "${BENCHMARK_RESULTS}" "${BENCHMARK_BASELINE}")
+endif()
+
+# Runtime benchmarks: CPU-bound workloads compiled natively and translated
+set(RUNTIME_BENCHMARK_RESULTS "${CMAKE_BINARY_DIR}/runtime-benchmarks.csv")
+set(RUNTIME_BENCHMARK_REPEAT "5"
+  CACHE
+  STRING
+  "Number of runs of each native and translated runtime benchmark.")
+
+set(RUNTIME_BENCHMARKS "checksum" "sort" "interpreter" "fp_kernels" "io_loop")
+
+set(RUNTIME_BENCHMARK_SOURCES_checksum "${SRC}/checksum.c")
+set(RUNTIME_BENCHMARK_ARGS_checksum "100")
+
+set(RUNTIME_BENCHMARK_SOURCES_sort "${SRC}/sort.c")
+set(RUNTIME_BENCHMARK_ARGS_sort "100000")
+
+set(RUNTIME_BENCHMARK_SOURCES_interpreter "${SRC}/interpreter.c")
+set(RUNTIME_BENCHMARK_ARGS_interpreter "1000000")
+
+set(RUNTIME_BENCHMARK_SOURCES_fp_kernels "${SRC}/fp-kernels.c")
+set(RUNTIME_BENCHMARK_ARGS_fp_kernels "10")
+
+set(RUNTIME_BENCHMARK_SOURCES_io_loop "${SRC}/io-loop.c")
+set(RUNTIME_BENCHMARK_ARGS_io_loop "100000")
+
+set(RUNTIME_BENCHMARK_SPECS "")
+set(RUNTIME_BENCHMARK_TARGETS "")
+foreach(BENCHMARK_NAME ${RUNTIME_BENCHMARKS})
+  add_executable(bench-native-${BENCHMARK_NAME} EXCLUDE_FROM_ALL
+    ${RUNTIME_BENCHMARK_SOURCES_${BENCHMARK_NAME}})
+  set_target_properties(bench-native-${BENCHMARK_NAME} PROPERTIES COMPILE_FLAGS "${TEST_CFLAGS} -O2")
+  set_target_properties(bench-native-${BENCHMARK_NAME} PROPERTIES LINK_FLAGS "${TEST_CFLAGS}")
+  list(APPEND RUNTIME_BENCHMARK_TARGETS bench-native-${BENCHMARK_NAME})
+endforeach()
+
+foreach(ARCH ${BENCHMARK_ARCHITECTURES})
+  list(FIND SUPPORTED_ARCHITECTURES "${ARCH}" ARCH_INDEX)
+  if(NOT ARCH_INDEX EQUAL -1)
+    foreach(BENCHMARK_NAME ${RUNTIME_BENCHMARKS})
+      register_for_compilation("${ARCH}"
+        "runtime-benchmark-${BENCHMARK_NAME}"
+        "${RUNTIME_BENCHMARK_SOURCES_${BENCHMARK_NAME}}"
+        "-O2"
+        BINARY)
+      list(APPEND RUNTIME_BENCHMARK_SPECS
+        "${BENCHMARK_NAME}-${ARCH},$<TARGET_FILE:bench-native-${BENCHMARK_NAME}>,${BINARY},${RUNTIME_BENCHMARK_ARGS_${BENCHMARK_NAME}}")
+    endforeach()
+  endif()
+endforeach()
+
+# Translate each workload at each optimization level, run it along with the
+# native version and report slowdown, dispatcher hits and code size
+if(RUNTIME_BENCHMARK_SPECS)
+  add_custom_target(bench-runtime
+    COMMAND "${SRC}/run-runtime-benchmarks"
+      --translate "${CMAKE_BINARY_DIR}/translate"
+      --results "${RUNTIME_BENCHMARK_RESULTS}"
+      --repeat "${RUNTIME_BENCHMARK_REPEAT}"
+      ${RUNTIME_BENCHMARK_SPECS}
+    VERBATIM)
+  add_dependencies(bench-runtime revamb ${BENCHMARK_PROJECTS} ${RUNTIME_BENCHMARK_TARGETS})
+endif()
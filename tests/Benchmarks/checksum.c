@@ -0,0 +1,72 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BUFFER_SIZE (64 * 1024)
+
+static uint8_t buffer[BUFFER_SIZE];
+static uint32_t crc_table[256];
+
+static void init_crc_table(void) {
+  uint32_t i, j;
+  for (i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    crc_table[i] = crc;
+  }
+}
+
+static uint32_t crc32(const uint8_t *data, size_t size) {
+  uint32_t crc = 0xffffffff;
+  size_t i;
+  for (i = 0; i < size; i++)
+    crc = (crc >> 8) ^ crc_table[(crc ^ data[i]) & 0xff];
+  return ~crc;
+}
+
+static uint32_t adler32(const uint8_t *data, size_t size) {
+  uint32_t a = 1, b = 0;
+  size_t i;
+  for (i = 0; i < size; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return (b << 16) | a;
+}
+
+static uint32_t fnv1a(const uint8_t *data, size_t size) {
+  uint32_t hash = 0x811c9dc5;
+  size_t i;
+  for (i = 0; i < size; i++)
+    hash = (hash ^ data[i]) * 0x01000193;
+  return hash;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 100;
+  uint32_t state = 1;
+  uint32_t result = 0;
+  int i;
+
+  for (i = 0; i < BUFFER_SIZE; i++) {
+    state = state * 1103515245 + 12345;
+    buffer[i] = state >> 16;
+  }
+
+  init_crc_table();
+
+  for (i = 0; i < iterations; i++) {
+    buffer[i % BUFFER_SIZE] ^= result;
+    result ^= crc32(buffer, BUFFER_SIZE);
+    result ^= adler32(buffer, BUFFER_SIZE);
+    result ^= fnv1a(buffer, BUFFER_SIZE);
+  }
+
+  printf("%08x\n", result);
+  return EXIT_SUCCESS;
+}
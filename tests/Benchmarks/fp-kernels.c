@@ -0,0 +1,68 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MATRIX_SIZE 48
+
+static double a[MATRIX_SIZE][MATRIX_SIZE];
+static double b[MATRIX_SIZE][MATRIX_SIZE];
+static double c[MATRIX_SIZE][MATRIX_SIZE];
+
+static void matrix_multiply(void) {
+  int i, j, k;
+  for (i = 0; i < MATRIX_SIZE; i++)
+    for (j = 0; j < MATRIX_SIZE; j++) {
+      double sum = 0.0;
+      for (k = 0; k < MATRIX_SIZE; k++)
+        sum += a[i][k] * b[k][j];
+      c[i][j] = sum;
+    }
+}
+
+// Number of points of a grid of the given size in the Mandelbrot set
+static int mandelbrot(int size) {
+  int x, y, result = 0;
+  for (y = 0; y < size; y++)
+    for (x = 0; x < size; x++) {
+      double cr = 2.5 * x / size - 2.0;
+      double ci = 2.0 * y / size - 1.0;
+      double zr = 0.0, zi = 0.0;
+      int iteration = 0;
+      while (iteration < 64 && zr * zr + zi * zi < 4.0) {
+        double tmp = zr * zr - zi * zi + cr;
+        zi = 2.0 * zr * zi + ci;
+        zr = tmp;
+        iteration++;
+      }
+      result += iteration == 64;
+    }
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 10;
+  double trace = 0.0;
+  int inside = 0;
+  int i, j;
+
+  for (i = 0; i < MATRIX_SIZE; i++)
+    for (j = 0; j < MATRIX_SIZE; j++) {
+      a[i][j] = (double) (i + j) / MATRIX_SIZE;
+      b[i][j] = (double) ((i * j) % 7) / MATRIX_SIZE;
+    }
+
+  for (i = 0; i < iterations; i++) {
+    matrix_multiply();
+    for (j = 0; j < MATRIX_SIZE; j++)
+      trace += c[j][j];
+    inside += mandelbrot(64);
+  }
+
+  // Print a rounded value, so that the output doesn't depend on the exact
+  // floating point implementation
+  printf("%d %d\n", (int) trace, inside);
+  return EXIT_SUCCESS;
+}
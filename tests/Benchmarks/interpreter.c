@@ -0,0 +1,118 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// A tiny stack-based bytecode interpreter: its dispatch loop is a switch, i.e.,
+// an indirect jump taken for each instruction
+typedef enum {
+  OP_PUSH,
+  OP_LOAD,
+  OP_STORE,
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_MOD,
+  OP_LT,
+  OP_JZ,
+  OP_JMP,
+  OP_DUP,
+  OP_POP,
+  OP_HALT
+} opcode;
+
+#define MAX_STACK 64
+#define MAX_VARIABLES 8
+
+static int32_t run(const int32_t *program, int32_t *variables) {
+  int32_t stack[MAX_STACK];
+  int sp = 0;
+  int pc = 0;
+
+  for (;;) {
+    int32_t a, b;
+    switch (program[pc++]) {
+    case OP_PUSH:
+      stack[sp++] = program[pc++];
+      break;
+    case OP_LOAD:
+      stack[sp++] = variables[program[pc++]];
+      break;
+    case OP_STORE:
+      variables[program[pc++]] = stack[--sp];
+      break;
+    case OP_ADD:
+      b = stack[--sp];
+      a = stack[--sp];
+      stack[sp++] = a + b;
+      break;
+    case OP_SUB:
+      b = stack[--sp];
+      a = stack[--sp];
+      stack[sp++] = a - b;
+      break;
+    case OP_MUL:
+      b = stack[--sp];
+      a = stack[--sp];
+      stack[sp++] = a * b;
+      break;
+    case OP_MOD:
+      b = stack[--sp];
+      a = stack[--sp];
+      stack[sp++] = b != 0 ? a % b : 0;
+      break;
+    case OP_LT:
+      b = stack[--sp];
+      a = stack[--sp];
+      stack[sp++] = a < b;
+      break;
+    case OP_JZ:
+      a = stack[--sp];
+      if (a == 0)
+        pc = program[pc];
+      else
+        pc++;
+      break;
+    case OP_JMP:
+      pc = program[pc];
+      break;
+    case OP_DUP:
+      a = stack[sp - 1];
+      stack[sp++] = a;
+      break;
+    case OP_POP:
+      sp--;
+      break;
+    case OP_HALT:
+      return sp > 0 ? stack[sp - 1] : 0;
+    default:
+      abort();
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int32_t iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+  int32_t variables[MAX_VARIABLES] = { 0 };
+
+  // i = 0; sum = 0;
+  // while (i < n) { sum = (sum * 7 + i) % 1000003; i = i + 1; }
+  // return sum;
+  const int32_t program[] = {
+    /*  0 */ OP_PUSH, 0, OP_STORE, 0,
+    /*  4 */ OP_PUSH, 0, OP_STORE, 1,
+    /*  8 */ OP_LOAD, 0, OP_LOAD, 2, OP_LT, OP_JZ, 38,
+    /* 15 */ OP_LOAD, 1, OP_PUSH, 7, OP_MUL, OP_LOAD, 0, OP_ADD,
+    /* 23 */ OP_PUSH, 1000003, OP_MOD, OP_STORE, 1,
+    /* 28 */ OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0,
+    /* 35 */ OP_JMP, 8, OP_HALT,
+    /* 38 */ OP_LOAD, 1, OP_HALT
+  };
+
+  variables[2] = iterations;
+  printf("%d\n", run(program, variables));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CHUNK_SIZE 64
+
+// Bounce small chunks of data through a pipe, so that most of the time is spent
+// performing system calls
+int main(int argc, char *argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+  uint8_t output[CHUNK_SIZE];
+  uint8_t input[CHUNK_SIZE];
+  uint32_t result = 0;
+  int pipe_fds[2];
+  int i, j;
+
+  if (pipe(pipe_fds) != 0)
+    return EXIT_FAILURE;
+
+  for (i = 0; i < iterations; i++) {
+    for (j = 0; j < CHUNK_SIZE; j++)
+      output[j] = i + j;
+
+    if (write(pipe_fds[1], output, CHUNK_SIZE) != CHUNK_SIZE)
+      return EXIT_FAILURE;
+    if (read(pipe_fds[0], input, CHUNK_SIZE) != CHUNK_SIZE)
+      return EXIT_FAILURE;
+
+    for (j = 0; j < CHUNK_SIZE; j++)
+      result = result * 31 + input[j];
+
+    result ^= getppid() != 0;
+  }
+
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+
+  printf("%08x\n", result);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t state = 1;
+
+static uint32_t next_random(void) {
+  state = state * 1103515245 + 12345;
+  return state >> 8;
+}
+
+static void fill(uint32_t *array, size_t size) {
+  size_t i;
+  for (i = 0; i < size; i++)
+    array[i] = next_random();
+}
+
+static void quick_sort(uint32_t *array, long low, long high) {
+  while (low < high) {
+    uint32_t pivot = array[(low + high) / 2];
+    long i = low;
+    long j = high;
+
+    while (i <= j) {
+      while (array[i] < pivot)
+        i++;
+      while (array[j] > pivot)
+        j--;
+      if (i <= j) {
+        uint32_t tmp = array[i];
+        array[i] = array[j];
+        array[j] = tmp;
+        i++;
+        j--;
+      }
+    }
+
+    // Recurse on the smaller half
+    if (j - low < high - i) {
+      quick_sort(array, low, j);
+      low = i;
+    } else {
+      quick_sort(array, i, high);
+      high = j;
+    }
+  }
+}
+
+static void merge_sort(uint32_t *array, uint32_t *scratch, size_t size) {
+  size_t width, i;
+  for (width = 1; width < size; width *= 2) {
+    for (i = 0; i < size; i += 2 * width) {
+      size_t middle = i + width < size ? i + width : size;
+      size_t end = i + 2 * width < size ? i + 2 * width : size;
+      size_t left = i, right = middle, k = i;
+      while (left < middle && right < end)
+        scratch[k++] = array[left] <= array[right] ? array[left++]
+                                                   : array[right++];
+      while (left < middle)
+        scratch[k++] = array[left++];
+      while (right < end)
+        scratch[k++] = array[right++];
+    }
+    memcpy(array, scratch, size * sizeof(uint32_t));
+  }
+}
+
+// Exercise indirect calls through the C library
+static int compare(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *) a;
+  uint32_t y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t checksum(const uint32_t *array, size_t size) {
+  uint32_t result = 0;
+  size_t i;
+  for (i = 0; i < size; i++)
+    result = result * 31 + array[i];
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  size_t size = argc > 1 ? atoi(argv[1]) : 100000;
+  uint32_t *array = malloc(size * sizeof(uint32_t));
+  uint32_t *scratch = malloc(size * sizeof(uint32_t));
+  uint32_t result = 0;
+
+  if (array == NULL || scratch == NULL)
+    return EXIT_FAILURE;
+
+  fill(array, size);
+  quick_sort(array, 0, (long) size - 1);
+  result ^= checksum(array, size);
+
+  fill(array, size);
+  merge_sort(array, scratch, size);
+  result ^= checksum(array, size);
+
+  fill(array, size);
+  qsort(array, size, sizeof(uint32_t), compare);
+  result ^= checksum(array, size);
+
+  printf("%08x\n", result);
+
+  free(scratch);
+  free(array);
+  return EXIT_SUCCESS;
+}
@@ -22,6 +22,9 @@ set(TEST_SOURCES_function_call "${SRC}/function-call.c")
 set(TEST_RUNS_function_call "default")
 set(TEST_ARGS_function_call_default "nope")
 
+# Also translate only root, its call to half must leave the region
+set(TEST_ONLY_function_call "root")
+
 ## floating_point
 set(TEST_SOURCES_floating_point "${SRC}/floating-point.c")
 
@@ -76,6 +79,7 @@ function(compile_executable OBJECTS TARGET OUTPUT)
   parse("${CMAKE_C_LINK_EXECUTABLE}" "${OUTPUT}")
 endfunction()
 
+set(LIFTING_BENCHMARK_COMMANDS "")
 foreach(ARCH ${SUPPORTED_ARCHITECTURES})
   foreach(TEST_NAME ${TESTS})
     # Register the programs for compilation
@@ -87,6 +91,28 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
     set_tests_properties(translate-${TEST_NAME}-${ARCH}
       PROPERTIES LABELS "runtime;translate;${TEST_NAME};${ARCH}")
 
+    # Translate a single function, nothing outside of it must be translated.
+    # Debug names are not enabled, basic blocks must be named after their PC
+    if(DEFINED TEST_ONLY_${TEST_NAME})
+      set(ONLY "${TEST_ONLY_${TEST_NAME}}")
+      add_test(NAME translate-only-${ONLY}-${TEST_NAME}-${ARCH}
+        COMMAND $<TARGET_FILE:revamb> --only "${ONLY}" --use-sections "${BINARY}" "${BINARY}.only-${ONLY}.ll")
+      set_tests_properties(translate-only-${ONLY}-${TEST_NAME}-${ARCH}
+        PROPERTIES LABELS "runtime;translate-only;${TEST_NAME};${ARCH}")
+
+      add_test(NAME check-only-${ONLY}-${TEST_NAME}-${ARCH}
+        COMMAND "${SRC}/check-region" "${BINARY}" "${ONLY}" "${BINARY}.only-${ONLY}.ll")
+      set_tests_properties(check-only-${ONLY}-${TEST_NAME}-${ARCH}
+        PROPERTIES DEPENDS translate-only-${ONLY}-${TEST_NAME}-${ARCH}
+                   LABELS "runtime;check-only;${TEST_NAME};${ARCH}")
+    endif()
+
+    # Lifting microbenchmark: translate the compiled binary reporting the time
+    # spent lifting each PTC instruction
+    list(APPEND LIFTING_BENCHMARK_COMMANDS
+      COMMAND ${CMAKE_COMMAND} -E echo "${TEST_NAME}-${ARCH}:"
+      COMMAND $<TARGET_FILE:revamb> -d liftingtime --use-sections ${BINARY} ${BINARY}.bench.ll)
+
     # Compose the command line to link support.c and the translated binaries
     string(REPLACE "-" "_" NORMALIZED_ARCH "${ARCH}")
     compile_executable("$(${CMAKE_BINARY_DIR}/li-csv-to-ld-options ${BINARY}.ll.li.csv) ${BINARY}${CMAKE_C_OUTPUT_EXTENSION} ${CMAKE_BINARY_DIR}/support.c -DTARGET_${NORMALIZED_ARCH} -lz -lm -lrt -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast -g -fno-pie"
@@ -139,3 +165,7 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
   endforeach()
 
 endforeach()
+
+# Run the lifting microbenchmark on all the compiled test programs
+add_custom_target(bench-lifting ${LIFTING_BENCHMARK_COMMANDS})
+add_dependencies(bench-lifting revamb)
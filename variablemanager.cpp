@@ -7,6 +7,7 @@
 //
 
 // Standard includes
+#include <algorithm>
 #include <cstdint>
 #include <stack>
 #include <sstream>
@@ -80,6 +81,8 @@ private:
 
 static const int64_t ErrorOffset = std::numeric_limits<int64_t>::max();
 
+const char *VariableManager::CPUStateMDName = "revamb.cpustate";
+
 bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
   OffsetValueStack WorkList;
 
@@ -91,15 +94,25 @@ bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
 
   assert(CPUStatePtr->getType()->isPointerTy());
 
+  using SpecializedArguments = std::vector<std::pair<unsigned, int64_t>>;
+
   struct Specialization {
     Function *F;
     Function *Original;
-    std::vector<std::pair<unsigned, int64_t>> SpecializedArgs;
+    SpecializedArguments SpecializedArgs;
   };
 
-  std::vector<Specialization> Specializations;
+  // Specializations indexed by the specialized function and by the pair
+  // (original function, sorted specialized arguments)
+  std::map<Function *, Specialization> Specializations;
+  std::map<std::pair<Function *, SpecializedArguments>,
+           Function *> SpecializationCache;
   std::map<Function *, int64_t> OffsetFunctions;
 
+  unsigned RewrittenAccesses = 0;
+  unsigned SpecializationCacheHits = 0;
+  unsigned UnhandledAccesses = 0;
+
   const DataLayout& DL = TheModule.getDataLayout();
 
   while (true) {
@@ -167,10 +180,13 @@ bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
                                                   ToStore);
           }
 
-          if (Success)
+          if (Success) {
+            RewrittenAccesses++;
             Replacements.push_back(std::make_tuple(TheUser, nullptr, nullptr));
-          else
+          } else {
+            UnhandledAccesses++;
             Builder.CreateCall(TheModule.getFunction("abort"));
+          }
 
           break;
         }
@@ -278,6 +294,7 @@ bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
                 Builder.CreateStore(Builder.CreateLoad(Ptr), Var);
               else
                 Builder.CreateStore(Builder.CreateLoad(Var), Ptr);
+              RewrittenAccesses++;
 
               Offset += Size;
             }
@@ -305,23 +322,19 @@ bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
 
           // TODO: move all the specialization-handling code outside
           // Is the callee already a specialization?
-          auto Comparison = [&Callee] (Specialization &S) {
-            return S.F == Callee;
-          };
-          auto CurrentSpecialization = std::find_if(Specializations.begin(),
-                                                    Specializations.end(),
-                                                    Comparison);
+          auto CurrentSpecialization = Specializations.find(Callee);
 
           Function *Original = Callee;
-          std::vector<std::pair<unsigned, int64_t>> SpecializedArgs;
+          SpecializedArguments SpecializedArgs;
 
           // If the callee was already a specialization, preserve its
           // specialized arguments
           if (CurrentSpecialization != Specializations.end()) {
+            const Specialization &Current = CurrentSpecialization->second;
 
             // Check if we're good with this specialization
             bool SpecializationMatches = false;
-            for (auto &P : CurrentSpecialization->SpecializedArgs) {
+            for (auto &P : Current.SpecializedArgs) {
               if (P.first == TheUse.getOperandNo()) {
                 assert(P.second == CurrentOffset);
                 SpecializationMatches = true;
@@ -332,42 +345,23 @@ bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
             if (SpecializationMatches)
               continue;
 
-            Original = CurrentSpecialization->Original;
-            SpecializedArgs = CurrentSpecialization->SpecializedArgs;
+            Original = Current.Original;
+            SpecializedArgs = Current.SpecializedArgs;
           }
 
-          // Add the new argument to specialize
+          // Add the new argument to specialize, keep them sorted so that they
+          // can be used as a key
           SpecializedArgs.push_back({ TheUse.getOperandNo(), CurrentOffset });
+          std::sort(SpecializedArgs.begin(), SpecializedArgs.end());
 
           // Does the specialization we want already exists?
-          Specialization *Matching = nullptr;
-          for (Specialization &S : Specializations) {
-            if (S.Original == Original
-                && S.SpecializedArgs.size() == SpecializedArgs.size()) {
-
-              Matching = &S;
-              for (std::pair<unsigned, int64_t> A : SpecializedArgs) {
-
-                bool Found = false;
-                for (std::pair<unsigned, int64_t> B : S.SpecializedArgs) {
-                  if (A.first == B.first && A.second == B.second) {
-                    Found = true;
-                    break;
-                  }
-                }
-                if (!Found) {
-                  Matching = nullptr;
-                  break;
-                }
-              }
-
-              if (Matching != nullptr)
-                break;
-
-            }
-          }
-
-          if (Matching == nullptr) {
+          Function *Matching = nullptr;
+          auto Key = std::make_pair(Original, SpecializedArgs);
+          auto CacheIt = SpecializationCache.find(Key);
+          if (CacheIt != SpecializationCache.end()) {
+            Matching = CacheIt->second;
+            SpecializationCacheHits++;
+          } else {
             // We need a new specialization
             ValueToValueMapTy VTV;
             SmallVector<ReturnInst *, 5> Returns;
@@ -396,12 +390,9 @@ bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
 
             CloneFunctionInto(NewFunc, Callee, VTV, true, Returns);
 
-            Specialization New;
-            New.F = NewFunc;
-            New.Original = Original;
-            New.SpecializedArgs = SpecializedArgs;
-            Specializations.push_back(New);
-            Matching = &Specializations.back();
+            Specializations[NewFunc] = { NewFunc, Original, SpecializedArgs };
+            SpecializationCache[Key] = NewFunc;
+            Matching = NewFunc;
 
             // The function is new, we have to explore its argument usage
 
@@ -428,12 +419,12 @@ bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
             }
           }
 
-          auto It = OffsetFunctions.find(Matching->F);
+          auto It = OffsetFunctions.find(Matching);
           if (It != OffsetFunctions.end())
             WorkList.push(It->second, static_cast<Value *>(Call));
 
           auto *OriginalCalleeTy = Call->getCalledValue()->getType();
-          Call->setCalledFunction(ConstantExpr::getBitCast(Matching->F,
+          Call->setCalledFunction(ConstantExpr::getBitCast(Matching,
                                                            OriginalCalleeTy));
 
           break;
@@ -464,6 +455,12 @@ bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
                                                     std::get<2>(Replacement));
   }
 
+  DBG("cpustate", dbg << std::dec
+                      << RewrittenAccesses << " CPU state accesses rewritten, "
+                      << UnhandledAccesses << " unhandled, "
+                      << Specializations.size() << " specializations created, "
+                      << SpecializationCacheHits << " reused\n");
+
   return true;
 }
 
@@ -474,52 +471,6 @@ static RegisterPass<CorrectCPUStateUsagePass> X("correct-cpustate-usage",
                                                 false,
                                                 false);
 
-static std::pair<Type *, unsigned> getTypeAtOffset(const DataLayout *TheLayout,
-                                                   StructType *TheStruct,
-                                                   intptr_t Offset,
-                                                   unsigned Depth=0) {
-  const StructLayout *Layout = TheLayout->getStructLayout(TheStruct);
-  unsigned FieldIndex = Layout->getElementContainingOffset(Offset);
-  uint64_t FieldOffset = Layout->getElementOffset(FieldIndex);
-  Type *VariableType = TheStruct->getTypeAtIndex(FieldIndex);
-  intptr_t FieldEnd = (FieldOffset
-                       + TheLayout->getTypeSizeInBits(VariableType) / 8);
-
-  DBG("type-at-offset", dbg
-      << std::string(Depth * 2, ' ')
-      << "Offset: " << Offset << " "
-      << "Name: " << TheStruct->getName().str() << " "
-      << "Index: " << FieldIndex << " "
-      << "Field offset: " << FieldOffset << " "
-      << "\n");
-
-  if (Offset >= FieldEnd)
-    return { nullptr, 0 };
-
-  if (VariableType->isIntegerTy())
-    return { VariableType, Offset - FieldOffset };
-  else if (VariableType->isArrayTy()) {
-    Type *ElementType = VariableType->getArrayElementType();
-    uint64_t ElementSize = TheLayout->getTypeSizeInBits(ElementType) / 8;
-    if (ElementType->isIntegerTy())
-      return { ElementType, (Offset - FieldOffset) % ElementSize };
-
-    return getTypeAtOffset(TheLayout,
-                           cast<StructType>(ElementType),
-                           (Offset - FieldOffset) % ElementSize,
-                           Depth + 1);
-
-  } else if (VariableType->isStructTy())
-    return getTypeAtOffset(TheLayout,
-                           cast<StructType>(VariableType),
-                           Offset - FieldOffset,
-                           Depth + 1);
-  else {
-    // TODO: do some kind of warning reporting here
-    return { nullptr, 0 };
-  }
-}
-
 VariableManager::VariableManager(Module& TheModule,
                                  Module& HelpersModule,
                                  Architecture& TargetArchitecture) :
@@ -549,6 +500,26 @@ VariableManager::VariableManager(Module& TheModule,
 
   assert(ptc.initialized_env != nullptr);
 
+  std::tie(CPUStateType, EnvOffset) = electCPUStateType(HelpersModule);
+}
+
+std::pair<StructType *, unsigned>
+VariableManager::electCPUStateType(Module &HelpersModule) {
+  QuickMetadata QMD(HelpersModule.getContext());
+
+  // Have we already performed the election on this module?
+  if (NamedMDNode *Cache = HelpersModule.getNamedMetadata(CPUStateMDName)) {
+    auto *Tuple = cast<MDTuple>(Cache->getOperand(0));
+    auto Name = QMD.extract<StringRef>(Tuple, 0);
+    StructType *Cached = HelpersModule.getTypeByName(Name);
+    assert(Cached != nullptr);
+    return { Cached, QMD.extract<uint32_t>(Tuple, 1) };
+  }
+
+  // Elect as CPU state the structure most frequently passed by pointer to
+  // helpers. Only the function prototypes are inspected, so this doesn't
+  // require materializing the helpers.
+  const DataLayout &TheLayout = HelpersModule.getDataLayout();
   using ElectionMap = std::map<StructType *, unsigned>;
   using ElectionMapElement = std::pair<StructType * const, unsigned>;
   ElectionMap EnvElection;
@@ -591,12 +562,14 @@ VariableManager::VariableManager(Module& TheModule,
 
   assert(EnvElection.size() > 0);
 
-  CPUStateType = std::max_element(EnvElection.begin(),
-                                  EnvElection.end(),
-                                  [] (ElectionMapElement& It1,
-                                      ElectionMapElement& It2) {
-                                    return It1.second < It2.second;
-                                  })->first;
+  auto Winner = std::max_element(EnvElection.begin(),
+                                 EnvElection.end(),
+                                 [] (ElectionMapElement& It1,
+                                     ElectionMapElement& It2) {
+                                   return It1.second < It2.second;
+                                 });
+  StructType *CPUStateType = Winner->first;
+  unsigned EnvOffset = 0;
 
   // Look for structures containing CPUStateType as a member and promove them
   // to CPUStateType. Basically this is a flexible way to keep track of the *CPU
@@ -616,7 +589,7 @@ VariableManager::VariableManager(Module& TheModule,
       if (Found != End) {
         unsigned Index = Found - Begin;
         const StructLayout *Layout = nullptr;
-        Layout = ModuleLayout->getStructLayout(TheStruct);
+        Layout = TheLayout.getStructLayout(TheStruct);
         EnvOffset += Layout->getElementOffset(Index);
         CPUStateType = TheStruct;
         Visited.insert(CPUStateType);
@@ -625,6 +598,18 @@ VariableManager::VariableManager(Module& TheModule,
       }
     }
   }
+
+  // Cache the result of the election in the module, unless the winner has no
+  // name to find it back
+  if (CPUStateType->hasName()) {
+    NamedMDNode *Cache = HelpersModule.getOrInsertNamedMetadata(CPUStateMDName);
+    Cache->addOperand(QMD.tuple({
+          QMD.get(CPUStateType->getName().str().c_str()),
+          QMD.get(EnvOffset)
+        }));
+  }
+
+  return { CPUStateType, EnvOffset };
 }
 
 bool VariableManager::storeToCPUStateOffset(IRBuilder<> &Builder,
@@ -814,61 +799,114 @@ GlobalVariable* VariableManager::getByCPUStateOffset(intptr_t Offset,
   return Result;
 }
 
+void VariableManager::fillCPUStateLayout(const DataLayout *TheLayout,
+                                         Type *TheType,
+                                         uint64_t Base,
+                                         std::vector<CPUStateByte> &Result) {
+  if (auto *Integer = dyn_cast<IntegerType>(TheType)) {
+    uint64_t Size = TheLayout->getTypeSizeInBits(Integer) / 8;
+    for (uint64_t I = 0; I < Size; I++) {
+      Result[Base + I].Type = Integer;
+      Result[Base + I].Remaining = I;
+    }
+  } else if (auto *Struct = dyn_cast<StructType>(TheType)) {
+    const StructLayout *Layout = TheLayout->getStructLayout(Struct);
+    for (unsigned I = 0; I < Struct->getNumElements(); I++)
+      fillCPUStateLayout(TheLayout,
+                         Struct->getElementType(I),
+                         Base + Layout->getElementOffset(I),
+                         Result);
+  } else if (auto *Array = dyn_cast<ArrayType>(TheType)) {
+    Type *ElementType = Array->getElementType();
+    uint64_t ElementSize = TheLayout->getTypeAllocSize(ElementType);
+    for (uint64_t I = 0; I < Array->getNumElements(); I++)
+      fillCPUStateLayout(TheLayout,
+                         ElementType,
+                         Base + I * ElementSize,
+                         Result);
+  }
+
+  // TODO: do some kind of warning reporting for other types
+}
+
+VariableManager::CPUStateByte *
+VariableManager::getLayoutEntry(intptr_t Offset) {
+  if (CPUStateLayout.empty()) {
+    uint64_t Size = ModuleLayout->getTypeAllocSize(CPUStateType);
+    CPUStateLayout.resize(Size);
+    fillCPUStateLayout(ModuleLayout, CPUStateType, 0, CPUStateLayout);
+
+    for (auto &P : CPUStateGlobals)
+      if (P.first >= 0 && static_cast<uint64_t>(P.first) < Size)
+        CPUStateLayout[P.first].CSV = P.second;
+
+    DBG("type-at-offset", dbg << "CPU state layout: " << std::dec
+                              << CPUStateLayout.size() << " bytes\n");
+  }
+
+  if (Offset < 0 || static_cast<uint64_t>(Offset) >= CPUStateLayout.size())
+    return nullptr;
+
+  return &CPUStateLayout[Offset];
+}
+
 std::pair<GlobalVariable*, unsigned>
 VariableManager::getByCPUStateOffsetInternal(intptr_t Offset,
                                              std::string Name) {
   if (Offset == ErrorOffset)
     return { nullptr, 0 };
 
-  GlobalsMap::iterator it = CPUStateGlobals.find(Offset);
-  if (it == CPUStateGlobals.end() ||
-      (Name.size() != 0 && !it->second->getName().equals_lower(Name))) {
-    Type *VariableType;
-    unsigned Remaining;
-    std::tie(VariableType, Remaining) = getTypeAtOffset(ModuleLayout,
-                                                        CPUStateType,
-                                                        Offset);
-
-    // Check we're not trying to go inside an existing variable
-    if (Remaining != 0) {
-      GlobalsMap::iterator it = CPUStateGlobals.find(Offset - Remaining);
-      if (it != CPUStateGlobals.end())
-        return { it->second, Remaining };
-    }
+  // Offsets outside the CPU state are not supported, let the caller handle the
+  // situation
+  CPUStateByte *Entry = getLayoutEntry(Offset);
+  if (Entry == nullptr)
+    return { nullptr, 0 };
 
-    // Unsupported type, let the caller handle the situation
-    if (VariableType == nullptr)
-      return { nullptr, 0 };
+  GlobalVariable *Existing = Entry->CSV;
+  if (Existing != nullptr
+      && (Name.size() == 0 || Existing->getName().equals_lower(Name)))
+    return { Existing, 0 };
 
-    if (Name.size() == 0) {
-      std::stringstream NameStream;
-      NameStream << "state_0x" << std::hex << Offset;
-      Name = NameStream.str();
-    }
+  Type *VariableType = Entry->Type;
+  unsigned Remaining = Entry->Remaining;
 
-    // TODO: offset could be negative, we could segfault here
-    auto *InitialValue = fromBytes(cast<IntegerType>(VariableType),
-                                   ptc.initialized_env - EnvOffset + Offset);
-
-    auto *NewVariable = new GlobalVariable(TheModule,
-                                           VariableType,
-                                           false,
-                                           GlobalValue::ExternalLinkage,
-                                           InitialValue,
-                                           Name);
-    assert(NewVariable != nullptr);
-
-    if (it != CPUStateGlobals.end()) {
-      it->second->replaceAllUsesWith(NewVariable);
-      it->second->eraseFromParent();
-    }
+  // Check we're not trying to go inside an existing variable
+  if (Remaining != 0) {
+    GlobalVariable *Container = getLayoutEntry(Offset - Remaining)->CSV;
+    if (Container != nullptr)
+      return { Container, Remaining };
+  }
 
-    CPUStateGlobals[Offset] = NewVariable;
+  // Unsupported type, let the caller handle the situation
+  if (VariableType == nullptr)
+    return { nullptr, 0 };
 
-    return { NewVariable, Remaining };
-  } else {
-    return { it->second, 0 };
+  if (Name.size() == 0) {
+    std::stringstream NameStream;
+    NameStream << "state_0x" << std::hex << Offset;
+    Name = NameStream.str();
   }
+
+  auto *InitialValue = fromBytes(cast<IntegerType>(VariableType),
+                                 ptc.initialized_env - EnvOffset + Offset);
+
+  auto *NewVariable = new GlobalVariable(TheModule,
+                                         VariableType,
+                                         false,
+                                         GlobalValue::ExternalLinkage,
+                                         InitialValue,
+                                         Name);
+  assert(NewVariable != nullptr);
+
+  if (Existing != nullptr) {
+    Existing->replaceAllUsesWith(NewVariable);
+    Existing->eraseFromParent();
+  }
+
+  CPUStateGlobals[Offset] = NewVariable;
+  Entry->CSV = NewVariable;
+
+  return { NewVariable, Remaining };
 }
 
 Value *VariableManager::getOrCreate(unsigned TemporaryId, bool Reading) {
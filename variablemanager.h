@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <map>
 #include <string>
+#include <vector>
 
 // LLVM includes
 #include "llvm/IR/IRBuilder.h"
@@ -138,6 +139,9 @@ public:
 
   void setDataLayout(const llvm::DataLayout *NewLayout) {
     ModuleLayout = NewLayout;
+
+    // The layout of the CPU state has to be recomputed
+    CPUStateLayout.clear();
   }
 
   template<typename T>
@@ -167,6 +171,28 @@ public:
     return storeToCPUStateOffset(Builder, StoreSize, ActualOffset, ToStore);
   }
 
+  /// \brief Identify the type of the CPU state and the offset of `env` in it
+  ///
+  /// The CPU state type is elected among the structures passed by pointer to
+  /// the helpers, then it is promoted to the outermost structure containing it
+  /// (e.g., `MIPSCPU`). The result is cached in \p HelpersModule as the
+  /// `revamb.cpustate` named metadata, so that the election is performed only
+  /// once per module.
+  ///
+  /// \return a pair composed by the CPU state type and the offset of `env`
+  ///         within it.
+  static std::pair<llvm::StructType *, unsigned>
+  electCPUStateType(llvm::Module &HelpersModule);
+
+  /// \brief Name of the named metadata caching the CPU state election
+  static const char *CPUStateMDName;
+
+  /// \brief Return the CSVs created so far, indexed by their offset in the CPU
+  ///        state
+  const std::map<intptr_t, llvm::GlobalVariable *> &cpuStateGlobals() const {
+    return CPUStateGlobals;
+  }
+
   /// \brief Perform finalization steps on variables
   ///
   /// \param ExternalCSVs true if CSVs linkage should not be turned into static.
@@ -180,6 +206,29 @@ public:
   }
 
 private:
+  /// \brief Description of a byte of the CPU state
+  struct CPUStateByte {
+    CPUStateByte() : CSV(nullptr), Type(nullptr), Remaining(0) { }
+
+    llvm::GlobalVariable *CSV; ///< The CSV associated to this offset, if any
+    llvm::Type *Type; ///< Type of the field containing this byte, if supported
+    unsigned Remaining; ///< Offset of this byte within its field
+  };
+
+  /// \brief Return the entry of the flat CPU state layout for \p Offset
+  ///
+  /// The layout is built upon the first request, so that each offset is
+  /// resolved in constant time from there on.
+  ///
+  /// \return the requested entry, or nullptr if \p Offset is out of the CPU
+  ///         state.
+  CPUStateByte *getLayoutEntry(intptr_t Offset);
+
+  static void fillCPUStateLayout(const llvm::DataLayout *TheLayout,
+                                 llvm::Type *TheType,
+                                 uint64_t Base,
+                                 std::vector<CPUStateByte> &Result);
+
   llvm::Value *loadFromCPUStateOffset(llvm::IRBuilder<> &Builder,
                                       unsigned LoadSize,
                                       unsigned Offset);
@@ -207,6 +256,7 @@ private:
   PTCInstructionList *Instructions;
 
   llvm::StructType *CPUStateType;
+  std::vector<CPUStateByte> CPUStateLayout;
   const llvm::DataLayout *ModuleLayout;
   unsigned EnvOffset;
 